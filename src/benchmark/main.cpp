@@ -0,0 +1,948 @@
+//============================================================================
+// main.cpp: Colibri benchmark
+//
+// Measures the search path without any GUI on synthetic Start Menu-like
+// corpora, e.g. "benchmark 1000 10000 100000 > results.txt". Results are
+// written to stdout as one JSON object per line, progress to stderr.
+//
+// Suites:
+//   match  - ns per match() call for every keystroke of the query sequences
+//   search - p50/p99 latency of database::search() (including stepping the
+//            result set, as db_controller does) per keystroke sequence
+//   index  - items/s of add_or_update_item() when (re-)indexing the corpus
+//   search_utf8, index_utf8 - the same on a database encoded as UTF-8, which
+//            SQLite converts from and to UTF-16 on every access (colibri
+//            creates UTF-16le databases, but keeps the encoding of old ones)
+//   compositing - ns per 32x32 icon blit (blend, copy and from an atlas) and
+//            per atlas add/remove, after checking blending, clipping and
+//            atlas page management against known results (the benchmark
+//            fails if a check does)
+//
+// The database suites work in a temporary profile folder, which is deleted
+// afterwards, or in the folder given with "-profile <folder>" (the real
+// profile folder is never touched unless given explicitly).
+//
+// "benchmark -replay sessions.txt database.sqlite" instead replays sessions
+// recorded by the session_recorder (see "Query statistics" in the Colibri
+// menu) against a copy of a database snapshot and reports the latency of
+// each keystroke, both of the search alone and end-to-end (i.e. including
+// the time the keystroke had to wait for the previous search). It also
+// reports the heap allocations per keystroke of building the options in an
+// arena (as db_controller does) and with a string per column (as it did
+// before), counting operator new calls (SQLite's own allocations, which are
+// the same for both, aren't included).
+//
+// The database suites need the SQLite wrapper, which passes wchar_t strings
+// to SQLite's UTF-16 interface, so they are only built on Windows. The match
+// and compositing suites build anywhere, e.g. on Linux:
+//   g++ -O2 -I../colibri main.cpp ../colibri/db/match.cpp
+//     ../colibri/libraries/log/log.cpp ../colibri/libraries/log/metrics.cpp
+//     ../colibri/libraries/gfx/surface.cpp ../colibri/libraries/gfx/atlas.cpp
+//     -lboost_filesystem -lboost_system -lboost_thread -o colibri_benchmark
+//
+// (c) Michael Walter, 2005-2007
+//============================================================================
+
+#include "../colibri/db/match.h"
+#include "../colibri/libraries/log/metrics.h"
+#include "../colibri/libraries/gfx/atlas.h"
+#ifdef _WIN32
+#include "../colibri/plugins/plugin.h"
+#include "../colibri/db/session_recorder.h"
+#include <boost/lexical_cast.hpp>
+#endif
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <algorithm>
+#include <set>
+#include <string>
+#include <vector>
+#include <stdexcept>
+using namespace std;
+//----------------------------------------------------------------------------
+
+
+#ifdef _WIN32
+//============================================================================
+// operator new()/delete()
+//
+// Counts heap allocations, see replay().
+//============================================================================
+namespace
+{
+  volatile LONG g_num_heap_allocations=0;
+}
+//----
+
+void *operator new(size_t size)
+{
+  InterlockedIncrement(&g_num_heap_allocations);
+  if(void *p=malloc(size ? size : 1))
+    return p;
+  throw bad_alloc();
+}
+//----
+
+void operator delete(void *p)
+{
+  free(p);
+}
+//----------------------------------------------------------------------------
+#endif
+
+
+//============================================================================
+// <anonymous namespace>
+//============================================================================
+namespace
+{
+  //==========================================================================
+  // options
+  //==========================================================================
+  struct options
+  {
+    vector<unsigned> corpus_sizes;
+    unsigned num_repetitions;
+    const char *replay_sessions, *replay_database; // 0 unless replaying
+    const char *profile; // 0 for a temporary profile folder
+  };
+  //----
+
+  options parse_options(int argc, char **argv)
+  {
+    // parse "[-repeat <n>] [-profile <folder>] [-replay <sessions> <database>] [<corpus size>...]"
+    options opts;
+    opts.num_repetitions=10;
+    opts.replay_sessions=opts.replay_database=0;
+    opts.profile=0;
+    for(int i=1; i<argc; ++i)
+    {
+      if(0==strcmp(argv[i], "-repeat") && i+1<argc)
+        opts.num_repetitions=max(1, atoi(argv[++i]));
+      else if(0==strcmp(argv[i], "-profile") && i+1<argc)
+        opts.profile=argv[++i];
+      else if(0==strcmp(argv[i], "-replay") && i+2<argc)
+      {
+        opts.replay_sessions=argv[++i];
+        opts.replay_database=argv[++i];
+      }
+      else if(atoi(argv[i])>0)
+        opts.corpus_sizes.push_back(unsigned(atoi(argv[i])));
+      else
+        throw runtime_error(string("Unknown option '")+argv[i]+"'.");
+    }
+    if(opts.corpus_sizes.empty())
+    {
+      opts.corpus_sizes.push_back(1000);
+      opts.corpus_sizes.push_back(10000);
+      opts.corpus_sizes.push_back(100000);
+    }
+    return opts;
+  }
+  //--------------------------------------------------------------------------
+
+
+  //==========================================================================
+  // random
+  //
+  // Linear congruential generator, so corpora are identical on all platforms
+  // (unlike rand()).
+  //==========================================================================
+  class random_generator
+  {
+  public:
+    // construction
+    random_generator(unsigned seed)
+      :m_state(seed)
+    {
+    }
+    //------------------------------------------------------------------------
+
+    // generation
+    unsigned next(unsigned range)
+    {
+      m_state=m_state*1664525u+1013904223u;
+      return (m_state>>8)%range;
+    }
+    //----
+
+    template<typename T, size_t n>
+    const T &pick(const T (&values)[n])
+    {
+      return values[next(unsigned(n))];
+    }
+    //------------------------------------------------------------------------
+
+  private:
+    unsigned m_state;
+  };
+  //--------------------------------------------------------------------------
+
+
+  //==========================================================================
+  // corpus
+  //==========================================================================
+  const wchar_t *const s_vendors[]=
+  {
+    L"Adobe", L"Apple", L"Microsoft", L"Mozilla", L"Google", L"Nullsoft", L"Valve", L"VideoLAN",
+    L"7-Zip", L"Notepad++", L"Oracle", L"Sun Microsystems", L"Skype", L"Corel", L"Nero", L"Symantec",
+    L"McAfee", L"Logitech", L"Creative", L"Intel", L"NVIDIA", L"ATI", L"Macromedia", L"Winamp",
+    L"TortoiseSVN", L"Python", L"Cygwin", L"IrfanView", L"Paint.NET", L"OpenOffice.org"
+  };
+  const wchar_t *const s_products[]=
+  {
+    L"Firefox", L"Thunderbird", L"Word", L"Excel", L"PowerPoint", L"Outlook", L"Access", L"Visio",
+    L"Photoshop", L"Illustrator", L"Acrobat Reader", L"Dreamweaver", L"Flash Player", L"iTunes", L"QuickTime Player", L"Safari",
+    L"Picasa", L"Google Earth", L"Steam", L"Media Player", L"Movie Maker", L"Messenger", L"Visual Studio", L"SQL Server Management Studio",
+    L"Control Panel", L"Calculator", L"Notepad", L"Paint", L"Command Prompt", L"Remote Desktop Connection", L"Sound Recorder", L"Character Map",
+    L"Disk Cleanup", L"Disk Defragmenter", L"System Restore", L"Task Scheduler", L"Burning ROM", L"Antivirus", L"Security Center", L"Display Settings",
+    L"Writer", L"Calc", L"Impress", L"Draw", L"Base", L"IDLE", L"Module Docs", L"Java Web Start"
+  };
+  const wchar_t *const s_suffixes[]=
+  {
+    L"", L"", L"", L"", L"", L"", L" Help", L" Readme", L" Release Notes", L" Documentation",
+    L" Website", L" Settings", L" (Safe Mode)", L" Uninstall", L" Update", L" Plugin Manager"
+  };
+  const wchar_t *const s_versions[]=
+  {
+    L"", L"", L"", L" 2003", L" 2007", L" 3.5", L" 8", L" 9.0", L" 11", L" CS3", L" XP", L" 2.0"
+  };
+  //----
+
+  struct corpus_item
+  {
+    wstring title;
+    wstring path;
+  };
+  //----
+
+  vector<corpus_item> create_corpus(unsigned size)
+  {
+    // create items like "Microsoft Word 2007 Help" in folders like
+    // "<Start Menu>\Programs\Microsoft\Word 2007" (item order and titles
+    // only depend on the corpus size)
+    const wstring start_menu=L"C:\\Documents and Settings\\All Users\\Start Menu\\Programs\\";
+    random_generator rnd(size);
+    set<wstring> paths;
+    vector<corpus_item> items(size);
+    for(unsigned i=0; i<size; ++i)
+    {
+      const wstring vendor=rnd.pick(s_vendors), product=rnd.pick(s_products), version=rnd.pick(s_versions), suffix=rnd.pick(s_suffixes);
+      corpus_item &item=items[i];
+      item.title=(rnd.next(3) ? vendor+L" " : wstring())+product+version+suffix;
+      const wstring folder=start_menu+vendor+L"\\"+product+version+L"\\";
+      item.path=folder+item.title+L".lnk";
+      for(unsigned n=2; !paths.insert(item.path).second; ++n)
+      {
+        // number duplicates like the shell does ("Word (2).lnk")
+        wchar_t number[32];
+        swprintf(number, sizeof(number)/sizeof(*number), L" (%u)", n);
+        item.path=folder+item.title+number+L".lnk";
+      }
+    }
+    return items;
+  }
+  //--------------------------------------------------------------------------
+
+
+  //==========================================================================
+  // keystroke sequences
+  //==========================================================================
+  const wchar_t *const s_sequences[]=
+  {
+    L"firefox", // single word, frequent
+    L"word", // short word
+    L"msword", // abbreviation across words
+    L"ctrl pnl", // abbreviation with white space
+    L"uninst", // suffix word, many hits
+    L"sql server mgmt", // long query, many chunks
+    L"zqx" // no hits once complete
+  };
+  //----
+
+  vector<wstring> get_keystrokes(const wchar_t *sequence)
+  {
+    // every prefix of the sequence, as typed
+    vector<wstring> keystrokes;
+    const wstring s=sequence;
+    for(size_t i=1; i<=s.size(); ++i)
+      keystrokes.push_back(s.substr(0, i));
+    return keystrokes;
+  }
+  //--------------------------------------------------------------------------
+
+
+  //==========================================================================
+  // print_result()
+  //==========================================================================
+  void print_result(const char *benchmark, unsigned corpus_size, const wchar_t *name, const char *metric, double value)
+  {
+    printf("{\"benchmark\": \"%s\", \"items\": %u, \"name\": \"%ls\", \"metric\": \"%s\", \"value\": %.3f}\n", benchmark, corpus_size, name, metric, value);
+    fflush(stdout);
+  }
+  //--------------------------------------------------------------------------
+
+
+  //==========================================================================
+  // benchmark_match()
+  //==========================================================================
+  void benchmark_match(const vector<corpus_item> &corpus, const options &opts)
+  {
+    // match every keystroke of every sequence against all titles
+    const unsigned corpus_size=unsigned(corpus.size());
+    unsigned long long total_time=0, total_ops=0;
+    for(size_t s=0; s<sizeof(s_sequences)/sizeof(*s_sequences); ++s)
+    {
+      const vector<wstring> keystrokes=get_keystrokes(s_sequences[s]);
+      unsigned long long time=0, ops=0, num_matches=0;
+      wstring marked_up_title;
+      for(unsigned r=0; r<opts.num_repetitions; ++r)
+        for(vector<wstring>::const_iterator keystroke=keystrokes.begin(); keystroke!=keystrokes.end(); ++keystroke)
+        {
+          const wstring term=normalized_term(*keystroke);
+          const unsigned long long start=logger::get_monotonic_time();
+          for(vector<corpus_item>::const_iterator item=corpus.begin(); item!=corpus.end(); ++item)
+          {
+            float score;
+            marked_up_title.clear();
+            if(match(term.c_str(), item->title.c_str(), score, marked_up_title))
+              ++num_matches;
+          }
+          time+=logger::get_monotonic_time()-start;
+          ops+=corpus.size();
+        }
+      print_result("match", corpus_size, s_sequences[s], "ns_per_op", ops ? time*1000.0/ops : 0.0);
+      print_result("match", corpus_size, s_sequences[s], "matches_per_keystroke", double(num_matches)/(opts.num_repetitions*keystrokes.size()));
+      total_time+=time;
+      total_ops+=ops;
+    }
+    print_result("match", corpus_size, L"all", "ns_per_op", total_ops ? total_time*1000.0/total_ops : 0.0);
+  }
+  //--------------------------------------------------------------------------
+
+
+  //==========================================================================
+  // check_compositing()
+  //==========================================================================
+  void check(bool condition, const char *what)
+  {
+    if(!condition)
+      throw runtime_error(string("Compositing check failed: ")+what+".");
+  }
+  //----
+
+  void check_blend()
+  {
+    // composite transparent, opaque and half transparent red over opaque blue
+    // and over transparent pixels (values premultiplied, rounded like x/255)
+    surface dst(4, 2), src(4, 2);
+    const boost::uint32_t src_pixels[]={0x00000000, 0xffff0000, premultiply(0x80ff0000), premultiply(0x40ff0000)};
+    const boost::uint32_t expected[2][4]=
+    {
+      {0xff0000ff, 0xffff0000, 0xff80007f, 0xff4000bf},
+      {0x00000000, 0xffff0000, 0x80800000, 0x40400000}
+    };
+    check(premultiply(0x80ff0000)==0x80800000, "premultiply() of half transparent red");
+    for(unsigned x=0; x<4; ++x)
+    {
+      dst.get_row(0)[x]=0xff0000ff;
+      src.get_row(0)[x]=src.get_row(1)[x]=src_pixels[x];
+    }
+    blend(dst, 0, 0, src, src.get_rect(), dst.get_rect());
+    for(unsigned y=0; y<2; ++y)
+      for(unsigned x=0; x<4; ++x)
+        check(dst.get_row(y)[x]==expected[y][x], "blend() of known pixels");
+  }
+  //----
+
+  void check_clipping(int x, int y, const pixel_rect &clip)
+  {
+    // blit a 4x4 image at (x, y), which must write exactly the pixels inside
+    // the clip rect and the 8x8 destination
+    surface src(4, 4), blended(8, 8), copied(8, 8);
+    for(unsigned sy=0; sy<4; ++sy)
+      for(unsigned sx=0; sx<4; ++sx)
+        src.get_row(sy)[sx]=0xff000000|(sy<<8)|sx;
+    blend(blended, x, y, src, src.get_rect(), clip);
+    copy(copied, x, y, src, src.get_rect(), clip);
+    for(int dy=0; dy<8; ++dy)
+      for(int dx=0; dx<8; ++dx)
+      {
+        const int sx=dx-x, sy=dy-y;
+        const bool is_inside=sx>=0 && sx<4 && sy>=0 && sy<4
+          && dx>=clip.x && dx<clip.x+int(clip.width) && dy>=clip.y && dy<clip.y+int(clip.height);
+        const boost::uint32_t expected=is_inside ? src.get_row(sy)[sx] : 0;
+        check(blended.get_row(dy)[dx]==expected, "blend() clipping");
+        check(copied.get_row(dy)[dx]==expected, "copy() clipping");
+      }
+  }
+  //----
+
+  void check_atlas()
+  {
+    // fill a 64x64 page with four 32x32 sprites, so that a fifth needs a
+    // second page, and an oversized image a page of its own
+    const unsigned long page_size=64*64*4;
+    atlas a(64, 64);
+    surface image(32, 32), large(100, 10);
+    image.fill(image.get_rect(), 0xff123456);
+    large.fill(large.get_rect(), 0xff654321);
+    sprite sprites[5];
+    for(unsigned i=0; i<5; ++i)
+      sprites[i]=a.add(image);
+    check(a.get_num_pages()==2 && a.get_size()==2*page_size, "atlas::add() page allocation");
+    const sprite large_sprite=a.add(large);
+    check(a.get_num_pages()==3 && a.get_size()==2*page_size+100*10*4, "atlas::add() of an oversized image");
+
+    // removing the last sprite of a page frees it, and the next page reuses its slot
+    a.remove(large_sprite);
+    a.remove(sprites[4]);
+    check(a.get_size()==page_size, "atlas::remove() page freeing");
+    sprites[4]=a.add(image);
+    check(a.get_num_pages()==3 && sprites[4].page!=sprites[0].page && a.get_size()==2*page_size, "atlas::add() page slot reuse");
+
+    // removed sprites are reused by images of the same size, keeping the page
+    const sprite removed=sprites[1];
+    a.remove(sprites[1]);
+    sprites[1]=a.add(image);
+    check(sprites[1].page==removed.page && sprites[1].rect.x==removed.rect.x && sprites[1].rect.y==removed.rect.y, "atlas::add() sprite reuse");
+    surface dst(32, 32);
+    a.copy(dst, 0, 0, sprites[1], dst.get_rect());
+    check(dst.get_row(31)[31]==0xff123456, "atlas::copy() of a reused sprite");
+
+    // removing all sprites frees all pages
+    for(unsigned i=0; i<5; ++i)
+      a.remove(sprites[i]);
+    check(a.get_size()==0, "atlas::remove() of all sprites");
+  }
+  //----
+
+  void check_compositing()
+  {
+    check_blend();
+    const pixel_rect clip(0, 0, 8, 8);
+    check_clipping(0, 0, clip);
+    check_clipping(-2, -2, clip);
+    check_clipping(6, 6, clip);
+    check_clipping(-3, 5, clip);
+    check_clipping(8, 0, clip);
+    check_clipping(0, -4, clip);
+    check_clipping(2, 2, pixel_rect(3, 3, 2, 2));
+    check_clipping(2, 2, pixel_rect(1, 4, 6, 0));
+    check_atlas();
+  }
+  //--------------------------------------------------------------------------
+
+
+  //==========================================================================
+  // benchmark_compositing()
+  //==========================================================================
+  void benchmark_compositing(const options &opts)
+  {
+    // paint frames of 16 rows of 16 icons with soft edges (i.e. partially
+    // transparent pixels), as the dropdown does, from separate surfaces and
+    // from an atlas
+    const unsigned icon_size=32, num_icons=256, num_frames=opts.num_repetitions*10;
+    surface icon(icon_size, icon_size), frame(16*icon_size, 16*icon_size);
+    for(unsigned y=0; y<icon_size; ++y)
+      for(unsigned x=0; x<icon_size; ++x)
+        icon.get_row(y)[x]=premultiply((min(255u, (x+y)*8)<<24)|0x204080);
+    const unsigned long long num_ops=(unsigned long long)num_frames*num_icons;
+    const wchar_t *const name=L"icon_32";
+    unsigned long long start=logger::get_monotonic_time();
+    for(unsigned f=0; f<num_frames; ++f)
+      for(unsigned i=0; i<num_icons; ++i)
+        blend(frame, int(i%16*icon_size), int(i/16*icon_size), icon, icon.get_rect(), frame.get_rect());
+    print_result("compositing", num_icons, name, "blend_ns_per_op", (logger::get_monotonic_time()-start)*1000.0/num_ops);
+    start=logger::get_monotonic_time();
+    for(unsigned f=0; f<num_frames; ++f)
+      for(unsigned i=0; i<num_icons; ++i)
+        copy(frame, int(i%16*icon_size), int(i/16*icon_size), icon, icon.get_rect(), frame.get_rect());
+    print_result("compositing", num_icons, name, "copy_ns_per_op", (logger::get_monotonic_time()-start)*1000.0/num_ops);
+
+    // pack the icons into an atlas (from scratch, as after a theme change),
+    // blend them from there and replace them (as the icon cache does)
+    atlas icons;
+    vector<sprite> sprites(num_icons);
+    start=logger::get_monotonic_time();
+    for(unsigned f=0; f<num_frames; ++f)
+    {
+      icons.clear();
+      for(unsigned i=0; i<num_icons; ++i)
+        sprites[i]=icons.add(icon);
+    }
+    print_result("compositing", num_icons, name, "atlas_add_ns_per_op", (logger::get_monotonic_time()-start)*1000.0/num_ops);
+    start=logger::get_monotonic_time();
+    for(unsigned f=0; f<num_frames; ++f)
+      for(unsigned i=0; i<num_icons; ++i)
+        icons.blend(frame, int(i%16*icon_size), int(i/16*icon_size), sprites[i], frame.get_rect());
+    print_result("compositing", num_icons, name, "atlas_blend_ns_per_op", (logger::get_monotonic_time()-start)*1000.0/num_ops);
+    start=logger::get_monotonic_time();
+    for(unsigned f=0; f<num_frames; ++f)
+      for(unsigned i=0; i<num_icons; ++i)
+      {
+        icons.remove(sprites[i]);
+        sprites[i]=icons.add(icon);
+      }
+    print_result("compositing", num_icons, name, "atlas_replace_ns_per_op", (logger::get_monotonic_time()-start)*1000.0/num_ops);
+  }
+  //--------------------------------------------------------------------------
+
+
+#ifdef _WIN32
+  //==========================================================================
+  // scratch_profile
+  //
+  // Points profile_folder() (scratch databases and the benchmark plugin's
+  // config) to a temporary folder, or to the folder given with -profile,
+  // and removes what the benchmark left there on destruction.
+  //==========================================================================
+  class scratch_profile
+  {
+  public:
+    // construction and destruction
+    scratch_profile(const options &opts)
+      :m_is_temporary(!opts.profile)
+    {
+      if(opts.profile)
+      {
+        const string folder=opts.profile;
+        m_path=wstring(folder.begin(), folder.end());
+      }
+      else
+      {
+        wchar_t temp_path[MAX_PATH];
+        if(!GetTempPathW(MAX_PATH, temp_path))
+          throw runtime_error("Unable to get temporary folder.");
+        m_path=boost::filesystem::wpath(temp_path) / (L"colibri_benchmark_"+boost::lexical_cast<wstring>(GetCurrentProcessId()));
+      }
+      boost::filesystem::create_directories(m_path);
+      set_profile_folder(m_path);
+    }
+    //----
+
+    ~scratch_profile()
+    {
+      try
+      {
+        if(m_is_temporary)
+          boost::filesystem::remove_all(m_path);
+        else
+          boost::filesystem::remove(m_path / L"benchmark.sqlite");
+      }
+      catch(const exception &e)
+      {
+        fprintf(stderr, "Unable to clean up profile folder: %s\n", e.what());
+      }
+    }
+    //------------------------------------------------------------------------
+
+  private:
+    scratch_profile(const scratch_profile&); // not implemented
+    void operator=(const scratch_profile&); // not implemented
+    //------------------------------------------------------------------------
+
+    boost::filesystem::wpath m_path;
+    const bool m_is_temporary;
+  };
+  //--------------------------------------------------------------------------
+
+
+  //==========================================================================
+  // benchmark_plugin
+  //
+  // Indexes the corpus the way plugins do, i.e. from within
+  // database::update_index() and in chunks.
+  //==========================================================================
+  class benchmark_plugin: public plugin
+  {
+  public:
+    // construction
+    benchmark_plugin(const vector<corpus_item> &corpus)
+      :m_corpus(corpus)
+    {
+    }
+    //------------------------------------------------------------------------
+
+    // information
+    virtual const wchar_t *get_name() const
+    {
+      return L"benchmark";
+    }
+    //----
+
+    virtual const wchar_t *get_title() const
+    {
+      return L"Benchmark";
+    }
+    //------------------------------------------------------------------------
+
+    // config management
+    virtual unsigned update_config(unsigned current_version)
+    {
+      return 1;
+    }
+    //------------------------------------------------------------------------
+
+    // indexing
+    virtual void index(boost::uint64_t new_index_version)
+    {
+      database_item item;
+      item.plugin_id=get_name();
+      item.is_transient=false;
+      item.index_version=new_index_version;
+      for(vector<corpus_item>::const_iterator iter=m_corpus.begin(); iter!=m_corpus.end(); ++iter)
+      {
+        item.item_id=iter->path;
+        item.title=iter->title;
+        item.description=iter->path;
+        item.icon_info.set(icon_source_shell, iter->path);
+        item.path=iter->path;
+        get_db().add_or_update_item(item);
+        get_db().commit_index_chunk();
+      }
+    }
+    //------------------------------------------------------------------------
+
+  private:
+    const vector<corpus_item> &m_corpus;
+  };
+  //--------------------------------------------------------------------------
+
+
+  //==========================================================================
+  // benchmark_index()
+  //==========================================================================
+  void benchmark_index(const char *suite, database &db, std::shared_ptr<benchmark_plugin> plugin, unsigned corpus_size)
+  {
+    // index into the empty database (inserts), then again (updates)
+    db.add_plugin(plugin);
+    const wchar_t *const passes[]={L"insert", L"update"};
+    for(unsigned i=0; i<2; ++i)
+    {
+      const unsigned long long start=logger::get_monotonic_time();
+      db.update_index();
+      const unsigned long long time=logger::get_monotonic_time()-start;
+      print_result(suite, corpus_size, passes[i], "items_per_s", time ? corpus_size*1000000.0/time : 0.0);
+    }
+  }
+  //--------------------------------------------------------------------------
+
+
+  //==========================================================================
+  // add_history()
+  //==========================================================================
+  void add_history(database &db, unsigned corpus_size)
+  {
+    // launch items by short prefixes of their titles, three out of four times
+    // one of the first 5% (as users tend to launch few items often)
+    vector<std::pair<boost::uint64_t, wstring> > items;
+    for(database_result_set rs=db.search(L""); rs; rs.next())
+      items.push_back(make_pair(rs.get_id(), rs.get_title()));
+    random_generator rnd(corpus_size+1);
+    const unsigned num_launches=max(20u, corpus_size/50);
+    for(unsigned i=0; i<num_launches; ++i)
+    {
+      const unsigned range=rnd.next(4) ? max(1u, unsigned(items.size())/20) : unsigned(items.size());
+      const std::pair<boost::uint64_t, wstring> &item=items[rnd.next(range)];
+      db.update_history(item.first, item.second.substr(0, 1+rnd.next(4)));
+    }
+  }
+  //--------------------------------------------------------------------------
+
+
+  //==========================================================================
+  // get_percentile()
+  //==========================================================================
+  unsigned long long get_percentile(vector<unsigned long long> samples, unsigned percent)
+  {
+    // nearest-rank percentile (exact, unlike logger::latency_histogram)
+    if(samples.empty())
+      return 0;
+    sort(samples.begin(), samples.end());
+    const size_t rank=(samples.size()*percent+99)/100;
+    return samples[rank ? rank-1 : 0];
+  }
+  //----
+
+  void print_latencies(const char *benchmark, unsigned corpus_size, const wchar_t *name, const string &metric_prefix, const vector<unsigned long long> &samples)
+  {
+    print_result(benchmark, corpus_size, name, (metric_prefix+"p50_us").c_str(), double(get_percentile(samples, 50)));
+    print_result(benchmark, corpus_size, name, (metric_prefix+"p99_us").c_str(), double(get_percentile(samples, 99)));
+    print_result(benchmark, corpus_size, name, (metric_prefix+"max_us").c_str(), double(get_percentile(samples, 100)));
+  }
+  //--------------------------------------------------------------------------
+
+
+  //==========================================================================
+  // benchmark_search()
+  //==========================================================================
+  void benchmark_search(const char *suite, database &db, const options &opts, unsigned corpus_size)
+  {
+    // search every keystroke of every sequence and step through all results,
+    // as db_controller::on_input_changed() does
+    vector<unsigned long long> all_samples;
+    for(size_t s=0; s<sizeof(s_sequences)/sizeof(*s_sequences); ++s)
+    {
+      const vector<wstring> keystrokes=get_keystrokes(s_sequences[s]);
+      vector<unsigned long long> samples;
+      unsigned long long num_results=0;
+      for(unsigned r=0; r<opts.num_repetitions; ++r)
+        for(vector<wstring>::const_iterator keystroke=keystrokes.begin(); keystroke!=keystrokes.end(); ++keystroke)
+        {
+          const unsigned long long start=logger::get_monotonic_time();
+          for(database_result_set rs=db.search(*keystroke); rs; rs.next())
+            ++num_results;
+          samples.push_back(logger::get_monotonic_time()-start);
+        }
+      print_latencies(suite, corpus_size, s_sequences[s], "", samples);
+      print_result(suite, corpus_size, s_sequences[s], "results_per_keystroke", double(num_results)/samples.size());
+      all_samples.insert(all_samples.end(), samples.begin(), samples.end());
+    }
+    print_latencies(suite, corpus_size, L"all", "", all_samples);
+  }
+  //--------------------------------------------------------------------------
+
+
+  //==========================================================================
+  // benchmark_database()
+  //==========================================================================
+  void benchmark_database(const vector<corpus_item> &corpus, const options &opts)
+  {
+    // start with an empty scratch database and plugin config in the (scratch)
+    // profile folder, encoded as UTF-16le (as created by colibri) and as UTF-8
+    const unsigned corpus_size=unsigned(corpus.size());
+    const boost::filesystem::wpath filename=profile_folder() / L"benchmark_database.sqlite";
+    const boost::filesystem::wpath config_filename=profile_folder() / L"benchmark.sqlite";
+    const char *const index_suites[]={"index", "index_utf8"};
+    const char *const search_suites[]={"search", "search_utf8"};
+    for(unsigned i=0; i<2; ++i)
+    {
+      boost::filesystem::remove(filename);
+      boost::filesystem::remove(config_filename);
+      if(i)
+      {
+        // the encoding of a database is fixed by its first table, so the
+        // UTF-16le requested by sqlite_connection is overridden before that
+        sqlite_connection connection(filename.string());
+        connection.prepare(L"PRAGMA encoding = \"UTF-8\"")->exec();
+        connection.prepare(L"CREATE TABLE benchmark_encoding (id INTEGER)")->exec();
+        if(L"UTF-8"!=connection.get_encoding())
+          throw runtime_error("Unable to create UTF-8 database.");
+      }
+      {
+        database db(filename);
+        benchmark_index(index_suites[i], db, std::shared_ptr<benchmark_plugin>(new benchmark_plugin(corpus)), corpus_size);
+        add_history(db, corpus_size);
+        benchmark_search(search_suites[i], db, opts, corpus_size);
+      }
+    }
+    boost::filesystem::remove(filename);
+    boost::filesystem::remove(config_filename);
+  }
+  //--------------------------------------------------------------------------
+
+
+  //==========================================================================
+  // replay_keystroke()
+  //==========================================================================
+  struct string_option
+  {
+    wstring title, description;
+    icon_info icon;
+  };
+  //----
+
+  unsigned long long replay_keystroke(database &db, const wstring &term, bool use_arena=true)
+  {
+    // search and build the options like db_controller::on_input_changed(),
+    // i.e. decode the strings of the first two pages (of 8 rows) only, either
+    // into an arena or (as before the arena) into strings of each option
+    const size_t num_kept_options=16;
+    const unsigned long long start=logger::get_monotonic_time();
+    arena options_arena;
+    vector<string_option> string_options;
+    size_t num_options=0;
+    for(database_result_set rs=db.search(term); rs; rs.next(), ++num_options)
+    {
+      rs.get_id();
+      rs.has_path();
+      if(num_options>=num_kept_options)
+        continue;
+      if(use_arena)
+      {
+        rs.get_marked_up_title(options_arena);
+        rs.get_description(options_arena);
+        rs.get_icon_path(options_arena);
+      }
+      else
+      {
+        string_option option;
+        option.title=rs.get_marked_up_title();
+        option.description=rs.get_description();
+        option.icon=rs.get_icon_info();
+        string_options.push_back(option);
+      }
+    }
+    return logger::get_monotonic_time()-start;
+  }
+  //--------------------------------------------------------------------------
+
+
+  //==========================================================================
+  // replay()
+  //==========================================================================
+  void replay(const options &opts)
+  {
+    // replay on a copy of the snapshot, as opening a database updates it
+    const vector<session> sessions=read_sessions(opts.replay_sessions);
+    const string snapshot=opts.replay_database;
+    const boost::filesystem::wpath filename=profile_folder() / L"benchmark_replay.sqlite";
+    boost::filesystem::remove(filename);
+    boost::filesystem::copy_file(boost::filesystem::wpath(wstring(snapshot.begin(), snapshot.end())), filename);
+    {
+      // recordings contain no terms, so type launch terms of the snapshot's
+      // history instead (or, without history, titles)
+      database db(filename);
+      vector<wstring> terms=db.get_history_terms(1000);
+      const bool has_history=!terms.empty();
+      unsigned num_items=0;
+      for(database_result_set rs=db.search(L""); rs; rs.next(), ++num_items)
+        if(!has_history && terms.size()<1000)
+          terms.push_back(normalized_term(rs.get_title()));
+      if(terms.empty())
+        throw runtime_error("The database contains no items.");
+      fprintf(stderr, "Replaying %u sessions on %u items...\n", unsigned(sessions.size()), num_items);
+
+      // replay keystrokes at their recorded times; searches run on the gui
+      // thread, so a keystroke waits for the search of the previous one
+      random_generator rnd(unsigned(sessions.size()));
+      vector<unsigned long long> search_samples[2], end_to_end_samples[2]; // typed, deleted
+      vector<wstring> replayed_terms;
+      unsigned num_selections=0, num_top_selections=0;
+      unsigned long long rank_sum=0;
+      for(vector<session>::const_iterator s=sessions.begin(); s!=sessions.end(); ++s)
+      {
+        // pick a term which is at least as long as the longest of the session
+        size_t max_length=0;
+        for(session::const_iterator event=s->begin(); event!=s->end(); ++event)
+          max_length=max<size_t>(max_length, event->term_length);
+        vector<const wstring*> candidates;
+        const wstring *longest=&terms.front();
+        for(vector<wstring>::const_iterator term=terms.begin(); term!=terms.end(); ++term)
+        {
+          if(term->size()>=max_length)
+            candidates.push_back(&*term);
+          if(term->size()>longest->size())
+            longest=&*term;
+        }
+        const wstring &term=candidates.empty() ? *longest : *candidates[rnd.next(unsigned(candidates.size()))];
+
+        // replay events
+        unsigned long long arrival=0, finish=0;
+        for(session::const_iterator event=s->begin(); event!=s->end(); ++event)
+        {
+          arrival+=event->delay*1000ull;
+          if(event->type==session_event::type_enter || event->type==session_event::type_tab)
+          {
+            if(event->rank)
+            {
+              ++num_selections;
+              rank_sum+=*event->rank;
+              if(!*event->rank)
+                ++num_top_selections;
+            }
+            continue;
+          }
+          if(!event->term_length)
+            continue;
+          replayed_terms.push_back(term.substr(0, event->term_length));
+          const unsigned long long time=replay_keystroke(db, replayed_terms.back());
+          finish=max(arrival, finish)+time;
+          const unsigned kind=event->type==session_event::type_backspace ? 1 : 0;
+          search_samples[kind].push_back(time);
+          end_to_end_samples[kind].push_back(finish-arrival);
+        }
+      }
+
+      // report latencies of typed and deleted characters
+      const wchar_t *const kinds[]={L"typed", L"deleted"};
+      vector<unsigned long long> all_search_samples, all_end_to_end_samples;
+      for(unsigned i=0; i<2; ++i)
+      {
+        print_result("replay", num_items, kinds[i], "keystrokes", double(search_samples[i].size()));
+        print_latencies("replay", num_items, kinds[i], "search_", search_samples[i]);
+        print_latencies("replay", num_items, kinds[i], "end_to_end_", end_to_end_samples[i]);
+        all_search_samples.insert(all_search_samples.end(), search_samples[i].begin(), search_samples[i].end());
+        all_end_to_end_samples.insert(all_end_to_end_samples.end(), end_to_end_samples[i].begin(), end_to_end_samples[i].end());
+      }
+      print_latencies("replay", num_items, L"all", "search_", all_search_samples);
+      print_latencies("replay", num_items, L"all", "end_to_end_", all_end_to_end_samples);
+      print_result("replay", num_items, L"sessions", "sessions", double(sessions.size()));
+      print_result("replay", num_items, L"sessions", "selected_rank_mean", num_selections ? double(rank_sum)/num_selections : 0.0);
+      print_result("replay", num_items, L"sessions", "top_selection_ratio", num_selections ? double(num_top_selections)/num_selections : 0.0);
+
+      // compare heap allocations of building the options in an arena and with
+      // strings, in a separate pass so the counting doesn't skew the latencies
+      const wchar_t *const paths[]={L"arena", L"strings"};
+      for(unsigned i=0; i<2; ++i)
+      {
+        const LONG start=g_num_heap_allocations;
+        for(vector<wstring>::const_iterator term=replayed_terms.begin(); term!=replayed_terms.end(); ++term)
+          replay_keystroke(db, *term, 0==i);
+        const unsigned long num_allocations=(unsigned long)(g_num_heap_allocations-start);
+        print_result("replay", num_items, paths[i], "heap_allocations_per_keystroke", replayed_terms.empty() ? 0.0 : double(num_allocations)/replayed_terms.size());
+      }
+    }
+    boost::filesystem::remove(filename);
+  }
+  //--------------------------------------------------------------------------
+#endif
+}
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// main()
+//============================================================================
+int main(int argc, char **argv)
+{
+  try
+  {
+    const options opts=parse_options(argc, argv);
+#ifdef _WIN32
+    const scratch_profile profile(opts);
+#endif
+    fprintf(stderr, "Checking compositing...\n");
+    check_compositing();
+    if(opts.replay_sessions)
+    {
+#ifdef _WIN32
+      replay(opts);
+      return 0;
+#else
+      throw runtime_error("Replaying sessions needs the database suites, which are only built on Windows.");
+#endif
+    }
+    for(vector<unsigned>::const_iterator size=opts.corpus_sizes.begin(); size!=opts.corpus_sizes.end(); ++size)
+    {
+      fprintf(stderr, "Benchmarking %u items...\n", *size);
+      const vector<corpus_item> corpus=create_corpus(*size);
+      benchmark_match(corpus, opts);
+#ifdef _WIN32
+      benchmark_database(corpus, opts);
+#endif
+    }
+    fprintf(stderr, "Benchmarking compositing...\n");
+    benchmark_compositing(opts);
+  }
+  catch(const exception &e)
+  {
+    fprintf(stderr, "Error: %s\n", e.what());
+    return 1;
+  }
+  return 0;
+}
+//----------------------------------------------------------------------------
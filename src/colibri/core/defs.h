@@ -23,11 +23,17 @@ inline boost::filesystem::wpath install_folder()
 }
 
 
-// profile_folder()
-inline boost::filesystem::wpath profile_folder()
+// profile_folder(), set_profile_folder()
+inline boost::filesystem::wpath &cached_profile_folder()
 {
-  // return if cached
   static boost::filesystem::wpath s_path;
+  return s_path;
+}
+
+inline boost::filesystem::wpath profile_folder()
+{
+  // return if cached (or overridden)
+  boost::filesystem::wpath &s_path=cached_profile_folder();
   if(!s_path.empty())
     return s_path;
 
@@ -44,4 +50,10 @@ inline boost::filesystem::wpath profile_folder()
   return s_path;
 }
 
+inline void set_profile_folder(const boost::filesystem::wpath &path)
+{
+  // use another profile folder, e.g. for tools
+  cached_profile_folder()=path;
+}
+
 #endif
@@ -8,6 +8,7 @@
 #include "match.h"
 #include "../plugins/colibri_plugin.h"
 #include "../libraries/log/log.h"
+#include "../libraries/log/trace.h"
 #include "../thirdparty/sqlite/sqlite3.h"
 using namespace std;
 using namespace boost;
@@ -22,9 +23,7 @@ namespace
   //==========================================================================
   // global state
   //==========================================================================
-  database *g_database;
   wstring g_current_term;
-  database_item g_current_parent_item;
   //--------------------------------------------------------------------------
 
 
@@ -98,16 +97,66 @@ namespace
 
 
   //==========================================================================
-  // COLIBRI_TRIGGER_ACTION (trigger action on current parent item)
+  // item columns (shared by search() and get_item_for_id() queries)
   //==========================================================================
-  void colibri_trigger_action(sqlite3_context *context, int, sqlite3_value **args)
+  enum e_column
   {
-    // trigger action on current parent item
-    const wchar_t *action=reinterpret_cast<const wchar_t*>(sqlite3_value_text16le(args[0]));
-    const bool action_supported=g_database->trigger_action(action, g_current_parent_item);
+    column_id,
+    column_plugin_id,
+    column_item_id,
+    column_title,
+    column_description,
+    column_is_transient,
+    column_icon_source,
+    column_icon_path,
+    column_index_version,
+    column_parent_id,
+    column_path,
+    column_launch_args,
+    column_on_enter,
+    column_on_tab,
+    column_on_query_applicable,
+    column_history_score,
+    column_match_score,
+    column_marked_up_title,
+  };
+  //----
+
+  void assign(optional<wstring> &dst, const optional<sqlite_string_view> &src)
+  {
+    // reuse the destination string, if any
+    if(!src)
+      dst=none;
+    else
+    {
+      if(!dst)
+        dst=wstring();
+      src->assign_to(*dst);
+    }
+  }
+  //----
 
-    // return success
-    sqlite3_result_int(context, action_supported ? 1 : 0);
+  void read_item(const sqlite_statement &stmt, database_item &item)
+  {
+    // fill mandatory fields (strings are copied from the column views into
+    // the existing item strings)
+    item.id=stmt.get_uint64(column_id);
+    stmt.get_string_view(column_plugin_id).assign_to(item.plugin_id);
+    stmt.get_string_view(column_item_id).assign_to(item.item_id);
+    stmt.get_string_view(column_title).assign_to(item.title);
+    stmt.get_string_view(column_description).assign_to(item.description);
+    item.is_transient=stmt.get_bool(column_is_transient);
+    item.icon_info.source=static_cast<e_icon_source>(stmt.get_unsigned(column_icon_source));
+    stmt.get_string_view(column_icon_path).assign_to(item.icon_info.path);
+    item.index_version=stmt.get_uint64_option(column_index_version);
+
+    // fill facet fields
+    item.parent_id=stmt.get_uint64_option(column_parent_id);
+    assign(item.path, stmt.get_string_view_option(column_path));
+    assign(item.launch_args, stmt.get_string_view_option(column_launch_args));
+    assign(item.on_enter, stmt.get_string_view_option(column_on_enter));
+    assign(item.on_tab, stmt.get_string_view_option(column_on_tab));
+    assign(item.on_query_applicable, stmt.get_string_view_option(column_on_query_applicable));
   }
 }
 //----------------------------------------------------------------------------
@@ -116,8 +165,10 @@ namespace
 //============================================================================
 // database_result_set
 //============================================================================
-database_result_set::database_result_set(std::shared_ptr<sqlite_statement> stmt)
+database_result_set::database_result_set(std::shared_ptr<sqlite_statement> stmt, boost::optional<boost::uint64_t> parent_id, std::shared_ptr<const std::vector<std::wstring> > applicable_actions)
   :m_stmt(stmt)
+  ,m_parent_id(parent_id)
+  ,m_applicable_actions(applicable_actions)
 {
   next();
 }
@@ -131,57 +182,110 @@ database_result_set::operator const void*() const
 
 void database_result_set::next()
 {
-  m_stmt->next();
-  if(!*m_stmt)
-    return;
-
-  // fill mandatory fields
-  m_item.id=m_stmt->get_uint64(0);
-  m_item.plugin_id=m_stmt->get_string(1);
-  m_item.item_id=m_stmt->get_string(2);
-  m_item.title=m_stmt->get_string(3);
-  m_item.description=m_stmt->get_string(4);
-  m_item.is_transient=m_stmt->get_bool(5);
-  m_item.icon_info.source=static_cast<e_icon_source>(m_stmt->get_unsigned(6));
-  m_item.icon_info.path=m_stmt->get_string(7);
-  m_item.index_version=m_stmt->get_uint64_option(8);
-
-  // fill facet fields
-  m_item.parent_id=m_stmt->get_uint64_option(9);
-  m_item.path=m_stmt->get_string_option(10);
-  m_item.launch_args=m_stmt->get_string_option(11);
-  m_item.on_enter=m_stmt->get_string_option(12);
-  m_item.on_tab=m_stmt->get_string_option(13);
-  m_item.on_query_applicable=m_stmt->get_string_option(14);
-
-  // fill search-only data
-  m_history_score=m_stmt->get_float(15);
-  m_match_score=m_stmt->get_float(16);
-  m_marked_up_title=m_stmt->get_string(17);
+  // step to next row, skipping actions which aren't applicable to the parent
+  do
+    m_stmt->next();
+  while(*m_stmt && !is_applicable());
 }
 //----------------------------------------------------------------------------
 
-const database_item &database_result_set::get_item() const
+boost::uint64_t database_result_set::get_id() const
 {
-  return m_item;
+  return m_stmt->get_uint64(column_id);
+}
+//----
+
+wstring database_result_set::get_title() const
+{
+  return m_stmt->get_string(column_title);
+}
+//----
+
+wstring database_result_set::get_description() const
+{
+  return m_stmt->get_string(column_description);
+}
+//----
+
+icon_info database_result_set::get_icon_info() const
+{
+  icon_info info;
+  info.source=static_cast<e_icon_source>(m_stmt->get_unsigned(column_icon_source));
+  info.path=m_stmt->get_string(column_icon_path);
+  return info;
+}
+//----
+
+bool database_result_set::has_path() const
+{
+  return !m_stmt->is_null(column_path);
 }
 //----
 
 float database_result_set::get_history_score() const
 {
-  return m_history_score;
+  return m_stmt->get_float(column_history_score);
 }
 //----
 
 float database_result_set::get_match_score() const
 {
-  return m_match_score;
+  return m_stmt->get_float(column_match_score);
+}
+//----
+
+wstring database_result_set::get_marked_up_title() const
+{
+  return m_stmt->get_string(column_marked_up_title);
+}
+//----
+
+database_item database_result_set::get_item() const
+{
+  database_item item;
+  read_item(*m_stmt, item);
+  return item;
+}
+//----------------------------------------------------------------------------
+
+bool database_result_set::is_applicable() const
+{
+  // children of the parent are always applicable
+  if(!m_applicable_actions || m_stmt->get_uint64_option(column_parent_id)==m_parent_id)
+    return true;
+
+  // check action against the ones applicable to the parent
+  const boost::optional<sqlite_string_view> action=m_stmt->get_string_view_option(column_on_query_applicable);
+  if(!action)
+    return false;
+  for(vector<wstring>::const_iterator iter=m_applicable_actions->begin(); iter!=m_applicable_actions->end(); ++iter)
+    if(iter->size()==action->size && 0==wmemcmp(iter->data(), action->data, action->size))
+      return true;
+  return false;
+}
+//----------------------------------------------------------------------------
+
+const wchar_t *database_result_set::get_marked_up_title(arena &a) const
+{
+  return m_stmt->get_string(column_marked_up_title, a);
+}
+//----
+
+const wchar_t *database_result_set::get_description(arena &a) const
+{
+  return m_stmt->get_string(column_description, a);
+}
+//----
+
+const wchar_t *database_result_set::get_icon_path(arena &a) const
+{
+  return m_stmt->get_string(column_icon_path, a);
 }
 //----
 
-const wstring &database_result_set::get_marked_up_title() const
+e_icon_source database_result_set::get_icon_source() const
 {
-  return m_marked_up_title;
+  return static_cast<e_icon_source>(m_stmt->get_unsigned(column_icon_source));
 }
 //----------------------------------------------------------------------------
 
@@ -189,11 +293,14 @@ const wstring &database_result_set::get_marked_up_title() const
 //============================================================================
 // database
 //============================================================================
-database::database()
+database::database(const boost::filesystem::wpath &filename)
   :m_gui(0)
-  ,m_db((profile_folder() / L"database.sqlite").string())
+  ,m_db(filename.string())
+  ,m_num_uncommitted_items(0)
+  ,m_applicable_actions_parent_id(0)
 {
   // update database schema
+  sqlite_transaction schema_transaction(m_db, sqlite_transaction::mode_immediate);
   switch(unsigned version=m_db.begin_schema_update())
   {
   case 0:
@@ -206,13 +313,12 @@ database::database()
     m_db.prepare(L"ALTER TABLE items ADD COLUMN launch_args TEXT NULL")->exec();
   }
   m_db.end_schema_update(L"database", 2);
+  schema_transaction.commit();
 
   // register custom functions
-  g_database=this;
   m_db.reg_function(L"COLIBRI_HISTORY_SCORE", 1, colibri_history_score);
   m_db.reg_function(L"COLIBRI_MATCH_SCORE", 1, colibri_match_score);
   m_db.reg_function(L"COLIBRI_MATCH_MARKED_UP_STRING", 1, colibri_match_marked_up_string);
-  m_db.reg_function(L"COLIBRI_TRIGGER_ACTION", 1, colibri_trigger_action);
 
   // prepare queries
   m_insert_query=m_db.prepare(L"INSERT INTO items (plugin_id, item_id, title, description, is_transient, icon_source, icon_path, index_version, parent_id, path, launch_args, on_enter, on_tab, on_query_applicable) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)");
@@ -267,18 +373,69 @@ void database::set_gui(gui &gui)
 void database::update_index()
 {
   /*XXX*/
+  m_applicable_actions.reset();
   for(plugins::iterator iter=m_plugins.begin(); iter!=m_plugins.end(); ++iter)
   {
+    // index in a transaction, which is rolled back if the plugin fails
     logger::infof("[%S] Updating index", (*iter)->get_name());
-    m_db.prepare(L"BEGIN TRANSACTION")->exec();
+    LOG_TRACE(logger::level_info, "[%S] Updating index", (*iter)->get_name());
+    sqlite_transaction transaction(m_db, sqlite_transaction::mode_immediate);
+    m_num_uncommitted_items=0;
     (*iter)->update_index();
-    m_db.prepare(L"COMMIT TRANSACTION")->exec();
+    transaction.commit();
+    LOG_TRACE(logger::level_info, "[%S] Updated index", (*iter)->get_name());
   }
 }
 //----------------------------------------------------------------------------
 
+void database::register_action(const std::wstring &name, plugin &handler)
+{
+  // register handler for single action
+  if(!m_action_handlers.insert(make_pair(name, &handler)).second)
+    throw_errorf("Action '%S' is already handled by plugin '%S'", name.c_str(), m_action_handlers[name]->get_name());
+}
+//----
+
+void database::register_action_prefix(const std::wstring &prefix, plugin &handler)
+{
+  // register handler for all actions up to and including the first dot
+  if(prefix.find(L'.')!=prefix.size()-1)
+    throw_errorf("Action prefix '%S' has to end with its only dot", prefix.c_str());
+  register_action(prefix, handler);
+}
+//----
+
+void database::commit_index_chunk(unsigned max_uncommitted_items)
+{
+  // commit items indexed so far once enough are pending, so that long crawls
+  // neither lose everything on failure nor hold the write lock until the end
+  sqlite_transaction *transaction=m_db.get_transaction();
+  if(!transaction || m_num_uncommitted_items<max_uncommitted_items)
+    return;
+  transaction->checkpoint();
+  m_num_uncommitted_items=0;
+}
+//----------------------------------------------------------------------------
+
 bool database::trigger_action(std::wstring name, boost::optional<database_item> target)
 {
+  // dispatch action to the plugin registered for its name or prefix
+  action_handlers::const_iterator handler=m_action_handlers.find(name);
+  if(handler==m_action_handlers.end())
+  {
+    const size_t dot=name.find(L'.');
+    if(dot!=wstring::npos)
+      handler=m_action_handlers.find(name.substr(0, dot+1));
+  }
+  if(handler!=m_action_handlers.end())
+    return handler->second->on_action(name, target);
+
+  // broadcast global events to all plugins
+  if(0!=name.compare(0, 7, L"global."))
+  {
+    LOG_WARNF_LIMITED(10, "No plugin handles action '%S'", name.c_str());
+    return false;
+  }
   bool ok=false;
   for(plugins::iterator iter=m_plugins.begin(); iter!=m_plugins.end(); ++iter)
     ok|=(*iter)->on_action(name, target);
@@ -289,19 +446,19 @@ bool database::trigger_action(std::wstring name, boost::optional<database_item>
 database_result_set database::search(const wstring &term, boost::optional<boost::uint64_t> parent_id)
 {
   // store search term
+  LOG_TRACE(logger::level_info, "Searching for '%S' (parent %llu)", term.c_str(), parent_id ? *parent_id : 0);
   g_current_term=normalized_term(term);
 
   // search
   std::shared_ptr<sqlite_statement> query;
   if(boost::uint64_t *pid=parent_id.get_ptr())
   {
-    // fetch parent item
-    g_current_parent_item=get_item_for_id(*pid);
-
-    // construct query
-    query=m_db.prepare(L"SELECT items.id AS id, plugin_id, items.item_id AS item_id, title, description, is_transient, icon_source, icon_path, index_version, parent_id, path, launch_args, on_enter, on_tab, on_query_applicable, COLIBRI_HISTORY_SCORE(item_history.term) AS history_score, COLIBRI_MATCH_SCORE(title) AS match_score, COLIBRI_MATCH_MARKED_UP_STRING(title) AS marked_up_title FROM items OUTER LEFT JOIN item_history ON item_history.item_id = items.id WHERE (parent_id = ? OR (on_query_applicable IS NOT NULL AND COLIBRI_TRIGGER_ACTION(on_query_applicable))) AND match_score!=? GROUP BY items.id ORDER BY MAX(history_score) DESC, MAX(last_invokation), match_score DESC, title ASC, description ASC");
+    // construct query (actions are filtered by the result set, see
+    // get_applicable_actions())
+    query=m_db.prepare(L"SELECT items.id AS id, plugin_id, items.item_id AS item_id, title, description, is_transient, icon_source, icon_path, index_version, parent_id, path, launch_args, on_enter, on_tab, on_query_applicable, COLIBRI_HISTORY_SCORE(item_history.term) AS history_score, COLIBRI_MATCH_SCORE(title) AS match_score, COLIBRI_MATCH_MARKED_UP_STRING(title) AS marked_up_title FROM items OUTER LEFT JOIN item_history ON item_history.item_id = items.id WHERE (parent_id = ? OR on_query_applicable IS NOT NULL) AND match_score!=? GROUP BY items.id ORDER BY MAX(history_score) DESC, MAX(last_invokation), match_score DESC, title ASC, description ASC");
     query->bind(0, *pid);
     query->bind(1, score_not_found());
+    return database_result_set(query, parent_id, get_applicable_actions(*pid));
   }
   else
   {
@@ -313,38 +470,60 @@ database_result_set database::search(const wstring &term, boost::optional<boost:
 }
 //----
 
+std::shared_ptr<const vector<wstring> > database::get_applicable_actions(boost::uint64_t parent_id)
+{
+  // reuse actions while searching below the same parent
+  if(m_applicable_actions && m_applicable_actions_parent_id==parent_id)
+    return m_applicable_actions;
+
+  // query each distinct action once for the parent item (instead of for each
+  // row from within the search)
+  const database_item parent_item=get_item_for_id(parent_id);
+  std::shared_ptr<vector<wstring> > actions(new vector<wstring>);
+  std::shared_ptr<sqlite_statement> query=m_db.prepare(L"SELECT DISTINCT on_query_applicable FROM items WHERE on_query_applicable IS NOT NULL");
+  query->exec();
+  while(*query)
+  {
+    const wstring action=query->get_string(0);
+    if(trigger_action(action, parent_item))
+      actions->push_back(action);
+    query->next();
+  }
+  m_applicable_actions_parent_id=parent_id;
+  m_applicable_actions=actions;
+  return actions;
+}
+//----
+
 database_item database::get_item_for_id(boost::uint64_t id) const
 {
-  // fetch item data
+  const boost::optional<database_item> item=try_get_item_for_id(id);
+  if(!item)
+    throw_errorf("Item not found for id %lu", id);
+  return *item;
+}
+//----
+
+boost::optional<database_item> database::try_get_item_for_id(boost::uint64_t id) const
+{
+  // fetch item data (items of a search may have been deleted by an index update since)
   std::shared_ptr<sqlite_statement> query=const_cast<sqlite_connection&>(m_db).prepare(L"SELECT id, plugin_id, item_id, title, description, is_transient, icon_source, icon_path, index_version, parent_id, path, launch_args, on_enter, on_tab, on_query_applicable FROM items WHERE id = ?");
   query->bind(0, id);
   query->exec();
   if(!*query)
-    throw_errorf("Item not found for id %lu", id);
+    return boost::none;
 
   // fill item
   database_item item;
-  item.id=query->get_uint64(0);
-  item.plugin_id=query->get_string(1);
-  item.item_id=query->get_string(2);
-  item.title=query->get_string(3);
-  item.description=query->get_string(4);
-  item.is_transient=query->get_bool(5);
-  item.icon_info.source=static_cast<e_icon_source>(query->get_unsigned(6));
-  item.icon_info.path=query->get_string(7);
-  item.index_version=query->get_uint64_option(8);
-  item.parent_id=query->get_uint64_option(9);
-  item.path=query->get_string_option(10);
-  item.launch_args=query->get_string_option(11);
-  item.on_enter=query->get_string_option(12);
-  item.on_tab=query->get_string_option(13);
-  item.on_query_applicable=query->get_string_option(14);
+  read_item(*query, item);
   return item;
 }
 //----
 
 void database::add_item(const database_item &item)
 {
+  m_applicable_actions.reset();
+  ++m_num_uncommitted_items;
   // bind values and execute
   m_insert_query->bind(0, item.plugin_id);
   m_insert_query->bind(1, item.item_id);
@@ -366,6 +545,7 @@ void database::add_item(const database_item &item)
 
 void database::add_or_update_item(const database_item &item)
 {
+  m_applicable_actions.reset();
   // bind values and execute
   m_update_query->bind(0, item.title);
   m_update_query->bind(1, item.description);
@@ -382,13 +562,16 @@ void database::add_or_update_item(const database_item &item)
   m_update_query->bind(12, item.plugin_id);
   m_update_query->bind(13, item.item_id);
   m_update_query->exec();
-  if(!m_db.get_num_affected_rows())
+  if(m_db.get_num_affected_rows())
+    ++m_num_uncommitted_items;
+  else
     add_item(item);
 }
 //----
 
 void database::delete_old_items(const std::wstring &plugin_name, boost::uint64_t current_index_version)
 {
+  m_applicable_actions.reset();
   // delete history of old items
   m_delete_old_item_history_query->bind(0, plugin_name);
   m_delete_old_item_history_query->bind(1, current_index_version);
@@ -403,6 +586,7 @@ void database::delete_old_items(const std::wstring &plugin_name, boost::uint64_t
 
 void database::delete_unindexed_items(const std::wstring &plugin_name)
 {
+  m_applicable_actions.reset();
   // delete history of unindexed_item items
   m_delete_unindexed_item_history_query->bind(0, plugin_name);
   m_delete_unindexed_item_history_query->exec();
@@ -434,4 +618,36 @@ void database::update_history(boost::uint64_t id, const wstring &term)
     query->exec();
   }
 }
+//----
+
+std::vector<icon_info> database::get_history_icons(unsigned max_items)
+{
+  // fetch icons of the most frequently and recently launched items
+  std::vector<icon_info> icons;
+  std::shared_ptr<sqlite_statement> query=m_db.prepare(L"SELECT icon_source, icon_path FROM items JOIN item_history ON item_history.item_id = items.id GROUP BY items.id ORDER BY SUM(invokation_count) DESC, MAX(last_invokation) DESC LIMIT ?");
+  query->bind(0, max_items);
+  query->exec();
+  while(*query)
+  {
+    icons.push_back(icon_info(static_cast<e_icon_source>(query->get_unsigned(0)), query->get_string(1)));
+    query->next();
+  }
+  return icons;
+}
+//----
+
+std::vector<std::wstring> database::get_history_terms(unsigned max_terms)
+{
+  // fetch the most frequently and recently used (normalized) terms
+  std::vector<std::wstring> terms;
+  std::shared_ptr<sqlite_statement> query=m_db.prepare(L"SELECT term FROM item_history GROUP BY term ORDER BY SUM(invokation_count) DESC, MAX(last_invokation) DESC LIMIT ?");
+  query->bind(0, max_terms);
+  query->exec();
+  while(*query)
+  {
+    terms.push_back(query->get_string(0));
+    query->next();
+  }
+  return terms;
+}
 //----------------------------------------------------------------------------
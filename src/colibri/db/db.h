@@ -10,6 +10,7 @@
 #include "../libraries/db/sqlite.h"
 #include "../libraries/win32/gfx.h"
 #include <vector>
+#include <hash_map>
 class gui;
 class plugin;
 class colibri_plugin;
@@ -50,6 +51,10 @@ struct database_item
 
 //============================================================================
 // database_result_set
+//
+// Only steps the underlying statement; columns are decoded on demand by the
+// accessors, so rows which are skipped or only partially displayed don't pay
+// for decoding (and copying) all of their strings.
 //============================================================================
 class database_result_set
 {
@@ -59,23 +64,34 @@ public:
   void next();
   //--------------------------------------------------------------------------
 
-  // accessors
-  const database_item &get_item() const;
+  // accessors (valid until next() is called)
+  boost::uint64_t get_id() const;
+  std::wstring get_title() const;
+  std::wstring get_description() const;
+  icon_info get_icon_info() const;
+  bool has_path() const;
   float get_history_score() const;
   float get_match_score() const;
-  const std::wstring &get_marked_up_title() const;
+  std::wstring get_marked_up_title() const;
+  database_item get_item() const; // decodes all item columns
+  //--------------------------------------------------------------------------
+
+  // arena accessors (strings are owned by the arena)
+  const wchar_t *get_marked_up_title(arena&) const;
+  const wchar_t *get_description(arena&) const;
+  const wchar_t *get_icon_path(arena&) const;
+  e_icon_source get_icon_source() const;
   //--------------------------------------------------------------------------
 
 private:
-  database_result_set(std::shared_ptr<sqlite_statement>);
+  database_result_set(std::shared_ptr<sqlite_statement>, boost::optional<boost::uint64_t> parent_id=boost::none, std::shared_ptr<const std::vector<std::wstring> > applicable_actions=std::shared_ptr<const std::vector<std::wstring> >());
   friend class database;
+  bool is_applicable() const;
   //--------------------------------------------------------------------------
 
   std::shared_ptr<sqlite_statement> m_stmt;
-  database_item m_item;
-  float m_history_score;
-  float m_match_score;
-  std::wstring m_marked_up_title;
+  boost::optional<boost::uint64_t> m_parent_id;
+  std::shared_ptr<const std::vector<std::wstring> > m_applicable_actions;
 };
 //----------------------------------------------------------------------------
 
@@ -87,7 +103,7 @@ class database
 {
 public:
   // construction
-  database();
+  database(const boost::filesystem::wpath &filename);
   //--------------------------------------------------------------------------
 
   // plugins
@@ -96,15 +112,19 @@ public:
   colibri_plugin &get_colibri_plugin();
   void set_gui(gui&);
   void update_index();
+  void commit_index_chunk(unsigned max_uncommitted_items=1000);
   //--------------------------------------------------------------------------
 
   // actions
+  void register_action(const std::wstring &name, plugin&);
+  void register_action_prefix(const std::wstring &prefix, plugin&);
   bool trigger_action(std::wstring name, boost::optional<database_item> target=boost::none);
   //--------------------------------------------------------------------------
 
   // item lookup
   database_result_set search(const std::wstring &term, boost::optional<boost::uint64_t> parent_id=boost::none);
   database_item get_item_for_id(boost::uint64_t id) const;
+  boost::optional<database_item> try_get_item_for_id(boost::uint64_t id) const;
   //--------------------------------------------------------------------------
 
   // item management
@@ -116,16 +136,26 @@ public:
 
   // history management
   void update_history(boost::uint64_t id, const std::wstring &term);
+  std::vector<icon_info> get_history_icons(unsigned max_items);
+  std::vector<std::wstring> get_history_terms(unsigned max_terms);
   //--------------------------------------------------------------------------
 
 private:
   typedef std::vector<std::shared_ptr<plugin> > plugins;
+  typedef stdext::hash_map<std::wstring, plugin*> action_handlers;
+  std::shared_ptr<const std::vector<std::wstring> > get_applicable_actions(boost::uint64_t parent_id);
+  //--------------------------------------------------------------------------
+
   gui *m_gui;
   plugins m_plugins;
+  action_handlers m_action_handlers; // by action name or prefix
   sqlite_connection m_db;
   std::shared_ptr<sqlite_statement> m_insert_query, m_update_query;
   std::shared_ptr<sqlite_statement> m_delete_old_item_history_query, m_delete_old_items_query;
   std::shared_ptr<sqlite_statement> m_delete_unindexed_item_history_query, m_delete_unindexed_items_query;
+  unsigned m_num_uncommitted_items;
+  boost::uint64_t m_applicable_actions_parent_id;
+  std::shared_ptr<const std::vector<std::wstring> > m_applicable_actions; // reset when items change
 };
 //----------------------------------------------------------------------------
 
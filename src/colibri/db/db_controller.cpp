@@ -6,11 +6,152 @@
 
 #include "db_controller.h"
 #include "db.h"
+#include "match.h"
+#include "session_recorder.h"
 #include "../plugins/colibri_plugin.h"
 #include "../libraries/win32/shell.h"
+#include "../libraries/log/trace.h"
+#include "../libraries/log/metrics.h"
 using namespace std;
 //----------------------------------------------------------------------------
 
+
+//============================================================================
+// local definitions
+//============================================================================
+namespace
+{
+  // latency histograms (see "Latency statistics" in the colibri menu)
+  logger::latency_histogram &g_search_latency=logger::get_latency_histogram("search");
+  logger::latency_histogram &g_build_options_latency=logger::get_latency_histogram("build_options");
+  //--------------------------------------------------------------------------
+
+
+  //==========================================================================
+  // db_option_source
+  //
+  // Options of a search. The result set is stepped once, keeping the first
+  // options (which are displayed right away) and only the item ids of the
+  // remaining results; their items are fetched again when the dropdown
+  // scrolls to them. Kept options are stored in an arena which is freed at
+  // once with the option source (i.e. when the next search replaces it).
+  //==========================================================================
+  class db_option_source: public gui::option_source
+  {
+  public:
+    // construction
+    db_option_source(database &db, const wstring &term, size_t num_kept_options)
+      :m_db(db)
+      ,m_term(normalized_term(term))
+      ,m_num_kept_options(num_kept_options)
+      ,m_kept_options(m_arena.allocate_array<kept_option>(num_kept_options))
+      ,m_all_have_arrow_overlay(true)
+    {
+    }
+    //------------------------------------------------------------------------
+
+    // building
+    void add(const database_result_set &rs)
+    {
+      // only decode the strings of kept options
+      const boost::uint64_t id=rs.get_id();
+      const bool has_path=rs.has_path();
+      if(has_path)
+        m_all_have_arrow_overlay=false;
+      if(m_ids.size()<m_num_kept_options)
+      {
+        kept_option &option=m_kept_options[m_ids.size()];
+        option.title=rs.get_marked_up_title(m_arena);
+        option.description=rs.get_description(m_arena);
+        option.icon_path=rs.get_icon_path(m_arena);
+        option.icon_source=rs.get_icon_source();
+        option.has_arrow_overlay=!has_path;
+      }
+      m_ids.push_back(id);
+    }
+    //----
+
+    const arena &get_arena() const
+    {
+      return m_arena;
+    }
+    //------------------------------------------------------------------------
+
+    // accessors
+    virtual size_t get_num_options() const
+    {
+      return m_ids.size();
+    }
+    //----
+
+    virtual gui::option get_option(size_t index)
+    {
+      // fetch option unless it has been kept
+      gui::option option=index<m_num_kept_options ? get_kept_option(index) : fetch_option(m_ids[index]);
+
+      // remove arrow if all items have one
+      if(m_all_have_arrow_overlay)
+        option.has_arrow_overlay=false;
+      return option;
+    }
+    //----
+
+    virtual boost::uint64_t get_option_data(size_t index) const
+    {
+      return m_ids[index];
+    }
+    //------------------------------------------------------------------------
+
+  private:
+    struct kept_option
+    {
+      const wchar_t *title;
+      const wchar_t *description;
+      const wchar_t *icon_path;
+      e_icon_source icon_source;
+      bool has_arrow_overlay;
+    };
+    //------------------------------------------------------------------------
+
+    gui::option get_kept_option(size_t index) const
+    {
+      const kept_option &kept=m_kept_options[index];
+      gui::option option(kept.title, kept.description, icon_info(kept.icon_source, kept.icon_path), m_ids[index]);
+      option.has_arrow_overlay=kept.has_arrow_overlay;
+      return option;
+    }
+    //----
+
+    gui::option fetch_option(boost::uint64_t id) const
+    {
+      // fetch item and mark up its title like the search does, items deleted
+      // since the search get a placeholder (and can't be launched)
+      const boost::optional<database_item> found_item=m_db.try_get_item_for_id(id);
+      if(!found_item)
+        return gui::option(L"Item removed", L"This item is no longer indexed", icon_info(icon_source_theme, L"fallback"), id);
+      const database_item &item=*found_item;
+      float score;
+      wstring marked_up_title;
+      if(m_term.empty() || !match(m_term.c_str(), item.title.c_str(), score, marked_up_title))
+        marked_up_title=item.title;
+      gui::option option(marked_up_title, item.description, item.icon_info, id);
+      option.has_arrow_overlay=!item.path;
+      return option;
+    }
+    //------------------------------------------------------------------------
+
+    database &m_db;
+    const wstring m_term;
+    const size_t m_num_kept_options;
+    arena m_arena;
+    kept_option *const m_kept_options;
+    vector<boost::uint64_t> m_ids;
+    bool m_all_have_arrow_overlay;
+  };
+  //--------------------------------------------------------------------------
+}
+//----------------------------------------------------------------------------
+
 //============================================================================
 // db_controller
 //============================================================================
@@ -23,6 +164,8 @@ db_controller::db_controller(database &db, boost::optional<boost::uint64_t> pare
 
 bool db_controller::on_tab(gui &gui)
 {
+  if(session_recorder *recorder=get_session_recorder())
+    recorder->record_tab(gui.get_current_option_index());
   const boost::optional<database_item> item=create_or_get_current_item(gui);
   if(!item)
   {
@@ -47,6 +190,8 @@ bool db_controller::on_tab(gui &gui)
 
 bool db_controller::on_enter(gui &gui)
 {
+  if(session_recorder *recorder=get_session_recorder())
+    recorder->record_enter(gui.get_current_option_index());
   const boost::optional<database_item> item=create_or_get_current_item(gui);
   if(!item)
     return false;
@@ -58,43 +203,64 @@ bool db_controller::on_enter(gui &gui)
   // try to trigger default action
   database_result_set rs=m_db.search(L"", item->id);
   if(rs)
-    if(const wstring *on_enter=rs.get_item().on_enter.get_ptr())
-      return m_db.trigger_action(*on_enter, rs.get_item().on_query_applicable ? item : rs.get_item());
+  {
+    const database_item default_item=rs.get_item();
+    if(const wstring *on_enter=default_item.on_enter.get_ptr())
+      return m_db.trigger_action(*on_enter, default_item.on_query_applicable ? item : default_item);
+  }
   return false;
 }
 //----
 
 void db_controller::on_input_changed(gui &gui)
 {
-  vector<gui::option> options;
-  m_items.clear();
+  if(session_recorder *recorder=get_session_recorder())
+    recorder->record_input(wcslen(gui.get_current_term()));
+
+  // keep options of the first two pages (shown and prefetched right away)
+  const unsigned rows_per_page=gui.get_dropdown_rows_per_page();
+  std::shared_ptr<db_option_source> options(new db_option_source(m_db, gui.get_current_term(), 2*size_t(rows_per_page)));
 
-  // perform search?
-  bool all_have_arrow_overlay=true;
+  // perform search? (time spent stepping the result set is accounted to the
+  // search, the remainder to building the options)
   if(*gui.get_current_term() || m_parent_id)
   {
-    for(database_result_set rs=m_db.search(gui.get_current_term(), m_parent_id); rs; rs.next())
+    const unsigned long long start=logger::get_monotonic_time();
+    database_result_set rs=m_db.search(gui.get_current_term(), m_parent_id);
+    unsigned long long search_time=logger::get_monotonic_time()-start;
+    while(rs)
     {
-      // remember item
-      m_items[*rs.get_item().id]=rs.get_item();
-
       // add gui option
-      gui::option option(rs.get_marked_up_title(), rs.get_item().description, rs.get_item().icon_info, *rs.get_item().id);
-      if(!rs.get_item().path)
-        option.has_arrow_overlay=true;
-      else
-        all_have_arrow_overlay=false;
-      options.push_back(option);
+      options->add(rs);
+
+      // step to next result
+      const unsigned long long step_start=logger::get_monotonic_time();
+      rs.next();
+      search_time+=logger::get_monotonic_time()-step_start;
     }
+    g_search_latency.add(search_time);
+    g_build_options_latency.add(logger::get_monotonic_time()-start-search_time);
   }
 
-  // remove arrow if all items have one
-  if(all_have_arrow_overlay)
-    for(vector<gui::option>::iterator iter=options.begin(); iter!=options.end(); ++iter)
-      iter->has_arrow_overlay=false;
-
   // set options
-  gui.set_options(options.begin(), options.end());
+  const size_t num_options=options->get_num_options();
+  LOG_TRACE(logger::level_info, "Showing %u options", unsigned(num_options));
+  const arena &options_arena=options->get_arena();
+  LOG_TRACE(logger::level_debug, "Option arena: %u allocations in %u blocks (%u bytes)", unsigned(options_arena.get_num_allocations()), unsigned(options_arena.get_num_blocks()), unsigned(options_arena.get_num_bytes()));
+  gui.set_options(options);
+
+  // prefetch icons of the next page or, without a search, of the items most
+  // likely to be picked (this replaces the previous prefetch)
+  vector<icon_info> icons;
+  if(!num_options)
+  {
+    if(!*gui.get_current_term() && !m_parent_id)
+      icons=m_db.get_history_icons(rows_per_page);
+  }
+  else
+    for(size_t i=rows_per_page; i<num_options && i<2*size_t(rows_per_page); ++i)
+      icons.push_back(options->get_option(i).icon_info);
+  gui.prefetch_icons(icons);
 }
 //----------------------------------------------------------------------------
 
@@ -117,6 +283,13 @@ bool db_controller::is_url(std::wstring &term)
 }
 //----
 
+session_recorder *db_controller::get_session_recorder() const
+{
+  // only sessions of the main brick are recorded
+  return m_parent_id ? 0 : m_db.get_colibri_plugin().get_session_recorder();
+}
+//----
+
 boost::optional<database_item> db_controller::create_or_get_current_item(gui &gui)
 {
   // try to add item if none is selected
@@ -142,12 +315,14 @@ boost::optional<database_item> db_controller::create_or_get_current_item(gui &gu
     }       
   }
 
-  // update timestamp if possible
-  items::const_iterator iter=m_items.find(*gui.get_current_option_data());
-  if(iter!=m_items.end())
+  // fetch item and update timestamp if possible (the item may have been
+  // deleted since the search)
+  if(const boost::optional<boost::uint64_t> id=gui.get_current_option_data())
   {
-    m_db.update_history(*iter->second.id, gui.get_current_term());
-    return iter->second;
+    const boost::optional<database_item> item=m_db.try_get_item_for_id(*id);
+    if(item)
+      m_db.update_history(*id, gui.get_current_term());
+    return item;
   }
   return boost::none;
 }
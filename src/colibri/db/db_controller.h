@@ -7,10 +7,10 @@
 #ifndef COLIBRI_DB_CONTROLLER_H
 #define COLIBRI_DB_CONTROLLER_H
 #include "../gui/controller.h"
-#include <hash_map>
 #include <boost/optional.hpp>
 class database;
 struct database_item;
+class session_recorder;
 //----------------------------------------------------------------------------
 
 // Interface:
@@ -36,13 +36,12 @@ public:
 
 private:
   static bool is_url(std::wstring&);
+  session_recorder *get_session_recorder() const;
   boost::optional<database_item> create_or_get_current_item(gui&);
   //--------------------------------------------------------------------------
 
-  typedef stdext::hash_map<boost::uint64_t, database_item> items;
   database &m_db;
   boost::optional<boost::uint64_t> m_parent_id;
-  items m_items;
 };
 //----------------------------------------------------------------------------
 
@@ -6,6 +6,7 @@
 
 #include "match.h"
 #include <cfloat>
+#include <cwctype>
 using namespace std;
 //----------------------------------------------------------------------------
 
@@ -6,7 +6,7 @@
 
 #ifndef COLIBRI_DB_MATCH_H
 #define COLIBRI_DB_MATCH_H
-#include "../core/defs.h"
+#include "../libraries/core/defs.h"
 #include <limits>
 //----------------------------------------------------------------------------
 
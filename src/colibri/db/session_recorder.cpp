@@ -0,0 +1,168 @@
+//============================================================================
+// session_recorder.cpp: Anonymized search session recording
+//
+// (c) Michael Walter, 2005-2007
+//============================================================================
+
+#include "session_recorder.h"
+#include "../libraries/log/metrics.h"
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+using namespace std;
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// local definitions
+//============================================================================
+namespace
+{
+  // sessions end after a minute without input
+  const unsigned long long session_timeout=60*1000000;
+  //--------------------------------------------------------------------------
+}
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// read_sessions()
+//============================================================================
+vector<session> read_sessions(const char *filename)
+{
+  // open recording
+  FILE *file=fopen(filename, "r");
+  if(!file)
+    throw_errorf("Unable to open session recording '%s'", filename);
+
+  // parse one event per line, skipping unknown lines
+  vector<session> sessions;
+  char line[256];
+  while(fgets(line, sizeof(line), file))
+  {
+    if('s'==line[0])
+    {
+      sessions.push_back(session());
+      continue;
+    }
+    if(sessions.empty())
+      continue;
+    session_event event;
+    char rank[16];
+    if(2==sscanf(line, "k %u %u", &event.delay, &event.term_length))
+      event.type=session_event::type_type;
+    else if(2==sscanf(line, "b %u %u", &event.delay, &event.term_length))
+      event.type=session_event::type_backspace;
+    else if(2==sscanf(line, "e %u %15s", &event.delay, rank) || 2==sscanf(line, "t %u %15s", &event.delay, rank))
+    {
+      event.type='e'==line[0] ? session_event::type_enter : session_event::type_tab;
+      event.term_length=0;
+      if(strcmp(rank, "-"))
+        event.rank=unsigned(atoi(rank));
+    }
+    else
+      continue;
+    sessions.back().push_back(event);
+  }
+  fclose(file);
+
+  // drop sessions without input
+  vector<session> result;
+  for(vector<session>::const_iterator iter=sessions.begin(); iter!=sessions.end(); ++iter)
+    if(!iter->empty())
+      result.push_back(*iter);
+  return result;
+}
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// session_recorder
+//============================================================================
+session_recorder::session_recorder(const boost::filesystem::wpath &filename)
+  :m_is_in_session(false)
+  ,m_term_length(0)
+  ,m_last_event_time(0)
+{
+  // append to recording
+#ifdef _WIN32
+  m_file=_wfopen(filename.string().c_str(), L"a");
+  if(!m_file)
+    throw_errorf("Unable to open session recording '%S'", filename.string().c_str());
+#else
+  m_file=fopen(filename.external_file_string().c_str(), "a");
+  if(!m_file)
+    throw_errorf("Unable to open session recording '%s'", filename.external_file_string().c_str());
+#endif
+}
+//----
+
+session_recorder::~session_recorder()
+{
+  fclose(m_file);
+}
+//----------------------------------------------------------------------------
+
+void session_recorder::record_input(size_t term_length)
+{
+  // ignore refreshes which didn't change the term
+  if(term_length==m_term_length)
+    return;
+
+  // start session on the first change of a non-empty term
+  if(m_is_in_session && get_delay()>=session_timeout/1000)
+    m_is_in_session=false;
+  if(!m_is_in_session)
+  {
+    if(!term_length)
+    {
+      m_term_length=0;
+      return;
+    }
+    fputs("s\n", m_file);
+    m_is_in_session=true;
+    m_last_event_time=logger::get_monotonic_time();
+  }
+
+  // record typed or deleted character, a cleared term ends the session
+  fprintf(m_file, "%c %u %u\n", term_length<m_term_length ? 'b' : 'k', get_delay(), unsigned(term_length));
+  fflush(m_file);
+  m_term_length=term_length;
+  m_last_event_time=logger::get_monotonic_time();
+  if(!term_length)
+    m_is_in_session=false;
+}
+//----
+
+void session_recorder::record_enter(boost::optional<size_t> rank)
+{
+  record_selection('e', rank);
+}
+//----
+
+void session_recorder::record_tab(boost::optional<size_t> rank)
+{
+  record_selection('t', rank);
+}
+//----------------------------------------------------------------------------
+
+unsigned session_recorder::get_delay()
+{
+  // milliseconds since the previous event
+  return unsigned(min<unsigned long long>((logger::get_monotonic_time()-m_last_event_time)/1000, ~0u));
+}
+//----
+
+void session_recorder::record_selection(char type, boost::optional<size_t> rank)
+{
+  // record selected rank, which ends the session
+  if(!m_is_in_session)
+    return;
+  if(rank)
+    fprintf(m_file, "%c %u %u\n", type, get_delay(), unsigned(*rank));
+  else
+    fprintf(m_file, "%c %u -\n", type, get_delay());
+  fflush(m_file);
+  m_is_in_session=false;
+}
+//----------------------------------------------------------------------------
@@ -0,0 +1,87 @@
+//============================================================================
+// session_recorder.h: Anonymized search session recording
+//
+// (c) Michael Walter, 2005-2007
+//============================================================================
+
+#ifndef COLIBRI_DB_SESSION_RECORDER_H
+#define COLIBRI_DB_SESSION_RECORDER_H
+#include "../libraries/core/defs.h"
+#include <cstdio>
+#include <vector>
+#include <boost/optional.hpp>
+#include <boost/filesystem/path.hpp>
+//----------------------------------------------------------------------------
+
+// Interface:
+struct session_event;
+class session_recorder;
+typedef std::vector<session_event> session;
+std::vector<session> read_sessions(const char *filename);
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// session_event
+//============================================================================
+struct session_event
+{
+  enum e_type
+  {
+    type_type, // term got longer
+    type_backspace, // term got shorter
+    type_enter,
+    type_tab
+  };
+  e_type type;
+  unsigned delay; // in milliseconds since the previous event of the session
+  unsigned term_length; // type_type and type_backspace
+  boost::optional<unsigned> rank; // type_enter and type_tab, if an option was selected
+};
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// session_recorder
+//
+// Appends search sessions of the main brick to a text file, one event per
+// line, for replaying them with the benchmark tool. Only term lengths,
+// delays and selected ranks are recorded, i.e. neither terms nor items nor
+// the time of day:
+//   s                    session starts
+//   k <delay> <length>   character typed
+//   b <delay> <length>   character deleted (a cleared term ends the session)
+//   e <delay> <rank>     enter pressed ("-" if no option was selected)
+//   t <delay> <rank>     tab pressed
+// Sessions also end after a minute without input. Sessions may start with
+// a non-empty term, e.g. if the term was kept after the last launch.
+//============================================================================
+class session_recorder
+{
+public:
+  // construction and destruction
+  session_recorder(const boost::filesystem::wpath &filename);
+  ~session_recorder();
+  //--------------------------------------------------------------------------
+
+  // recording
+  void record_input(size_t term_length);
+  void record_enter(boost::optional<size_t> rank);
+  void record_tab(boost::optional<size_t> rank);
+  //--------------------------------------------------------------------------
+
+private:
+  session_recorder(const session_recorder&); // not implemented
+  void operator=(const session_recorder&); // not implemented
+  unsigned get_delay();
+  void record_selection(char type, boost::optional<size_t> rank);
+  //--------------------------------------------------------------------------
+
+  FILE *m_file;
+  bool m_is_in_session;
+  size_t m_term_length;
+  unsigned long long m_last_event_time;
+};
+//----------------------------------------------------------------------------
+
+#endif
@@ -11,6 +11,7 @@
 #include "../libraries/win32/shell.h"
 #include "../libraries/win32/win.h"
 #include "../libraries/log/log.h"
+#include "../libraries/log/metrics.h"
 #include <set>
 #include <sstream>
 using namespace std;
@@ -51,6 +52,39 @@ namespace
   void null_controller::on_input_changed(gui&)
   {
   }
+  //--------------------------------------------------------------------------
+
+  // conversion of GDI+ rectangles, rounding outwards
+  pixel_rect to_pixel_rect(const Gdiplus::RectF &rc)
+  {
+    const int x0=int(floor(rc.X)), y0=int(floor(rc.Y));
+    const int x1=int(ceil(rc.X+rc.Width)), y1=int(ceil(rc.Y+rc.Height));
+    return pixel_rect(x0, y0, unsigned(max(x1-x0, 0)), unsigned(max(y1-y0, 0)));
+  }
+  //----
+
+  Gdiplus::Rect to_gdiplus_rect(const pixel_rect &rc)
+  {
+    return Gdiplus::Rect(rc.x, rc.y, INT(rc.width), INT(rc.height));
+  }
+  //--------------------------------------------------------------------------
+
+  // latency histograms (see "Latency statistics" in the colibri menu)
+  logger::latency_histogram &g_input_queue_latency=logger::get_latency_histogram("input_queue");
+  logger::latency_histogram &g_input_to_paint_latency=logger::get_latency_histogram("input_to_paint");
+  logger::latency_histogram &g_paint_brick_latency=logger::get_latency_histogram("paint_brick");
+  logger::latency_histogram &g_paint_dropdown_latency=logger::get_latency_histogram("paint_dropdown");
+  logger::latency_histogram &g_update_window_latency=logger::get_latency_histogram("update_layered_window");
+  //----
+
+  void add_input_queue_latency()
+  {
+    // time the current message spent in the message queue, kept apart from
+    // the QPC-timed handler latencies since GetMessageTime() only has the
+    // resolution of GetTickCount() (10-16 ms)
+    g_input_queue_latency.add((GetTickCount()-DWORD(GetMessageTime()))*1000ull);
+  }
+  //--------------------------------------------------------------------------
 }
 //----------------------------------------------------------------------------
 
@@ -74,12 +108,14 @@ struct gui::brick
 
   // shared state
   wstring input;
+  std::auto_ptr<dc> back_buffer;
+  damage_region damage;
   //--------------------------------------------------------------------------
 
   // option brick state
   unsigned y_scroll_amount;
-  vector<option> options;
-  vector<option>::size_type active_option_index; // well-defined iff options.size()>0
+  std::shared_ptr<option_source> options;
+  size_t active_option_index; // well-defined iff options->get_num_options()>0
   boost::optional<boost::uint64_t> last_user_activated_option; // last option consciously activated by user
   //--------------------------------------------------------------------------
 
@@ -97,6 +133,7 @@ gui::brick::brick(e_brick_type type, HWND handle, ::controller &controller, boos
   ,controller(controller)
   ,custom_icon(custom_icon)
   ,y_scroll_amount(0)
+  ,options(new option_vector)
   ,active_option_index(0)
   ,last_user_activated_option(none)
   ,credits_start_ticks(0)
@@ -162,6 +199,10 @@ gui::gui(colibri_plugin &colibri)
   m_dropdown=CreateWindowExW(WS_EX_LAYERED|WS_EX_TOOLWINDOW, L"ColibriDropdown", L"Colibri", WS_POPUP, 0, 0, m_theme->get_dropdown_width(), m_theme->get_dropdown_height(), 0, 0, GetModuleHandle(0), this);
   if(!m_dropdown)
     throw runtime_error("Unable to create drop down window.");
+  m_dropdown_back_buffer.reset(new dc(m_theme->get_dropdown_width(), m_theme->get_dropdown_height()));
+  set_icon_notify_window(m_dropdown, WM_COLIBRI_ICON_LOADED);
+  set_icon_cache_size(m_colibri.get_icon_cache_size()*1024*1024);
+  set_icon_store_file(profile_folder() / L"icons.cache");
 
   // create dimmer
   m_dimmer=CreateWindowExW(WS_EX_TOOLWINDOW|WS_EX_LAYERED|WS_EX_TRANSPARENT, L"ColibriDimmer", L"Colibri", WS_POPUP, 0, 0, 10, 10, 0, 0, GetModuleHandle(0), this);
@@ -203,6 +244,7 @@ gui::~gui()
   }
 
   // free dropdown
+  set_icon_notify_window(0, 0);
   DestroyWindow(m_dropdown);
 
   // free dimmer
@@ -210,6 +252,11 @@ gui::~gui()
 
   // free context menu
   DestroyMenu(m_context_menu);
+
+  // log latency (and query, if profiled) statistics of the session
+  logger::log_latency_summaries(logger::level_info);
+  if(is_sqlite_profiling_enabled())
+    log_sqlite_query_profiles();
 }
 //----
 
@@ -379,8 +426,20 @@ optional<boost::uint64_t> gui::get_current_option_data() const
   if(brick_type_option!=get_current_brick().type)
     throw logic_error("get_current_option_data() should only be called for option bricks.");
   const brick &brick=get_current_brick();
-  if(brick.active_option_index<brick.options.size())
-    return brick.options[brick.active_option_index].data;
+  if(brick.active_option_index<brick.options->get_num_options())
+    return brick.options->get_option_data(brick.active_option_index);
+  return none;
+}
+//----
+
+optional<size_t> gui::get_current_option_index() const
+{
+  // return index of the active option of the current brick
+  if(brick_type_option!=get_current_brick().type)
+    throw logic_error("get_current_option_index() should only be called for option bricks.");
+  const brick &brick=get_current_brick();
+  if(brick.active_option_index<brick.options->get_num_options())
+    return brick.active_option_index;
   return none;
 }
 //----
@@ -391,21 +450,45 @@ void gui::set_current_option(unsigned index)
   if(brick_type_option!=get_current_brick().type)
     throw logic_error("set_current_option() should only be called for option bricks.");
   brick &brick=get_current_brick();
-  if(index>=brick.options.size())
-    throw_errorf("Option index %u should be in [0,%u).", index, brick.options.size());
+  if(index>=brick.options->get_num_options())
+    throw_errorf("Option index %u should be in [0,%u).", index, unsigned(brick.options->get_num_options()));
+  const size_t old_index=brick.active_option_index;
   brick.active_option_index=index;
 
   // repaint brick and dropdown
-  repaint(get_current_brick());
+  invalidate_selection(brick, old_index);
+  repaint(brick);
   repaint_dropdown();
 }
 //----
 
+void gui::set_options(std::shared_ptr<option_source> options)
+{
+  // set options of current brick
+  if(brick_type_option!=get_current_brick().type)
+    throw logic_error("set_options() should only be called for option bricks.");
+  get_current_brick().options=options;
+  on_options_changed();
+}
+//----
+
 void gui::add_term_char(wchar_t ch)
 {
   try_add_char(ch);
   on_input_changed();
 }
+//----
+
+unsigned gui::get_dropdown_rows_per_page() const
+{
+  return m_theme->get_dropdown_rows_per_page();
+}
+//----
+
+void gui::prefetch_icons(const std::vector<icon_info> &icons)
+{
+  m_theme->prefetch_icons(icons);
+}
 //----------------------------------------------------------------------------
 
 const wchar_t *gui::get_current_text() const
@@ -493,7 +576,10 @@ LRESULT CALLBACK gui::wnd_proc_brick(HWND win, UINT msg, WPARAM wparam, LPARAM l
   {
     brick &brick=gui.get_current_brick();
     if(brick_type_credits==brick.type)
+    {
+      gui.invalidate(brick, gui.m_theme->get_brick_text_rect());
       gui.repaint(brick);
+    }
   }
 
   // Ctrl-Space: show main brick
@@ -502,7 +588,10 @@ LRESULT CALLBACK gui::wnd_proc_brick(HWND win, UINT msg, WPARAM wparam, LPARAM l
     // reset hot key
     brick &brick=gui.get_current_brick();
     if(brick_type_hotkey==brick.type)
+    {
+      gui.invalidate(brick, gui.m_theme->get_brick_text_rect());
       gui.repaint(brick);
+    }
 
     // bring main brick to foreground
     DWORD pidForeground=GetWindowThreadProcessId(GetForegroundWindow(), 0);
@@ -577,6 +666,7 @@ LRESULT CALLBACK gui::wnd_proc_brick(HWND win, UINT msg, WPARAM wparam, LPARAM l
         hk.rwin=rwin;
         hk.vk=DWORD(wparam);
         gui.m_colibri.set_hotkey(hk);
+        gui.invalidate(gui.get_current_brick(), gui.m_theme->get_brick_text_rect());
         gui.repaint(gui.get_current_brick());
       }
       else if(VK_F1<=wparam && wparam<=VK_F24)
@@ -590,6 +680,7 @@ LRESULT CALLBACK gui::wnd_proc_brick(HWND win, UINT msg, WPARAM wparam, LPARAM l
         hk.rwin=rwin;
         hk.vk=DWORD(wparam);
         gui.m_colibri.set_hotkey(hk);
+        gui.invalidate(gui.get_current_brick(), gui.m_theme->get_brick_text_rect());
         gui.repaint(gui.get_current_brick());
       }
     }
@@ -658,8 +749,9 @@ LRESULT CALLBACK gui::wnd_proc_brick(HWND win, UINT msg, WPARAM wparam, LPARAM l
   if(WM_KEYDOWN==msg && (VK_UP==wparam || VK_DOWN==wparam || VK_PRIOR==wparam || VK_NEXT==wparam))
   {
     brick &brick=gui.get_current_brick();
+    const size_t old_index=brick.active_option_index;
     bool ok=false;
-    if(const vector<option>::size_type num_options=brick.options.size())
+    if(const size_t num_options=brick.options->get_num_options())
     {
       const unsigned dropdown_rows_per_page=gui.m_theme->get_dropdown_rows_per_page();
       switch(wparam)
@@ -701,9 +793,10 @@ LRESULT CALLBACK gui::wnd_proc_brick(HWND win, UINT msg, WPARAM wparam, LPARAM l
     if(ok)
     {
       // remember option as having been conciously actived by the user
-      brick.last_user_activated_option=brick.options[brick.active_option_index].data;
+      brick.last_user_activated_option=brick.options->get_option_data(brick.active_option_index);
 
       // update scrolling and repaint
+      gui.invalidate_selection(brick, old_index);
       gui.repaint(brick);
       gui.repaint_dropdown();
     }
@@ -731,6 +824,8 @@ LRESULT CALLBACK gui::wnd_proc_brick(HWND win, UINT msg, WPARAM wparam, LPARAM l
       }
       else
         brick.input.resize(input_len-1);
+      add_input_queue_latency();
+      logger::scoped_latency latency(g_input_to_paint_latency);
       gui.on_input_changed();
     }
     else
@@ -741,6 +836,8 @@ LRESULT CALLBACK gui::wnd_proc_brick(HWND win, UINT msg, WPARAM wparam, LPARAM l
   // Any printable character: add to text string
   if(WM_CHAR==msg && wparam>=L' ')
   {
+    add_input_queue_latency();
+    logger::scoped_latency latency(g_input_to_paint_latency);
     if(gui.try_add_char(wchar_t(wparam)))
       gui.on_input_changed();
   }
@@ -762,10 +859,39 @@ LRESULT CALLBACK gui::wnd_proc_dropdown(HWND win, UINT msg, WPARAM wparam, LPARA
     return 0;
   }
 
+  // repaint with icons loaded in the background
+  if(WM_COLIBRI_ICON_LOADED==msg)
+  {
+    // coalesce notifications
+    MSG pending;
+    while(PeekMessage(&pending, win, WM_COLIBRI_ICON_LOADED, WM_COLIBRI_ICON_LOADED, PM_REMOVE));
+
+    // repaint icons of brick and dropdown
+    if(gui.m_bricks.size())
+    {
+      gui.invalidate(gui.get_current_brick(), gui.m_theme->get_brick_icon_rect());
+      gui.invalidate_dropdown(gui.m_theme->get_dropdown_page_rect());
+      gui.repaint(gui.get_current_brick());
+      gui.repaint_dropdown();
+    }
+    return 0;
+  }
+
   // ignore all other messages until Colibri has been initialized
   if(gui.m_in_startup)
     return DefWindowProc(win, msg, wparam, lparam);
 
+  // relayout when the monitor configuration changes
+  if(WM_DISPLAYCHANGE==msg)
+  {
+    if(gui.m_bricks.size())
+    {
+      gui.m_rc_monitor=get_monitor(gui.m_colibri.get_monitor()).rect;
+      gui.relayout();
+    }
+    return 0;
+  }
+
   // activate current brick on activation
   if(WM_ACTIVATE==msg && WA_INACTIVE!=wparam)
   {
@@ -876,6 +1002,8 @@ void gui::push_brick(e_brick_type type, controller &controller, boost::optional<
   // push onto brick stack
   brick *brick=new gui::brick(type, win, controller, custom_icon);
   m_bricks.push_front(brick);
+  brick->back_buffer.reset(new dc(m_theme->get_brick_width(), m_theme->get_brick_height()));
+  invalidate(*brick);
 
   // first brick gets promoted to main brick
   if(1==m_bricks.size())
@@ -920,15 +1048,6 @@ gui::brick &gui::get_current_brick()
 }
 //----
 
-vector<gui::option> &gui::get_options()
-{
-  // return search term of current brick
-  if(brick_type_option!=get_current_brick().type)
-    throw logic_error("get_options() should only be called for option bricks.");
-  return get_current_brick().options;
-}
-//----
-
 bool gui::try_add_char(wchar_t ch)
 {
   // filter control chars
@@ -943,7 +1062,9 @@ bool gui::try_add_char(wchar_t ch)
 
 void gui::on_input_changed()
 {
-  // repaint brick and dropdown
+  // repaint input (brick title or hint and dropdown header)
+  invalidate(get_current_brick(), m_theme->get_brick_text_rect());
+  invalidate_dropdown(m_theme->get_dropdown_header_rect());
   repaint(get_current_brick());
   repaint_dropdown();
 
@@ -961,9 +1082,9 @@ void gui::on_options_changed()
   {
     // try to select current option
     brick.last_user_activated_option=none;
-    for(vector<option>::size_type idx=0; idx<brick.options.size(); ++idx)
+    for(size_t idx=0, num_options=brick.options->get_num_options(); idx<num_options; ++idx)
     {
-      if(*last_user_activated_option==brick.options[idx].data)
+      if(*last_user_activated_option==brick.options->get_option_data(idx))
       {
         brick.active_option_index=idx;
         brick.last_user_activated_option=*last_user_activated_option;
@@ -972,7 +1093,11 @@ void gui::on_options_changed()
     }
   }
 
-  // repaint brick and dropdown
+  // repaint active option and dropdown rows
+  invalidate(brick, m_theme->get_brick_icon_rect());
+  invalidate(brick, m_theme->get_brick_text_rect());
+  invalidate_dropdown(m_theme->get_dropdown_page_rect());
+  invalidate_dropdown(m_theme->get_dropdown_footer_rect());
   repaint(brick);
   repaint_dropdown();
 }
@@ -1028,6 +1153,7 @@ void gui::relayout()
   // get brick metrics
   const unsigned brick_width=m_theme->get_brick_width();
   const unsigned brick_height=m_theme->get_brick_height();
+  resize_back_buffers();
 
   // layout dimmer
   SetWindowPos(m_dimmer, HWND_TOPMOST, 0, 0, m_rc_monitor.right-m_rc_monitor.left, m_rc_monitor.bottom-m_rc_monitor.top, SWP_NOACTIVATE);
@@ -1045,39 +1171,117 @@ void gui::relayout()
 
   // layout dropdown
   SetWindowPos(m_dropdown, HWND_TOPMOST, x, y, 0, 0, SWP_NOSIZE|SWP_NOACTIVATE);
+  invalidate_dropdown();
   repaint_dropdown();
 }
 //----
 
+void gui::resize_back_buffers()
+{
+  // reallocate back buffers if the theme metrics don't match anymore
+  const unsigned brick_width=m_theme->get_brick_width(), brick_height=m_theme->get_brick_height();
+  for(ptr_deque<brick>::iterator iter=m_bricks.begin(); iter!=m_bricks.end(); ++iter)
+    if(iter->back_buffer->get_width()!=brick_width || iter->back_buffer->get_height()!=brick_height)
+    {
+      iter->back_buffer->resize(brick_width, brick_height);
+      invalidate(*iter);
+    }
+  if(m_dropdown_back_buffer->get_width()!=m_theme->get_dropdown_width() || m_dropdown_back_buffer->get_height()!=m_theme->get_dropdown_height())
+  {
+    m_dropdown_back_buffer->resize(m_theme->get_dropdown_width(), m_theme->get_dropdown_height());
+    invalidate_dropdown();
+  }
+}
+//----
+
+void gui::invalidate(brick &brick)
+{
+  invalidate(brick, pixel_rect(0, 0, m_theme->get_brick_width(), m_theme->get_brick_height()));
+}
+//----
+
+void gui::invalidate(brick &brick, const pixel_rect &rect)
+{
+  brick.damage.add(intersect(rect, pixel_rect(0, 0, m_theme->get_brick_width(), m_theme->get_brick_height())));
+}
+//----
+
+void gui::invalidate_dropdown()
+{
+  invalidate_dropdown(pixel_rect(0, 0, m_theme->get_dropdown_width(), m_theme->get_dropdown_height()));
+}
+//----
+
+void gui::invalidate_dropdown(const pixel_rect &rect)
+{
+  m_dropdown_damage.add(intersect(rect, pixel_rect(0, 0, m_theme->get_dropdown_width(), m_theme->get_dropdown_height())));
+}
+//----
+
+void gui::invalidate_selection(brick &brick, size_t old_index)
+{
+  // brick shows icon and title of the active option
+  invalidate(brick, m_theme->get_brick_icon_rect());
+  invalidate(brick, m_theme->get_brick_text_rect());
+
+  // dropdown: previously and newly active rows (or the page if it scrolls) and the position in the footer
+  if(m_theme->scroll_dropdown(brick))
+    invalidate_dropdown(m_theme->get_dropdown_page_rect());
+  else
+  {
+    invalidate_dropdown(m_theme->get_dropdown_row_rect(brick, unsigned(old_index)));
+    invalidate_dropdown(m_theme->get_dropdown_row_rect(brick, unsigned(brick.active_option_index)));
+  }
+  invalidate_dropdown(m_theme->get_dropdown_footer_rect());
+}
+//----
+
 void gui::repaint(brick &brick)
 {
-  // create GDI+ graphics context
-  dc dc(m_theme->get_brick_width(), m_theme->get_brick_height());
-  Gdiplus::Graphics graphics(dc.get_dc());
-  if(Gdiplus::Ok!=graphics.GetLastStatus())
-    throw runtime_error("Unable to initialize GDI+ Graphics object for repainting brick.");
+  // nothing to do?
+  if(brick.damage.is_empty())
+    return;
 
-  // theme brick
-  m_theme->paint_brick(graphics, brick, m_colibri);
+  // theme damaged parts of the brick
+  {
+    logger::scoped_latency latency(g_paint_brick_latency);
+    const vector<pixel_rect> &rects=brick.damage.get_rects();
+    for(vector<pixel_rect>::const_iterator iter=rects.begin(); iter!=rects.end(); ++iter)
+      m_theme->paint_brick(brick.back_buffer->get_graphics(), brick.back_buffer->get_surface(), brick, m_colibri, *iter);
+    brick.back_buffer->get_graphics().Flush(Gdiplus::FlushIntentionSync);
+  }
 
   // update layered window
-  dc.update(brick.handle);
+  const pixel_rect dirty=brick.damage.get_bounds();
+  brick.damage.clear();
+  logger::scoped_latency latency(g_update_window_latency);
+  brick.back_buffer->update(brick.handle, &dirty);
 }
 //----
 
 void gui::repaint_dropdown()
 {
-  // create GDI+ graphics context
-  dc dc(m_theme->get_dropdown_width(), m_theme->get_dropdown_height());
-  Gdiplus::Graphics graphics(dc.get_dc());
-  if(Gdiplus::Ok!=graphics.GetLastStatus())
-    throw runtime_error("Unable to initialize GDI+ Graphics object for repainting dropdown.");
+  // scroll to active option
+  brick &brick=get_current_brick();
+  if(m_theme->scroll_dropdown(brick))
+    invalidate_dropdown(m_theme->get_dropdown_page_rect());
+  if(m_dropdown_damage.is_empty())
+    return;
 
-  // theme brick
-  m_theme->paint_dropdown(graphics, get_current_brick());
+  // theme damaged parts of the dropdown
+  {
+    logger::scoped_latency latency(g_paint_dropdown_latency);
+    const vector<pixel_rect> &rects=m_dropdown_damage.get_rects();
+    for(vector<pixel_rect>::const_iterator iter=rects.begin(); iter!=rects.end(); ++iter)
+      m_theme->paint_dropdown(m_dropdown_back_buffer->get_graphics(), m_dropdown_back_buffer->get_surface(), brick, *iter);
+    m_dropdown_back_buffer->get_graphics().Flush(Gdiplus::FlushIntentionSync);
+  }
 
   // update layered window
-  dc.update(m_dropdown);
+  const pixel_rect dirty=m_dropdown_damage.get_bounds();
+  m_dropdown_damage.clear();
+  logger::scoped_latency latency(g_update_window_latency);
+  m_dropdown_back_buffer->update(m_dropdown, &dirty);
 }
 //----------------------------------------------------------------------------
 
@@ -1096,6 +1300,42 @@ gui::option::option(const wstring &title, const wstring &description, const ::ic
 //----------------------------------------------------------------------------
 
 
+//============================================================================
+// gui::option_source
+//============================================================================
+gui::option_source::~option_source()
+{
+}
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// gui::option_vector
+//============================================================================
+gui::option_vector::option_vector()
+{
+}
+//----------------------------------------------------------------------------
+
+size_t gui::option_vector::get_num_options() const
+{
+  return m_options.size();
+}
+//----
+
+gui::option gui::option_vector::get_option(size_t index)
+{
+  return m_options[index];
+}
+//----
+
+boost::uint64_t gui::option_vector::get_option_data(size_t index) const
+{
+  return m_options[index].data;
+}
+//----------------------------------------------------------------------------
+
+
 //============================================================================
 // theme
 //============================================================================
@@ -1134,6 +1374,8 @@ bool theme::load(const wstring &name, wstring &errors)
     return false;
   }
   set_theme_for_icons_hack(name);
+  m_text_cache.clear();
+  create_string_formats();
 
   // brick
   load_theme_image(name, L"brick.png", m_brick, errors);
@@ -1208,6 +1450,20 @@ bool theme::load(const wstring &name, wstring &errors)
   m_dropdown_rows_per_page=m_dropdown_page_height / m_dropdown_row_height;
   m_splash_screen_width=m_splash_screen->GetWidth();
   m_splash_screen_height=m_splash_screen->GetHeight();
+
+  // pack images into atlas
+  try
+  {
+    pack_images();
+  }
+  catch(std::exception &e)
+  {
+    const char *ascii=e.what();
+    while(*ascii)
+      errors+=wchar_t(*ascii++);
+    errors+=L"\n";
+    return false;
+  }
   return true;
 }
 //----
@@ -1271,36 +1527,86 @@ unsigned theme::get_splash_screen_height() const
 }
 //----------------------------------------------------------------------------
 
-void theme::paint_brick(Gdiplus::Graphics &graphics, gui::brick &brick, colibri_plugin &colibri)
+bool theme::scroll_dropdown(gui::brick &brick) const
+{
+  // scroll up/down to fully show current option
+  const unsigned old_y_scroll_amount=brick.y_scroll_amount;
+  const int relativeY=int(brick.active_option_index*m_dropdown_row_height-brick.y_scroll_amount);
+  const int maxY=m_dropdown_page_height-m_dropdown_row_height;
+  if(relativeY<0)
+    brick.y_scroll_amount+=relativeY;
+  else if(relativeY>maxY)
+    brick.y_scroll_amount+=relativeY-maxY;
+  return old_y_scroll_amount!=brick.y_scroll_amount;
+}
+//----
+
+pixel_rect theme::get_brick_icon_rect() const
+{
+  return pixel_rect(m_brick_icon_pos.X, m_brick_icon_pos.Y, 48, 48);
+}
+//----
+
+pixel_rect theme::get_brick_text_rect() const
+{
+  // title, hint and credits share the text area
+  return unite(unite(to_pixel_rect(m_brick_title_rect), to_pixel_rect(m_brick_hint_rect)), to_pixel_rect(m_credits_rect));
+}
+//----
+
+pixel_rect theme::get_dropdown_header_rect() const
+{
+  return pixel_rect(0, 0, m_dropdown_width, m_dropdown_header->GetHeight());
+}
+//----
+
+pixel_rect theme::get_dropdown_page_rect() const
+{
+  const unsigned y_header=m_dropdown_header->GetHeight();
+  return pixel_rect(0, int(y_header), m_dropdown_width, m_dropdown_height-m_dropdown_footer->GetHeight()-y_header);
+}
+//----
+
+pixel_rect theme::get_dropdown_row_rect(const gui::brick &brick, unsigned index) const
 {
-  // left format (title etc.)
-  Gdiplus::StringFormat leftFormat;
-  leftFormat.SetAlignment(Gdiplus::StringAlignmentNear);
-  leftFormat.SetLineAlignment(Gdiplus::StringAlignmentCenter);
-  leftFormat.SetHotkeyPrefix(Gdiplus::HotkeyPrefixShow);
-  leftFormat.SetTrimming(Gdiplus::StringTrimmingEllipsisCharacter);
+  const int y=int(m_dropdown_header->GetHeight()+index*m_dropdown_row_height)-int(brick.y_scroll_amount);
+  return intersect(pixel_rect(0, y, m_dropdown_width, m_dropdown_row_height), get_dropdown_page_rect());
+}
+//----
 
-  // center format (credits etc.)
-  Gdiplus::StringFormat centerFormat(&leftFormat);
-  centerFormat.SetAlignment(Gdiplus::StringAlignmentCenter);
+pixel_rect theme::get_dropdown_footer_rect() const
+{
+  const unsigned footer_height=m_dropdown_footer->GetHeight();
+  return pixel_rect(0, int(m_dropdown_height-footer_height), m_dropdown_width, footer_height);
+}
+//----------------------------------------------------------------------------
 
-  // start with background
-  graphics.DrawImage(m_brick, 0, 0, m_brick_width, m_brick_height);
+void theme::paint_brick(Gdiplus::Graphics &graphics, surface &pixels, gui::brick &brick, colibri_plugin &colibri, const pixel_rect &dirty)
+{
+  // formats (title etc. left aligned, credits etc. centered)
+  const Gdiplus::StringFormat &leftFormat=*m_brick_left_format;
+  const Gdiplus::StringFormat &centerFormat=*m_brick_center_format;
+
+  // start with background (images are blitted from the atlas, text is drawn
+  // by GDI+ on top of them), only touching the dirty part
+  const pixel_rect clip=intersect(dirty, pixels.get_rect());
+  pixels.clear(clip);
+  m_atlas.copy(pixels, 0, 0, m_brick_sprite, clip);
+  graphics.SetClip(to_gdiplus_rect(clip), Gdiplus::CombineModeReplace);
+  graphics.SetTextRenderingHint(Gdiplus::TextRenderingHintAntiAliasGridFit);
 
   // render content
   switch(brick.type)
   {
   case gui::brick_type_option:
-    if(brick.active_option_index<brick.options.size())
+    if(brick.active_option_index<brick.options->get_num_options())
     {
       // render icon with overlay
-      const gui::option &option=brick.options[brick.active_option_index];
-      graphics.DrawImage(load_icon(option.icon_info)->icon_48.get(), m_brick_icon_pos.X, m_brick_icon_pos.Y, 48, 48);
-      if(option.has_arrow_overlay)
-        graphics.DrawImage(m_arrow_overlay_48, m_brick_icon_pos.X, m_brick_icon_pos.Y, 48, 48);
+      const gui::option option=brick.options->get_option(brick.active_option_index);
+      paint_icon(graphics, pixels, *load_icon(option.icon_info), 48, m_brick_icon_pos.X, m_brick_icon_pos.Y, option.has_arrow_overlay, clip);
 
-      // render title
-      graphics.DrawString(option.title.c_str(), (INT)option.title.size(), m_brick_title_font.get(), m_brick_title_rect, &leftFormat, m_brick_title_brush.get());
+      // render title (cached, as it comes back when browsing the options)
+      m_text_cache.draw(pixels, option.title, *m_brick_title_font, *m_brick_title_brush, m_brick_title_rect, leftFormat, clip);
     }
     else if(!brick.input.size())
     {
@@ -1311,7 +1617,10 @@ void theme::paint_brick(Gdiplus::Graphics &graphics, gui::brick &brick, colibri_
 
   case gui::brick_type_text:
     // render icon
-    graphics.DrawImage(brick.custom_icon ? load_icon(*brick.custom_icon)->icon_48.get() : m_default_text_brick_icon, m_brick_icon_pos.X, m_brick_icon_pos.Y, 48, 48);
+    if(brick.custom_icon)
+      paint_icon(graphics, pixels, *load_icon(*brick.custom_icon), 48, m_brick_icon_pos.X, m_brick_icon_pos.Y, false, clip);
+    else
+      m_atlas.blend(pixels, m_brick_icon_pos.X, m_brick_icon_pos.Y, m_default_text_brick_icon_sprite, clip);
 
     // render text
     graphics.DrawString((brick.input+L'_').c_str(), -1, m_brick_title_font.get(), m_brick_title_rect, &leftFormat, m_brick_title_brush.get());
@@ -1319,7 +1628,7 @@ void theme::paint_brick(Gdiplus::Graphics &graphics, gui::brick &brick, colibri_
 
   case gui::brick_type_hotkey:
     // render icon
-    graphics.DrawImage(m_hotkey_brick_icon, m_brick_icon_pos.X, m_brick_icon_pos.Y, 48, 48);
+    m_atlas.blend(pixels, m_brick_icon_pos.X, m_brick_icon_pos.Y, m_hotkey_brick_icon_sprite, clip);
 
     // render text
     graphics.DrawString(str(colibri.get_hotkey()).c_str(), -1, m_brick_title_font.get(), m_brick_title_rect, &leftFormat, m_brick_title_brush.get());
@@ -1331,7 +1640,7 @@ void theme::paint_brick(Gdiplus::Graphics &graphics, gui::brick &brick, colibri_
     const DWORD dt=GetTickCount()-brick.credits_start_ticks;
 
     // render icon
-    graphics.DrawImage(m_credits_brick_icon, m_brick_icon_pos.X, m_brick_icon_pos.Y, 48, 48);
+    m_atlas.blend(pixels, m_brick_icon_pos.X, m_brick_icon_pos.Y, m_credits_brick_icon_sprite, clip);
 
     // render text
     if(dt<FRAME_MSECS)
@@ -1348,49 +1657,50 @@ void theme::paint_brick(Gdiplus::Graphics &graphics, gui::brick &brick, colibri_
       brick.credits_start_ticks=GetTickCount();
     break;
   }
+
+  // reset clipping
+  graphics.ResetClip();
 }
 //----
 
-void theme::paint_dropdown(Gdiplus::Graphics &graphics, gui::brick &brick)
+void theme::paint_dropdown(Gdiplus::Graphics &graphics, surface &pixels, gui::brick &brick, const pixel_rect &dirty)
 {
-  // scroll up/down to fully show current option
-  const int relativeY=int(brick.active_option_index*m_dropdown_row_height-brick.y_scroll_amount);
-  const int maxY=m_dropdown_page_height-m_dropdown_row_height;
-  if(relativeY<0)
-    brick.y_scroll_amount+=relativeY;
-  else if(relativeY>maxY)
-    brick.y_scroll_amount+=relativeY-maxY;
-
-  // left format (title etc.)
-  Gdiplus::StringFormat leftFormat;
-  leftFormat.SetAlignment(Gdiplus::StringAlignmentNear);
-  leftFormat.SetLineAlignment(Gdiplus::StringAlignmentNear);
-  leftFormat.SetHotkeyPrefix(Gdiplus::HotkeyPrefixShow);
-  leftFormat.SetTrimming(Gdiplus::StringTrimmingEllipsisPath);
-  leftFormat.SetFormatFlags(Gdiplus::StringFormatFlagsNoWrap);
+  // format (title etc.)
+  const Gdiplus::StringFormat &leftFormat=*m_dropdown_format;
+  graphics.SetTextRenderingHint(Gdiplus::TextRenderingHintAntiAliasGridFit);
 
-  // render header
-  graphics.DrawImage(m_dropdown_header, 0, 0, m_dropdown_header->GetWidth(), m_dropdown_header->GetHeight());
-  graphics.DrawString(brick.input.c_str(), -1, m_dropdown_header_text_font.get(), m_dropdown_header_text_rect, &leftFormat, m_dropdown_header_text_brush.get());
-
-  // clip dropdown area
-  const int width=m_dropdown_row->GetWidth(), height=m_dropdown_row->GetHeight();
+  // dropdown area, only the dirty part is touched
+  const int height=int(m_dropdown_row_height);
+  const int y_header=int(m_dropdown_header->GetHeight());
   const int y_footer=int(m_dropdown_height-m_dropdown_footer->GetHeight());
-  const Gdiplus::Rect clip_rect(0, m_dropdown_header->GetHeight(), width, y_footer-m_dropdown_header->GetHeight());
-  graphics.SetClip(clip_rect, Gdiplus::CombineModeReplace);
-
-  // render rows
-  int y=int(m_dropdown_header->GetHeight()-brick.y_scroll_amount);
-  for(vector<gui::option>::const_iterator iter=brick.options.begin(); y<y_footer && iter!=brick.options.end(); ++iter, y+=m_dropdown_row->GetHeight())
+  const int y_first=y_header-int(brick.y_scroll_amount);
+  const pixel_rect clip=intersect(dirty, pixels.get_rect()), page_clip=intersect(clip, get_dropdown_page_rect());
+  const bool is_header_dirty=!intersect(clip, get_dropdown_header_rect()).is_empty();
+  const bool is_footer_dirty=!intersect(clip, get_dropdown_footer_rect()).is_empty();
+  pixels.clear(clip);
+
+  // blit header, rows and footer from the atlas first, starting with the
+  // first visible row (only options of dirty rows are fetched from the source)
+  if(is_header_dirty)
+    m_atlas.copy(pixels, 0, 0, m_dropdown_header_sprite, clip);
+  graphics.SetClip(to_gdiplus_rect(page_clip), Gdiplus::CombineModeReplace);
+  const size_t num_options=brick.options->get_num_options();
+  vector<gui::option> dirty_options;
+  vector<int> dirty_option_ys;
+  size_t index=brick.y_scroll_amount/m_dropdown_row_height;
+  int y=y_first+int(index)*height;
+  for(; y<y_footer && index<num_options; ++index, y+=height)
   {
-    // skip completely invisible rows
-    if(y+m_dropdown_row->GetHeight()<=m_dropdown_header->GetHeight())
+    // skip clean rows
+    if(page_clip.is_empty() || y+height<=page_clip.y || y>=page_clip.y+int(page_clip.height))
       continue;
+    dirty_options.push_back(brick.options->get_option(index));
+    dirty_option_ys.push_back(y);
+    const gui::option &option=dirty_options.back();
 
     // render background
-    const bool isActive=brick.options.begin()+brick.active_option_index==iter;
-    const Gdiplus::Rect dest(0, y, width, height);
-    graphics.DrawImage(isActive ? m_dropdown_row_active : m_dropdown_row, dest, 0, 0, width, height, Gdiplus::UnitPixel);
+    const bool isActive=brick.active_option_index==index;
+    m_atlas.copy(pixels, 0, y, isActive ? m_dropdown_row_active_sprite : m_dropdown_row_sprite, page_clip);
 
 #if 0
     // render selection checkbox
@@ -1399,40 +1709,48 @@ void theme::paint_dropdown(Gdiplus::Graphics &graphics, gui::brick &brick)
 #endif
 
     // render icon with overlay
-    graphics.DrawImage(load_icon(iter->icon_info)->icon_32.get(), m_dropdown_row_icon_pos.X, m_dropdown_row_icon_pos.Y+y, 32, 32);
-    if(iter->has_arrow_overlay)
-      graphics.DrawImage(m_arrow_overlay_32, m_dropdown_row_icon_pos.X, m_dropdown_row_icon_pos.Y+y, 32, 32);
+    paint_icon(graphics, pixels, *load_icon(option.icon_info), 32, m_dropdown_row_icon_pos.X, m_dropdown_row_icon_pos.Y+y, option.has_arrow_overlay, page_clip);
+  }
 
-    // render title and description
+  // fill remaining dropdown when there aren't enough items
+  for(; y<y_footer; y+=height)
+    m_atlas.copy(pixels, 0, y, m_dropdown_row_sprite, page_clip);
+  if(is_footer_dirty)
+    m_atlas.copy(pixels, 0, y_footer, m_dropdown_footer_sprite, clip);
+
+  // render header text
+  graphics.SetClip(to_gdiplus_rect(clip), Gdiplus::CombineModeReplace);
+  if(is_header_dirty)
+    graphics.DrawString(brick.input.c_str(), -1, m_dropdown_header_text_font.get(), m_dropdown_header_text_rect, &leftFormat, m_dropdown_header_text_brush.get());
+
+  // render titles and descriptions (cached, only their position changes
+  // when scrolling)
+  for(size_t i=0; i<dirty_options.size(); ++i)
+  {
     Gdiplus::RectF rc=m_dropdown_row_title_rect;
-    rc.Y+=y;
-    graphics.DrawString(iter->title.c_str(), -1, m_dropdown_row_title_font.get(), rc, &leftFormat, m_dropdown_row_title_brush.get());
+    rc.Y+=dirty_option_ys[i];
+    m_text_cache.draw(pixels, dirty_options[i].title, *m_dropdown_row_title_font, *m_dropdown_row_title_brush, rc, leftFormat, page_clip);
     rc=m_dropdown_row_description_rect;
-    rc.Y+=y;
-    graphics.DrawString(iter->description.c_str(), -1, m_dropdown_row_description_font.get(), rc, &leftFormat, m_dropdown_row_description_brush.get());
+    rc.Y+=dirty_option_ys[i];
+    m_text_cache.draw(pixels, dirty_options[i].description, *m_dropdown_row_description_font, *m_dropdown_row_description_brush, rc, leftFormat, page_clip);
   }
 
-  // fill remaining dropdown when there aren't enough items
-  for(; y<y_footer; y+=m_dropdown_row_height)
+  // render footer text
+  graphics.SetClip(to_gdiplus_rect(clip), Gdiplus::CombineModeReplace);
+  if(is_footer_dirty)
   {
-    // render background
-    const Gdiplus::Rect dest(0, y, width, height);
-    graphics.DrawImage(m_dropdown_row, dest, 0, 0, width, height, Gdiplus::UnitPixel);
+    wostringstream stats;
+    if(brick.active_option_index<num_options)
+      stats<<unsigned(brick.active_option_index+1)<<L" of "<<unsigned(num_options);
+    else
+      stats<<unsigned(num_options)<<L" Items";
+    Gdiplus::RectF rc=m_dropdown_footer_text_rect;
+    rc.Y+=y_footer;
+    graphics.DrawString(stats.str().c_str(), -1, m_dropdown_footer_text_font.get(), rc, &leftFormat, m_dropdown_footer_text_brush.get());
   }
 
   // reset clipping
   graphics.ResetClip();
-
-  // render footer
-  graphics.DrawImage(m_dropdown_footer, 0, y_footer, m_dropdown_footer->GetWidth(), m_dropdown_footer->GetHeight());
-  wostringstream stats;
-  if(brick.active_option_index<brick.options.size())
-    stats<<unsigned(brick.active_option_index+1)<<L" of "<<unsigned(brick.options.size());
-  else
-    stats<<unsigned(brick.options.size())<<L" Items";
-  Gdiplus::RectF rc=m_dropdown_footer_text_rect;
-  rc.Y+=y_footer;
-  graphics.DrawString(stats.str().c_str(), -1, m_dropdown_footer_text_font.get(), rc, &leftFormat, m_dropdown_footer_text_brush.get());
 }
 //----
 
@@ -1445,7 +1763,80 @@ void theme::paint_splash_screen(Gdiplus::Graphics &graphics, ufloat1 progress, c
 
 std::shared_ptr<icon> theme::load_icon(const icon_info &ii)
 { 
-  return ::load_icon(ii, L"fallback");
+  return ::load_icon_async(ii, L"fallback");
+}
+//----
+
+void theme::prefetch_icons(const std::vector<icon_info> &icons)
+{
+  ::prefetch_icons(icons, L"fallback");
+}
+//----------------------------------------------------------------------------
+
+void theme::create_string_formats()
+{
+  // brick (title etc.)
+  m_brick_left_format.reset(new Gdiplus::StringFormat);
+  m_brick_left_format->SetAlignment(Gdiplus::StringAlignmentNear);
+  m_brick_left_format->SetLineAlignment(Gdiplus::StringAlignmentCenter);
+  m_brick_left_format->SetHotkeyPrefix(Gdiplus::HotkeyPrefixShow);
+  m_brick_left_format->SetTrimming(Gdiplus::StringTrimmingEllipsisCharacter);
+
+  // brick (credits etc.)
+  m_brick_center_format.reset(new Gdiplus::StringFormat(m_brick_left_format.get()));
+  m_brick_center_format->SetAlignment(Gdiplus::StringAlignmentCenter);
+
+  // dropdown (title etc.)
+  m_dropdown_format.reset(new Gdiplus::StringFormat);
+  m_dropdown_format->SetAlignment(Gdiplus::StringAlignmentNear);
+  m_dropdown_format->SetLineAlignment(Gdiplus::StringAlignmentNear);
+  m_dropdown_format->SetHotkeyPrefix(Gdiplus::HotkeyPrefixShow);
+  m_dropdown_format->SetTrimming(Gdiplus::StringTrimmingEllipsisPath);
+  m_dropdown_format->SetFormatFlags(Gdiplus::StringFormatFlagsNoWrap);
+}
+//----
+
+void theme::pack_images()
+{
+  // pack images at the size they are painted with
+  m_atlas.clear();
+  pack_image(m_brick, m_brick_width, m_brick_height, m_brick_sprite);
+  pack_image(m_default_text_brick_icon, 48, 48, m_default_text_brick_icon_sprite);
+  pack_image(m_hotkey_brick_icon, 48, 48, m_hotkey_brick_icon_sprite);
+  pack_image(m_credits_brick_icon, 48, 48, m_credits_brick_icon_sprite);
+  pack_image(m_arrow_overlay_32, 32, 32, m_arrow_overlay_32_sprite);
+  pack_image(m_arrow_overlay_48, 48, 48, m_arrow_overlay_48_sprite);
+  pack_image(m_dropdown_header, m_dropdown_header->GetWidth(), m_dropdown_header->GetHeight(), m_dropdown_header_sprite);
+  pack_image(m_dropdown_row, m_dropdown_width, m_dropdown_row_height, m_dropdown_row_sprite);
+  pack_image(m_dropdown_row_active, m_dropdown_width, m_dropdown_row_height, m_dropdown_row_active_sprite);
+  pack_image(m_dropdown_footer, m_dropdown_footer->GetWidth(), m_dropdown_footer->GetHeight(), m_dropdown_footer_sprite);
+}
+//----
+
+void theme::pack_image(Gdiplus::Image *img, unsigned width, unsigned height, sprite &s)
+{
+  surface pixels(width, height);
+  image_to_surface(*img, pixels);
+  s=m_atlas.add(pixels);
+}
+//----
+
+void theme::paint_icon(Gdiplus::Graphics &graphics, surface &pixels, const icon &icon, unsigned size, int x, int y, bool has_arrow_overlay, const pixel_rect &clip)
+{
+  // blit icon and overlay from the atlases
+  if(blend_icon(pixels, x, y, icon, size, clip))
+  {
+    if(has_arrow_overlay)
+      m_atlas.blend(pixels, x, y, 48==size ? m_arrow_overlay_48_sprite : m_arrow_overlay_32_sprite, clip);
+    return;
+  }
+
+  // fall back to GDI+ for icons which couldn't be packed
+  draw_icon(graphics, x, y, icon, size);
+  if(has_arrow_overlay)
+    graphics.DrawImage(48==size ? m_arrow_overlay_48 : m_arrow_overlay_32, x, y, size, size);
+  graphics.Flush(Gdiplus::FlushIntentionSync);
+  GdiFlush();
 }
 //----------------------------------------------------------------------------
 
@@ -1453,7 +1844,7 @@ void theme::load_theme_image(const std::wstring &theme, const wchar_t *filename,
 {
   try
   {
-    img=load_image(install_folder() / L"themes" / theme / filename).get();
+    img=load_image(install_folder() / L"themes" / theme / filename, true).get();
   }
   catch(std::exception &e)
   {
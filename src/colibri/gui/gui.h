@@ -8,6 +8,7 @@
 #define COLIBRI_GUI_GUI_H
 #include "splash_screen.h"
 #include "../libraries/core/dynlib.h"
+#include "../libraries/win32/text_cache.h"
 #include <memory>
 #include <vector>
 #include <boost/optional.hpp>
@@ -33,6 +34,8 @@ class gui
 public:
   // nested types
   struct option;
+  class option_source;
+  class option_vector;
   //--------------------------------------------------------------------------
 
   // construction and destruction
@@ -62,9 +65,13 @@ public:
   // option brick accessors
   const wchar_t *get_current_term() const;
   boost::optional<boost::uint64_t> get_current_option_data() const;
+  boost::optional<size_t> get_current_option_index() const;
   template<typename Iter> void set_options(Iter begin, Iter end);
+  void set_options(std::shared_ptr<option_source>);
   void set_current_option(unsigned index);
   void add_term_char(wchar_t);
+  unsigned get_dropdown_rows_per_page() const;
+  void prefetch_icons(const std::vector<icon_info>&);
   //--------------------------------------------------------------------------
 
   // text brick accessors
@@ -89,13 +96,18 @@ private:
   void push_brick(e_brick_type, controller&, boost::optional<icon_info> custom_icon=boost::none);
   const brick &get_current_brick() const;
   brick &get_current_brick();
-  std::vector<option> &get_options();
   bool try_add_char(wchar_t);
   void on_input_changed();
   void on_options_changed();
   void update_tray_icon(bool add_=false);
   void update_hotkey();
   void relayout();
+  void resize_back_buffers();
+  void invalidate(brick&);
+  void invalidate(brick&, const pixel_rect&);
+  void invalidate_dropdown();
+  void invalidate_dropdown(const pixel_rect&);
+  void invalidate_selection(brick&, size_t old_index);
   void repaint(brick&);
   void repaint_dropdown();
   //--------------------------------------------------------------------------
@@ -121,6 +133,8 @@ private:
 
   // dropdown
   HWND m_dropdown;
+  std::auto_ptr<dc> m_dropdown_back_buffer;
+  damage_region m_dropdown_damage;
 
   // dimmer
   HWND m_dimmer;
@@ -145,6 +159,51 @@ struct gui::option
 //----------------------------------------------------------------------------
 
 
+//============================================================================
+// gui::option_source
+//
+// Options of an option brick. The gui reads them by index, so that only the
+// visible options have to be constructed; get_option_data() is used to
+// track the selection and should be cheap.
+//============================================================================
+class gui::option_source
+{
+public:
+  // destruction
+  virtual ~option_source();
+  //--------------------------------------------------------------------------
+
+  // accessors
+  virtual size_t get_num_options() const=0;
+  virtual option get_option(size_t index)=0;
+  virtual boost::uint64_t get_option_data(size_t index) const=0;
+};
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// gui::option_vector
+//============================================================================
+class gui::option_vector: public gui::option_source
+{
+public:
+  // construction
+  option_vector();
+  template<typename Iter> option_vector(Iter begin, Iter end);
+  //--------------------------------------------------------------------------
+
+  // accessors
+  virtual size_t get_num_options() const;
+  virtual option get_option(size_t index);
+  virtual boost::uint64_t get_option_data(size_t index) const;
+  //--------------------------------------------------------------------------
+
+private:
+  std::vector<option> m_options;
+};
+//----------------------------------------------------------------------------
+
+
 //============================================================================
 // theme
 //============================================================================
@@ -170,17 +229,32 @@ public:
   unsigned get_splash_screen_height() const;
   //--------------------------------------------------------------------------
 
+  // damage
+  bool scroll_dropdown(gui::brick&) const;
+  pixel_rect get_brick_icon_rect() const;
+  pixel_rect get_brick_text_rect() const;
+  pixel_rect get_dropdown_header_rect() const;
+  pixel_rect get_dropdown_page_rect() const;
+  pixel_rect get_dropdown_row_rect(const gui::brick&, unsigned index) const;
+  pixel_rect get_dropdown_footer_rect() const;
+  //--------------------------------------------------------------------------
+
   // painting
-  void paint_brick(Gdiplus::Graphics&, gui::brick&, colibri_plugin&);
-  void paint_dropdown(Gdiplus::Graphics&, gui::brick&);
+  void paint_brick(Gdiplus::Graphics&, surface&, gui::brick&, colibri_plugin&, const pixel_rect &dirty);
+  void paint_dropdown(Gdiplus::Graphics&, surface&, gui::brick&, const pixel_rect &dirty);
   void paint_splash_screen(Gdiplus::Graphics&, ufloat1 progress, const wchar_t *text);
   //--------------------------------------------------------------------------
 
   // loading
   std::shared_ptr<icon> load_icon(const icon_info&);
+  void prefetch_icons(const std::vector<icon_info>&);
   //--------------------------------------------------------------------------
 
 private:
+  void create_string_formats();
+  void pack_images();
+  void pack_image(Gdiplus::Image*, unsigned width, unsigned height, sprite&);
+  void paint_icon(Gdiplus::Graphics&, surface&, const icon&, unsigned size, int x, int y, bool has_arrow_overlay, const pixel_rect &clip);
   static void load_theme_image(const std::wstring &ini, const wchar_t *filename_, Gdiplus::Image*&, std::wstring &errors);
   void load_theme_font(const std::wstring &ini, const wchar_t *section, const wchar_t *key, std::auto_ptr<Gdiplus::Font>&, std::wstring &errors);
   static void load_theme_brush(const std::wstring &ini, const wchar_t *section, const wchar_t *key, std::auto_ptr<Gdiplus::SolidBrush>&, std::wstring &errors);
@@ -194,6 +268,9 @@ private:
   // default font
   std::wstring m_default_font;
 
+  // string formats
+  std::auto_ptr<Gdiplus::StringFormat> m_brick_left_format, m_brick_center_format, m_dropdown_format;
+
   // brick
   Gdiplus::Image *m_brick;
 
@@ -251,6 +328,18 @@ private:
   // splash screen
   Gdiplus::Image *m_splash_screen;
 
+  // atlas of the images above (except for the splash screen, which is only
+  // painted during startup)
+  atlas m_atlas;
+  sprite m_brick_sprite;
+  sprite m_default_text_brick_icon_sprite, m_hotkey_brick_icon_sprite, m_credits_brick_icon_sprite;
+  sprite m_arrow_overlay_32_sprite, m_arrow_overlay_48_sprite;
+  sprite m_dropdown_header_sprite, m_dropdown_row_sprite, m_dropdown_row_active_sprite, m_dropdown_footer_sprite;
+
+  // rendered option titles and descriptions (refers to the fonts, brushes
+  // and string formats above, so it's cleared when loading a theme)
+  text_cache m_text_cache;
+
   // dependant values
   unsigned m_brick_width;
   unsigned m_brick_height;
@@ -11,7 +11,17 @@
 template<typename Iter>
 void gui::set_options(Iter begin, Iter end)
 {
-  get_options().assign(begin, end);
-  on_options_changed();
+  set_options(std::shared_ptr<option_source>(new option_vector(begin, end)));
+}
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// gui::option_vector
+//============================================================================
+template<typename Iter>
+gui::option_vector::option_vector(Iter begin, Iter end)
+  :m_options(begin, end)
+{
 }
 //----------------------------------------------------------------------------
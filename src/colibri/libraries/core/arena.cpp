@@ -0,0 +1,97 @@
+//============================================================================
+// arena.cpp: Monotonic allocator
+//
+// (c) Michael Walter, 2006
+//============================================================================
+
+#include "arena.h"
+#include <cstdlib>
+#include <cstring>
+#include <new>
+using namespace std;
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// arena
+//============================================================================
+arena::arena(size_t block_size)
+  :m_block_size(block_size)
+  ,m_last_block(0)
+  ,m_pos(0)
+  ,m_end(0)
+  ,m_num_allocations(0)
+  ,m_num_blocks(0)
+  ,m_num_bytes(0)
+{
+}
+//----
+
+arena::~arena()
+{
+  release();
+}
+//----
+
+void arena::release()
+{
+  // free all blocks at once
+  while(block *b=m_last_block)
+  {
+    m_last_block=b->prev;
+    free(b);
+  }
+  m_pos=m_end=0;
+  m_num_allocations=0;
+  m_num_blocks=0;
+  m_num_bytes=0;
+}
+//----------------------------------------------------------------------------
+
+const wchar_t *arena::copy(const wchar_t *str, size_t length)
+{
+  wchar_t *dst=static_cast<wchar_t*>(allocate((length+1)*sizeof(wchar_t), sizeof(wchar_t)));
+  memcpy(dst, str, length*sizeof(wchar_t));
+  dst[length]=0;
+  return dst;
+}
+//----------------------------------------------------------------------------
+
+unsigned long arena::get_num_allocations() const
+{
+  return m_num_allocations;
+}
+//----
+
+unsigned long arena::get_num_blocks() const
+{
+  return m_num_blocks;
+}
+//----
+
+unsigned long arena::get_num_bytes() const
+{
+  return m_num_bytes;
+}
+//----------------------------------------------------------------------------
+
+void *arena::allocate_block(size_t size, size_t alignment)
+{
+  // allocate block large enough for the request (oversized requests get a
+  // block of their own)
+  const size_t block_size=sizeof(block)+alignment+(size>m_block_size ? size : m_block_size);
+  block *b=static_cast<block*>(malloc(block_size));
+  if(!b)
+    throw bad_alloc();
+  b->prev=m_last_block;
+  m_last_block=b;
+  ++m_num_blocks;
+
+  // carve request from the new block
+  char *pos=reinterpret_cast<char*>(b+1);
+  pos+=(alignment-size_t(pos)%alignment)%alignment;
+  m_pos=pos+size;
+  m_end=reinterpret_cast<char*>(b)+block_size;
+  return pos;
+}
+//----------------------------------------------------------------------------
@@ -0,0 +1,66 @@
+//============================================================================
+// arena.h: Monotonic allocator
+//
+// (c) Michael Walter, 2006
+//============================================================================
+
+#ifndef UTILS_CORE_ARENA_H
+#define UTILS_CORE_ARENA_H
+#include <cstddef>
+//----------------------------------------------------------------------------
+
+// Interface:
+class arena;
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// arena
+//
+// Hands out memory from large blocks by bumping a pointer and frees all of it
+// at once when the arena is released or destroyed. Nothing allocated in the
+// arena is destructed, so it may only hold PODs and strings copied with
+// copy(), which live as long as the arena.
+//============================================================================
+class arena
+{
+public:
+  // construction and destruction
+  arena(size_t block_size=64*1024);
+  ~arena();
+  void release();
+  //--------------------------------------------------------------------------
+
+  // allocation
+  inline void *allocate(size_t size, size_t alignment=sizeof(void*));
+  template<typename T> inline T *allocate_array(size_t count);
+  const wchar_t *copy(const wchar_t *str, size_t length);
+  //--------------------------------------------------------------------------
+
+  // statistics (since construction or the last release)
+  unsigned long get_num_allocations() const;
+  unsigned long get_num_blocks() const;
+  unsigned long get_num_bytes() const;
+  //--------------------------------------------------------------------------
+
+private:
+  arena(const arena&); // not implemented
+  void operator=(const arena&); // not implemented
+  struct block
+  {
+    block *prev;
+  };
+  void *allocate_block(size_t size, size_t alignment);
+  //--------------------------------------------------------------------------
+
+  const size_t m_block_size;
+  block *m_last_block;
+  char *m_pos, *m_end;
+  unsigned long m_num_allocations;
+  unsigned long m_num_blocks;
+  unsigned long m_num_bytes;
+};
+//----------------------------------------------------------------------------
+
+#include "arena.inl"
+#endif
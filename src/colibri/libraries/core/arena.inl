@@ -0,0 +1,29 @@
+//============================================================================
+// arena.inl: Monotonic allocator
+//
+// (c) Michael Walter, 2006
+//============================================================================
+
+
+//============================================================================
+// arena
+//============================================================================
+void *arena::allocate(size_t size, size_t alignment)
+{
+  // bump pointer, start a new block if the current one is exhausted
+  ++m_num_allocations;
+  m_num_bytes+=(unsigned long)size;
+  char *pos=m_pos+(alignment-size_t(m_pos)%alignment)%alignment;
+  if(!m_pos || pos>m_end || size_t(m_end-pos)<size)
+    return allocate_block(size, alignment);
+  m_pos=pos+size;
+  return pos;
+}
+//----
+
+template<typename T>
+T *arena::allocate_array(size_t count)
+{
+  return static_cast<T*>(allocate(count*sizeof(T), __alignof(T)));
+}
+//----------------------------------------------------------------------------
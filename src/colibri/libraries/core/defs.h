@@ -6,9 +6,11 @@
 
 #ifndef UTILS_CORE_DEFS_H
 #define UTILS_CORE_DEFS_H
+#ifdef _MSC_VER
 #define log __old_log
 #include <cmath>
 #undef log
+#endif
 #include <string>
 #include <vector>
 #include <boost/cstdint.hpp>
@@ -18,7 +20,11 @@
 typedef std::vector<boost::uint8_t> buffer;
 void init_utils();
 void shutdown_utils();
+#ifdef _MSC_VER
 __declspec(noreturn) void throw_errorf(const char*, ...);
+#else
+void throw_errorf(const char*, ...) __attribute__((noreturn));
+#endif
 //----------------------------------------------------------------------------
 
 #endif
@@ -7,16 +7,134 @@
 #include "sqlite.h"
 #include "../../thirdparty/sqlite/sqlite3.h"
 #include "../log/log.h"
+#include "../log/metrics.h"
+#include <sstream>
+#include <map>
+#include <algorithm>
+#include <cctype>
+#include <boost/thread/mutex.hpp>
 using namespace std;
 using namespace boost;
 //----------------------------------------------------------------------------
 
 
+//============================================================================
+// query profiling
+//============================================================================
+namespace
+{
+  struct profile_registry
+  {
+    boost::mutex mutex;
+    std::map<std::string, sqlite_query_profile> profiles;
+  };
+  //----
+
+  profile_registry &get_profile_registry()
+  {
+    static profile_registry s_registry;
+    return s_registry;
+  }
+  //----
+
+  bool g_is_profiling=false;
+  //--------------------------------------------------------------------------
+
+  std::string normalized_sql(const char *sql)
+  {
+    // collapse whitespace and replace literals by '?', so that statements only
+    // differing in their constants are aggregated
+    std::string result;
+    const char *c=sql;
+    while(*c)
+    {
+      if(isspace((unsigned char)*c))
+      {
+        while(isspace((unsigned char)*c))
+          ++c;
+        if(*c && !result.empty())
+          result+=' ';
+      }
+      else if('\''==*c)
+      {
+        for(++c; *c && ('\''!=*c || '\''==c[1]); ++c)
+          if('\''==*c)
+            ++c;
+        if(*c)
+          ++c;
+        result+='?';
+      }
+      else if(isdigit((unsigned char)*c) && (result.empty() || (!isalnum((unsigned char)result[result.size()-1]) && '_'!=result[result.size()-1])))
+      {
+        while(isalnum((unsigned char)*c) || '.'==*c)
+          ++c;
+        result+='?';
+      }
+      else
+        result+=*c++;
+    }
+    return result;
+  }
+  //----
+
+  bool has_greater_total_time(const sqlite_query_profile &a, const sqlite_query_profile &b)
+  {
+    return a.total_time>b.total_time;
+  }
+}
+//----------------------------------------------------------------------------
+
+void enable_sqlite_profiling(bool enable)
+{
+  g_is_profiling=enable;
+}
+//----
+
+bool is_sqlite_profiling_enabled()
+{
+  return g_is_profiling;
+}
+//----
+
+std::vector<sqlite_query_profile> get_sqlite_query_profiles()
+{
+  // get profiles, most expensive first
+  profile_registry &reg=get_profile_registry();
+  std::vector<sqlite_query_profile> profiles;
+  {
+    boost::mutex::scoped_lock lock(reg.mutex);
+    for(std::map<std::string, sqlite_query_profile>::const_iterator iter=reg.profiles.begin(); iter!=reg.profiles.end(); ++iter)
+      profiles.push_back(iter->second);
+  }
+  std::sort(profiles.begin(), profiles.end(), has_greater_total_time);
+  return profiles;
+}
+//----
+
+void log_sqlite_query_profiles()
+{
+  const std::vector<sqlite_query_profile> profiles=get_sqlite_query_profiles();
+  logger::infof("Query statistics (%u statements, profiling %s)", unsigned(profiles.size()), g_is_profiling ? "enabled" : "disabled");
+  for(std::vector<sqlite_query_profile>::const_iterator iter=profiles.begin(); iter!=profiles.end(); ++iter)
+    logger::infof("Query %s: %lu executions, %lu rows, total %.2f ms, max %.2f ms", iter->sql.c_str(), iter->num_executions, iter->num_rows, iter->total_time/1000.0, iter->max_time/1000.0);
+}
+//----
+
+void reset_sqlite_query_profiles()
+{
+  profile_registry &reg=get_profile_registry();
+  boost::mutex::scoped_lock lock(reg.mutex);
+  reg.profiles.clear();
+}
+//----------------------------------------------------------------------------
+
+
 //============================================================================
 // sqlite_connection
 //============================================================================
 sqlite_connection::sqlite_connection(const wstring &filename)
   :m_current_version(0)
+  ,m_transaction(0)
 {
   // open sqlite database
   int result=sqlite3_open16(filename.c_str(), &m_sqlite);
@@ -25,8 +143,16 @@ sqlite_connection::sqlite_connection(const wstring &filename)
   if(SQLITE_OK!=result)
   {
     sqlite3_close(m_sqlite);
-    throw_errorf("Unable to open SQLite database: %S", filename);
+    throw_errorf("Unable to open SQLite database: %S", filename.c_str());
   }
+
+  // text is bound, read and passed to custom functions as UTF-16le, so create
+  // new databases with that encoding to spare SQLite converting it on every
+  // access (existing databases keep their encoding)
+  prepare(L"PRAGMA encoding = \"UTF-16le\"")->exec();
+  const wstring encoding=get_encoding();
+  if(L"UTF-16le"!=encoding)
+    logger::warnf("SQLite database %S is encoded as %S, text is converted on every access", filename.c_str(), encoding.c_str());
 }
 //----------------------------------------------------------------------------
 
@@ -45,6 +171,12 @@ unsigned sqlite_connection::get_num_affected_rows() const
 {
   return sqlite3_changes(m_sqlite);
 }
+//----
+
+wstring sqlite_connection::get_encoding()
+{
+  return prepare(L"PRAGMA encoding")->exec().get_string();
+}
 //----------------------------------------------------------------------------
 
 void sqlite_connection::reg_function(const wchar_t *name, unsigned num_args, void (*function)(sqlite3_context*,int,sqlite3_value**))
@@ -54,17 +186,22 @@ void sqlite_connection::reg_function(const wchar_t *name, unsigned num_args, voi
 }
 //----------------------------------------------------------------------------
 
+sqlite_transaction *sqlite_connection::get_transaction() const
+{
+  return m_transaction;
+}
+//----------------------------------------------------------------------------
+
 unsigned sqlite_connection::begin_schema_update()
 {
   // create meta information, if necessary
+  if(!m_transaction)
+    throw logic_error("Schema updates have to be performed within a transaction.");
   prepare(L"CREATE TABLE IF NOT EXISTS meta (key TEXT PRIMARY KEY, value TEXT)")->exec();
   prepare(L"INSERT OR IGNORE INTO meta (key, value) VALUES ('version', 0)")->exec();
 
   // query current version
   unsigned current_version=prepare(L"SELECT value FROM meta WHERE key='version'")->exec().get_unsigned(0);
-
-  // start transaction
-  prepare(L"BEGIN TRANSACTION")->exec();
   m_current_version=current_version;
   return current_version;
 }
@@ -74,7 +211,6 @@ void sqlite_connection::end_schema_update(const wchar_t *name, unsigned new_vers
 {
   // set new version
   prepare(L"UPDATE meta SET value=? WHERE key='version'")->bind(0, new_version).exec();
-  prepare(L"COMMIT TRANSACTION")->exec();
   if(!m_current_version)
     logger::infof("[%S] Created version %u database schema", name, new_version);
   else if(m_current_version!=new_version)
@@ -84,6 +220,106 @@ void sqlite_connection::end_schema_update(const wchar_t *name, unsigned new_vers
 //----------------------------------------------------------------------------
 
 
+//============================================================================
+// sqlite_transaction
+//============================================================================
+namespace
+{
+  wstring savepoint_name(unsigned depth)
+  {
+    // outermost transaction doesn't need a savepoint
+    if(!depth)
+      return wstring();
+    wostringstream name;
+    name<<L"colibri_savepoint_"<<depth;
+    return name.str();
+  }
+}
+//----------------------------------------------------------------------------
+
+sqlite_transaction::sqlite_transaction(sqlite_connection &connection, e_mode mode)
+  :m_connection(connection)
+  ,m_outer(connection.m_transaction)
+  ,m_depth(m_outer ? m_outer->m_depth+1 : 0)
+  ,m_mode(mode)
+  ,m_savepoint(savepoint_name(m_depth))
+  ,m_active(false)
+{
+  begin();
+  m_connection.m_transaction=this;
+}
+//----
+
+sqlite_transaction::~sqlite_transaction()
+{
+  // roll back unless committed (errors are only logged, as this may be called
+  // while unwinding an exception)
+  try
+  {
+    if(m_active)
+      rollback();
+  }
+  catch(std::exception &e)
+  {
+    logger::errorf("Unable to roll back SQLite transaction: %s", e.what());
+  }
+  m_connection.m_transaction=m_outer;
+}
+//----------------------------------------------------------------------------
+
+void sqlite_transaction::commit()
+{
+  end(L"COMMIT TRANSACTION", L"RELEASE ");
+}
+//----
+
+void sqlite_transaction::checkpoint()
+{
+  // commit changes so far and start over (savepoints are only durable once
+  // the outermost transaction commits)
+  commit();
+  begin();
+}
+//----
+
+void sqlite_transaction::rollback()
+{
+  // SQLite rolls back by itself on some errors (e.g. when the disk is full)
+  if(m_active && m_savepoint.empty() && sqlite3_get_autocommit(m_connection.m_sqlite))
+  {
+    m_active=false;
+    return;
+  }
+
+  // savepoints have to be released after rolling back to them
+  end(L"ROLLBACK TRANSACTION", L"ROLLBACK TO ");
+  if(!m_savepoint.empty())
+    m_connection.prepare(L"RELEASE "+m_savepoint)->exec();
+}
+//----------------------------------------------------------------------------
+
+void sqlite_transaction::begin()
+{
+  if(!m_savepoint.empty())
+    m_connection.prepare(L"SAVEPOINT "+m_savepoint)->exec();
+  else
+    m_connection.prepare(mode_immediate==m_mode ? L"BEGIN IMMEDIATE TRANSACTION" : L"BEGIN TRANSACTION")->exec();
+  m_active=true;
+}
+//----
+
+void sqlite_transaction::end(const wchar_t *outermost_sql, const wchar_t *savepoint_sql)
+{
+  if(!m_active)
+    throw logic_error("SQLite transaction has already been completed.");
+  if(m_connection.m_transaction!=this)
+    throw logic_error("SQLite transaction has to be completed after its nested transactions.");
+  m_active=false;
+  m_connection.prepare(m_savepoint.empty() ? wstring(outermost_sql) : savepoint_sql+m_savepoint)->exec();
+}
+//----------------------------------------------------------------------------
+
+
 //============================================================================
 // sqlite_statement
 //============================================================================
@@ -93,12 +329,16 @@ sqlite_statement::sqlite_statement(sqlite3 *sqlite, sqlite3_stmt *stmt, const ws
   ,m_sql(sql)
   ,m_executed(false)
   ,m_more(false)
+  ,m_profile_time(0)
+  ,m_profile_rows(0)
+  ,m_is_profile_pending(false)
 {
 }
 //----
 
 sqlite_statement::~sqlite_statement()
 {
+  flush_profile();
   sqlite3_finalize(m_stmt);
 }
 //----------------------------------------------------------------------------
@@ -107,6 +347,7 @@ sqlite_statement &sqlite_statement::bind(unsigned idx, bool value)
 {
   if(m_executed)
   {
+    flush_profile();
     sqlite3_reset(m_stmt);
     m_executed=false;
   }
@@ -120,6 +361,7 @@ sqlite_statement &sqlite_statement::bind(unsigned idx, unsigned value)
 {
   if(m_executed)
   {
+    flush_profile();
     sqlite3_reset(m_stmt);
     m_executed=false;
   }
@@ -133,6 +375,7 @@ sqlite_statement &sqlite_statement::bind(unsigned idx, boost::uint64_t value)
 {
   if(m_executed)
   {
+    flush_profile();
     sqlite3_reset(m_stmt);
     m_executed=false;
   }
@@ -146,6 +389,7 @@ sqlite_statement &sqlite_statement::bind(unsigned idx, float value)
 {
   if(m_executed)
   {
+    flush_profile();
     sqlite3_reset(m_stmt);
     m_executed=false;
   }
@@ -159,6 +403,7 @@ sqlite_statement &sqlite_statement::bind(unsigned idx, const wchar_t *value)
 {
   if(m_executed)
   {
+    flush_profile();
     sqlite3_reset(m_stmt);
     m_executed=false;
   }
@@ -172,6 +417,7 @@ sqlite_statement &sqlite_statement::bind(unsigned idx, const wstring &value)
 {
   if(m_executed)
   {
+    flush_profile();
     sqlite3_reset(m_stmt);
     m_executed=false;
   }
@@ -185,6 +431,7 @@ sqlite_statement &sqlite_statement::bind_null(unsigned idx)
 {
   if(m_executed)
   {
+    flush_profile();
     sqlite3_reset(m_stmt);
     m_executed=false;
   }
@@ -198,32 +445,76 @@ sqlite_statement &sqlite_statement::exec()
 {
   // reset and step
   if(m_executed)
+  {
+    flush_profile();
     sqlite3_reset(m_stmt);
+  }
   return next();
 }
 //----
 
 sqlite_statement &sqlite_statement::next()
 {
-  // execute query, or fetch another row
+  // execute query, or fetch another row (timed while profiling)
+  const bool is_profiling=g_is_profiling;
+  const unsigned long long start=is_profiling ? logger::get_monotonic_time() : 0;
   int result=sqlite3_step(m_stmt);
+  if(is_profiling)
+  {
+    m_profile_time+=logger::get_monotonic_time()-start;
+    m_profile_rows+=SQLITE_ROW==result ? 1 : 0;
+    m_is_profile_pending=true;
+  }
   if(SQLITE_DONE!=result && SQLITE_ROW!=result)
   {
+    flush_profile();
     sqlite3_reset(m_stmt);
     throw_errorf("Unable to execute statement for query '%S': %S", m_sql.c_str(), sqlite3_errmsg16(m_sqlite));
   }
   m_executed=true;
   m_more=SQLITE_ROW==result;
+  if(!m_more)
+    flush_profile();
   return *this;
 }
 //----
 
+void sqlite_statement::flush_profile()
+{
+  // add execution to the profile of the statement
+  if(!m_is_profile_pending)
+    return;
+  profile_registry &reg=get_profile_registry();
+  const std::string sql=normalized_sql(sqlite3_sql(m_stmt));
+  {
+    boost::mutex::scoped_lock lock(reg.mutex);
+    sqlite_query_profile &profile=reg.profiles[sql];
+    profile.sql=sql;
+    ++profile.num_executions;
+    profile.num_rows+=m_profile_rows;
+    profile.total_time+=m_profile_time;
+    profile.max_time=std::max(profile.max_time, m_profile_time);
+  }
+  m_profile_time=0;
+  m_profile_rows=0;
+  m_is_profile_pending=false;
+}
+//----
+
 sqlite_statement::operator const void*() const
 {
   return reinterpret_cast<const void*>(m_executed && m_more);
 }
 //----------------------------------------------------------------------------
 
+bool sqlite_statement::is_null(unsigned idx) const
+{
+  if(!m_executed)
+    throw logic_error("SQL statement hasn't been executed yet.");
+  return SQLITE_NULL==sqlite3_column_type(m_stmt, idx);
+}
+//----
+
 bool sqlite_statement::get_bool(unsigned idx) const
 {
   if(!m_executed)
@@ -258,13 +549,26 @@ float sqlite_statement::get_float(unsigned idx) const
 
 wstring sqlite_statement::get_string(unsigned idx) const
 {
+  return get_string_view(idx).str();
+}
+//----
+
+const wchar_t *sqlite_statement::get_string(unsigned idx, arena &a) const
+{
+  // copy column text into the arena (instead of a string of its own)
+  const sqlite_string_view text=get_string_view(idx);
+  return a.copy(text.data, text.size);
+}
+//----
+
+sqlite_string_view sqlite_statement::get_string_view(unsigned idx) const
+{
+  // get text (converted by SQLite if necessary) before its size
   if(!m_executed)
     throw logic_error("SQL statement hasn't been executed yet.");
-  const unsigned size=sqlite3_column_bytes16(m_stmt, idx)/2;
-  wstring buffer;
-  buffer.resize(size);
-  memcpy(&buffer[0], sqlite3_column_text16(m_stmt, idx), size*sizeof(wchar_t));
-  return buffer;
+  if(const wchar_t *text=static_cast<const wchar_t*>(sqlite3_column_text16(m_stmt, idx)))
+    return sqlite_string_view(text, sqlite3_column_bytes16(m_stmt, idx)/sizeof(wchar_t));
+  return sqlite_string_view(L"", 0);
 }
 //----
 
@@ -299,4 +603,15 @@ boost::optional<std::wstring> sqlite_statement::get_string_option(unsigned idx)
     option=get_string(idx);
   return option;
 }
+//----
+
+boost::optional<sqlite_string_view> sqlite_statement::get_string_view_option(unsigned idx) const
+{
+  if(!m_executed)
+    throw logic_error("SQL statement hasn't been executed yet.");
+  boost::optional<sqlite_string_view> option;
+  if(SQLITE_NULL!=sqlite3_column_type(m_stmt, idx))
+    option=get_string_view(idx);
+  return option;
+}
 //----------------------------------------------------------------------------
@@ -7,6 +7,7 @@
 #ifndef UTILS_DB_SQLITE_H
 #define UTILS_DB_SQLITE_H
 #include "../core/defs.h"
+#include "../core/arena.h"
 #include <memory>
 #include <boost/optional.hpp>
 //----------------------------------------------------------------------------
@@ -14,6 +15,14 @@
 // Interface:
 class sqlite_connection;
 class sqlite_statement;
+class sqlite_transaction;
+struct sqlite_string_view;
+struct sqlite_query_profile;
+void enable_sqlite_profiling(bool enable);
+bool is_sqlite_profiling_enabled();
+std::vector<sqlite_query_profile> get_sqlite_query_profiles();
+void log_sqlite_query_profiles();
+void reset_sqlite_query_profiles();
 //----------------------------------------------------------------------------
 
 
@@ -30,13 +39,18 @@ public:
   // query
   std::shared_ptr<sqlite_statement> prepare(const std::wstring &sql);
   unsigned get_num_affected_rows() const;
+  std::wstring get_encoding();
   //--------------------------------------------------------------------------
 
   // customization
   void reg_function(const wchar_t *name, unsigned num_args, void (*function)(struct sqlite3_context*, int, struct Mem**));
   //--------------------------------------------------------------------------
 
-  // versioning
+  // transactions
+  sqlite_transaction *get_transaction() const;
+  //--------------------------------------------------------------------------
+
+  // versioning (within a transaction)
   unsigned begin_schema_update();
   void end_schema_update(const wchar_t *name, unsigned new_version);
   //--------------------------------------------------------------------------
@@ -44,10 +58,12 @@ public:
 private:
   sqlite_connection(const sqlite_connection&); // not implemented
   void operator=(const sqlite_connection&); // not implemented
+  friend class sqlite_transaction;
   //--------------------------------------------------------------------------
 
   struct sqlite3 *m_sqlite;
   unsigned m_current_version;
+  sqlite_transaction *m_transaction; // innermost
 };
 //----------------------------------------------------------------------------
 
@@ -89,19 +105,24 @@ public:
   //--------------------------------------------------------------------------
 
   // column accessors
+  bool is_null(unsigned idx=0) const;
   bool get_bool(unsigned idx=0) const;
   unsigned get_unsigned(unsigned idx=0) const;
   boost::uint64_t get_uint64(unsigned idx=0) const;
   float get_float(unsigned idx=0) const;
   std::wstring get_string(unsigned idx=0) const;
+  const wchar_t *get_string(unsigned idx, arena&) const;
+  sqlite_string_view get_string_view(unsigned idx=0) const;
   boost::optional<unsigned> get_unsigned_option(unsigned idx=0) const;
   boost::optional<boost::uint64_t> get_uint64_option(unsigned idx=0) const;
   boost::optional<std::wstring> get_string_option(unsigned idx=0) const;
+  boost::optional<sqlite_string_view> get_string_view_option(unsigned idx=0) const;
   //--------------------------------------------------------------------------
 
 private:
   sqlite_statement(const sqlite_statement&); // not implemented
   void operator=(const sqlite_statement&); // not implemented
+  void flush_profile();
   //--------------------------------------------------------------------------
 
   struct sqlite3 *m_sqlite;
@@ -109,7 +130,97 @@ private:
   std::wstring m_sql;
   bool m_executed;
   bool m_more;
+  unsigned long long m_profile_time; // of the current execution
+  unsigned long m_profile_rows;
+  bool m_is_profile_pending;
+};
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// sqlite_transaction
+//
+// Scoped transaction. The outermost transaction of a connection BEGINs (in
+// immediate mode the write lock is taken right away), nested ones are
+// savepoints. Unless committed, the transaction is rolled back when it goes
+// out of scope, e.g. when an exception is thrown. checkpoint() commits the
+// changes so far and continues, so long operations can commit in chunks.
+//============================================================================
+class sqlite_transaction
+{
+public:
+  // construction and destruction
+  enum e_mode {mode_deferred, mode_immediate};
+  sqlite_transaction(sqlite_connection&, e_mode mode=mode_deferred);
+  ~sqlite_transaction();
+  //--------------------------------------------------------------------------
+
+  // completion
+  void commit();
+  void checkpoint();
+  void rollback();
+  //--------------------------------------------------------------------------
+
+private:
+  sqlite_transaction(const sqlite_transaction&); // not implemented
+  void operator=(const sqlite_transaction&); // not implemented
+  void begin();
+  void end(const wchar_t *outermost_sql, const wchar_t *savepoint_sql);
+  //--------------------------------------------------------------------------
+
+  sqlite_connection &m_connection;
+  sqlite_transaction *const m_outer;
+  const unsigned m_depth;
+  const e_mode m_mode;
+  const std::wstring m_savepoint; // empty for the outermost transaction
+  bool m_active;
+};
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// sqlite_query_profile
+//
+// Statistics of the statements with the same SQL (with literals replaced by
+// '?'), collected while profiling is enabled. Only the time spent stepping
+// statements is measured, not preparing them.
+//============================================================================
+struct sqlite_query_profile
+{
+  // construction
+  inline sqlite_query_profile();
+  //--------------------------------------------------------------------------
+
+  std::string sql;
+  unsigned long num_executions;
+  unsigned long num_rows;
+  unsigned long long total_time, max_time; // in microseconds
+};
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// sqlite_string_view
+//
+// Column text owned by the statement (zero-terminated), valid until the
+// statement is stepped or executed again.
+//============================================================================
+struct sqlite_string_view
+{
+  // construction
+  inline sqlite_string_view(const wchar_t *data, size_t size);
+  //--------------------------------------------------------------------------
+
+  // accessors
+  inline bool empty() const;
+  inline std::wstring str() const;
+  inline void assign_to(std::wstring&) const;
+  //--------------------------------------------------------------------------
+
+  const wchar_t *data;
+  size_t size;
 };
 //----------------------------------------------------------------------------
 
+#include "sqlite.inl"
 #endif
\ No newline at end of file
@@ -0,0 +1,48 @@
+//============================================================================
+// db/sqlite.inl: SQLite database components
+//
+// (c) Michael Walter, 2006
+//============================================================================
+
+
+//============================================================================
+// sqlite_query_profile
+//============================================================================
+sqlite_query_profile::sqlite_query_profile()
+  :num_executions(0)
+  ,num_rows(0)
+  ,total_time(0)
+  ,max_time(0)
+{
+}
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// sqlite_string_view
+//============================================================================
+sqlite_string_view::sqlite_string_view(const wchar_t *data_, size_t size_)
+  :data(data_)
+  ,size(size_)
+{
+}
+//----------------------------------------------------------------------------
+
+bool sqlite_string_view::empty() const
+{
+  return !size;
+}
+//----
+
+std::wstring sqlite_string_view::str() const
+{
+  return std::wstring(data, size);
+}
+//----
+
+void sqlite_string_view::assign_to(std::wstring &s) const
+{
+  // reuses the capacity of the string
+  s.assign(data, size);
+}
+//----------------------------------------------------------------------------
@@ -0,0 +1,185 @@
+//============================================================================
+// gfx/atlas.cpp: Texture atlas
+//
+// (c) Michael Walter, 2006
+//============================================================================
+
+#include "atlas.h"
+#include <stdexcept>
+using namespace std;
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// sprite
+//============================================================================
+sprite::sprite()
+  :page(0)
+{
+}
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// atlas
+//============================================================================
+atlas::atlas(unsigned page_width, unsigned page_height)
+  :m_page_width(page_width)
+  ,m_page_height(page_height)
+{
+}
+//----------------------------------------------------------------------------
+
+sprite atlas::add(const surface &image)
+{
+  // allocate space and copy pixels
+  if(!image.get_width() || !image.get_height())
+    throw invalid_argument("Unable to add empty image to atlas.");
+  sprite s=allocate(image.get_width(), image.get_height());
+  ::copy(m_pages[s.page], s.rect.x, s.rect.y, image, image.get_rect(), s.rect);
+  ++m_page_sprites[s.page];
+  return s;
+}
+//----
+
+void atlas::remove(const sprite &s)
+{
+  // free page once its last sprite is gone
+  if(!--m_page_sprites[s.page])
+  {
+    free_page(s.page);
+    return;
+  }
+
+  // keep space for the next sprite of the same size
+  m_pages[s.page].clear(s.rect);
+  m_free_sprites.insert(make_pair(make_pair(s.rect.width, s.rect.height), s));
+}
+//----
+
+void atlas::clear()
+{
+  m_pages.clear();
+  m_page_heights.clear();
+  m_page_sprites.clear();
+  m_shelves.clear();
+  m_free_sprites.clear();
+}
+//----------------------------------------------------------------------------
+
+unsigned atlas::get_num_pages() const
+{
+  return unsigned(m_pages.size());
+}
+//----
+
+const surface &atlas::get_page(unsigned index) const
+{
+  return m_pages[index];
+}
+//----
+
+unsigned long atlas::get_size() const
+{
+  unsigned long size=0;
+  for(unsigned page=0; page<m_pages.size(); ++page)
+    if(!m_pages.is_null(page))
+      size+=m_pages[page].get_width()*m_pages[page].get_height()*4;
+  return size;
+}
+//----------------------------------------------------------------------------
+
+void atlas::blend(surface &dst, int x, int y, const sprite &s, const pixel_rect &clip) const
+{
+  ::blend(dst, x, y, m_pages[s.page], s.rect, clip);
+}
+//----
+
+void atlas::copy(surface &dst, int x, int y, const sprite &s, const pixel_rect &clip) const
+{
+  ::copy(dst, x, y, m_pages[s.page], s.rect, clip);
+}
+//----------------------------------------------------------------------------
+
+sprite atlas::allocate(unsigned width, unsigned height)
+{
+  // reuse space of a removed sprite of the same size
+  sprite s;
+  free_sprites::iterator free=m_free_sprites.find(make_pair(width, height));
+  if(free!=m_free_sprites.end())
+  {
+    s=free->second;
+    m_free_sprites.erase(free);
+    return s;
+  }
+
+  // images exceeding the page size get a page of their own
+  if(width>m_page_width || height>m_page_height)
+  {
+    s.page=add_page(width, height);
+    m_page_heights[s.page]=height;
+    s.rect=pixel_rect(0, 0, width, height);
+    return s;
+  }
+
+  // put sprite on the first shelf that fits without wasting too much height
+  for(vector<shelf>::iterator iter=m_shelves.begin(); iter!=m_shelves.end(); ++iter)
+    if(height<=iter->height && iter->height<=height+height/4 && iter->next_x+width<=m_page_width)
+    {
+      s.page=iter->page;
+      s.rect=pixel_rect(int(iter->next_x), int(iter->y), width, height);
+      iter->next_x+=width;
+      return s;
+    }
+
+  // start a new shelf, adding a page if none has enough room left
+  unsigned page=0;
+  while(page<m_pages.size() && (m_pages.is_null(page) || m_page_heights[page]+height>m_pages[page].get_height()))
+    ++page;
+  if(page==m_pages.size())
+    page=add_page(m_page_width, m_page_height);
+  shelf new_shelf={page, m_page_heights[page], height, width};
+  m_shelves.push_back(new_shelf);
+  m_page_heights[page]+=height;
+  s.page=page;
+  s.rect=pixel_rect(0, int(new_shelf.y), width, height);
+  return s;
+}
+//----
+
+unsigned atlas::add_page(unsigned width, unsigned height)
+{
+  // reuse slot of a freed page, so that the indices of other pages stay valid
+  unsigned page=0;
+  while(page<m_pages.size() && !m_pages.is_null(page))
+    ++page;
+  if(page==m_pages.size())
+  {
+    m_pages.push_back(0);
+    m_page_heights.push_back(0);
+    m_page_sprites.push_back(0);
+  }
+  m_pages.replace(page, new surface(width, height));
+  m_page_heights[page]=0;
+  m_page_sprites[page]=0;
+  return page;
+}
+//----
+
+void atlas::free_page(unsigned page)
+{
+  // release pixels and drop the page's shelves and free sprites
+  m_pages.replace(page, 0);
+  m_page_heights[page]=0;
+  for(vector<shelf>::iterator iter=m_shelves.begin(); iter!=m_shelves.end();)
+    if(iter->page==page)
+      iter=m_shelves.erase(iter);
+    else
+      ++iter;
+  for(free_sprites::iterator iter=m_free_sprites.begin(); iter!=m_free_sprites.end();)
+    if(iter->second.page==page)
+      m_free_sprites.erase(iter++);
+    else
+      ++iter;
+}
+//----------------------------------------------------------------------------
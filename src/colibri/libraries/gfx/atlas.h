@@ -0,0 +1,91 @@
+//============================================================================
+// gfx/atlas.h: Texture atlas
+//
+// (c) Michael Walter, 2006
+//============================================================================
+
+#ifndef UTILS_GFX_ATLAS_H
+#define UTILS_GFX_ATLAS_H
+#include "surface.h"
+#include <map>
+#include <utility>
+#include <boost/ptr_container/ptr_vector.hpp>
+//----------------------------------------------------------------------------
+
+// Interface:
+struct sprite;
+class atlas;
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// sprite
+//============================================================================
+struct sprite
+{
+  // construction
+  sprite();
+  //--------------------------------------------------------------------------
+
+  unsigned page;
+  pixel_rect rect;
+};
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// atlas
+//
+// Packs premultiplied images into a few large pages, so that painting
+// blits sub-rectangles of the same memory instead of many small bitmaps.
+// Pages are filled shelf by shelf; removed sprites are reused by later
+// sprites of the same size, which suits fixed-size icons. Pages whose last
+// sprite is removed are freed and their slot is reused by the next page.
+//============================================================================
+class atlas
+{
+public:
+  // construction
+  atlas(unsigned page_width=1024, unsigned page_height=1024);
+  //--------------------------------------------------------------------------
+
+  // packing
+  sprite add(const surface&);
+  void remove(const sprite&);
+  void clear();
+  //--------------------------------------------------------------------------
+
+  // accessors
+  unsigned get_num_pages() const;
+  const surface &get_page(unsigned index) const;
+  unsigned long get_size() const; // of allocated pages
+  //--------------------------------------------------------------------------
+
+  // painting
+  void blend(surface &dst, int x, int y, const sprite&, const pixel_rect &clip) const;
+  void copy(surface &dst, int x, int y, const sprite&, const pixel_rect &clip) const;
+  //--------------------------------------------------------------------------
+
+private:
+  atlas(const atlas&); // not implemented
+  void operator=(const atlas&); // not implemented
+  struct shelf
+  {
+    unsigned page, y, height, next_x;
+  };
+  typedef std::multimap<std::pair<unsigned, unsigned>, sprite> free_sprites;
+  sprite allocate(unsigned width, unsigned height);
+  unsigned add_page(unsigned width, unsigned height);
+  void free_page(unsigned page);
+  //--------------------------------------------------------------------------
+
+  const unsigned m_page_width, m_page_height;
+  boost::ptr_vector<boost::nullable<surface> > m_pages; // null if freed
+  std::vector<unsigned> m_page_heights; // used height per page
+  std::vector<unsigned> m_page_sprites; // number of sprites per page
+  std::vector<shelf> m_shelves;
+  free_sprites m_free_sprites;
+};
+//----------------------------------------------------------------------------
+
+#endif
@@ -0,0 +1,88 @@
+//============================================================================
+// gfx/damage.cpp: Damage tracking
+//
+// (c) Michael Walter, 2006
+//============================================================================
+
+#include "damage.h"
+using namespace std;
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// <anonymous namespace>
+//============================================================================
+namespace
+{
+  // check if rectangles overlap or touch
+  bool are_adjacent(const pixel_rect &a, const pixel_rect &b)
+  {
+    return a.x<=b.x+int(b.width) && b.x<=a.x+int(a.width) && a.y<=b.y+int(b.height) && b.y<=a.y+int(a.height);
+  }
+  //--------------------------------------------------------------------------
+}
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// damage_region
+//============================================================================
+damage_region::damage_region()
+{
+}
+//----------------------------------------------------------------------------
+
+void damage_region::add(const pixel_rect &rect)
+{
+  // merge rectangle with all rectangles it touches
+  if(rect.is_empty())
+    return;
+  pixel_rect merged=rect;
+  for(size_t i=0; i<m_rects.size();)
+  {
+    if(are_adjacent(merged, m_rects[i]))
+    {
+      merged=unite(merged, m_rects[i]);
+      m_rects.erase(m_rects.begin()+i);
+      i=0;
+    }
+    else
+      ++i;
+  }
+  m_rects.push_back(merged);
+
+  // collapse to bounding rectangle if the region gets too fragmented
+  if(m_rects.size()>max_rects)
+  {
+    const pixel_rect bounds=get_bounds();
+    m_rects.assign(1, bounds);
+  }
+}
+//----
+
+void damage_region::clear()
+{
+  m_rects.clear();
+}
+//----------------------------------------------------------------------------
+
+bool damage_region::is_empty() const
+{
+  return m_rects.empty();
+}
+//----
+
+const vector<pixel_rect> &damage_region::get_rects() const
+{
+  return m_rects;
+}
+//----
+
+pixel_rect damage_region::get_bounds() const
+{
+  pixel_rect bounds;
+  for(vector<pixel_rect>::const_iterator iter=m_rects.begin(); iter!=m_rects.end(); ++iter)
+    bounds=bounds.is_empty() ? *iter : unite(bounds, *iter);
+  return bounds;
+}
+//----------------------------------------------------------------------------
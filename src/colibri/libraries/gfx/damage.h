@@ -0,0 +1,50 @@
+//============================================================================
+// gfx/damage.h: Damage tracking
+//
+// (c) Michael Walter, 2006
+//============================================================================
+
+#ifndef UTILS_GFX_DAMAGE_H
+#define UTILS_GFX_DAMAGE_H
+#include "surface.h"
+#include <vector>
+//----------------------------------------------------------------------------
+
+// Interface:
+class damage_region;
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// damage_region
+//
+// Set of rectangles which need to be repainted. Overlapping and touching
+// rectangles are merged; once there are more than a handful the region
+// collapses to its bounding rectangle, as repainting a slightly larger area
+// is cheaper than walking many small ones.
+//============================================================================
+class damage_region
+{
+public:
+  // construction
+  damage_region();
+  //--------------------------------------------------------------------------
+
+  // mutators
+  void add(const pixel_rect&);
+  void clear();
+  //--------------------------------------------------------------------------
+
+  // accessors
+  bool is_empty() const;
+  const std::vector<pixel_rect> &get_rects() const;
+  pixel_rect get_bounds() const;
+  //--------------------------------------------------------------------------
+
+private:
+  enum {max_rects=4};
+  std::vector<pixel_rect> m_rects;
+};
+//----------------------------------------------------------------------------
+
+#endif
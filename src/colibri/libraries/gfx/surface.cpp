@@ -0,0 +1,210 @@
+//============================================================================
+// gfx/surface.cpp: Portable software compositing
+//
+// (c) Michael Walter, 2006
+//============================================================================
+
+#include "surface.h"
+#include <algorithm>
+#include <cstring>
+using namespace std;
+using namespace boost;
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// <anonymous namespace>
+//============================================================================
+namespace
+{
+  // division by 255 of two 16-bit channels at once, rounded
+  inline uint32_t div_255_x2(uint32_t channels)
+  {
+    channels+=0x00800080;
+    return ((channels+((channels>>8)&0x00ff00ff))>>8)&0x00ff00ff;
+  }
+  //--------------------------------------------------------------------------
+
+  // clip a blit to the source and destination surfaces and the clip rect
+  bool clip_blit(const surface &dst, int &x, int &y, const surface &src, pixel_rect &src_rect, const pixel_rect &clip)
+  {
+    // clip source rect against source surface
+    const pixel_rect clipped_src=intersect(src_rect, src.get_rect());
+    x+=clipped_src.x-src_rect.x;
+    y+=clipped_src.y-src_rect.y;
+
+    // clip destination rect against clip rect and destination surface
+    const pixel_rect dst_rect=intersect(intersect(pixel_rect(x, y, clipped_src.width, clipped_src.height), clip), dst.get_rect());
+    if(dst_rect.is_empty())
+      return false;
+    src_rect=pixel_rect(clipped_src.x+dst_rect.x-x, clipped_src.y+dst_rect.y-y, dst_rect.width, dst_rect.height);
+    x=dst_rect.x;
+    y=dst_rect.y;
+    return true;
+  }
+  //--------------------------------------------------------------------------
+}
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// intersect()
+//============================================================================
+pixel_rect intersect(const pixel_rect &a, const pixel_rect &b)
+{
+  const int x0=max(a.x, b.x), y0=max(a.y, b.y);
+  const int x1=min(a.x+int(a.width), b.x+int(b.width)), y1=min(a.y+int(a.height), b.y+int(b.height));
+  if(x1<=x0 || y1<=y0)
+    return pixel_rect(x0, y0, 0, 0);
+  return pixel_rect(x0, y0, unsigned(x1-x0), unsigned(y1-y0));
+}
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// unite()
+//============================================================================
+pixel_rect unite(const pixel_rect &a, const pixel_rect &b)
+{
+  const int x0=min(a.x, b.x), y0=min(a.y, b.y);
+  const int x1=max(a.x+int(a.width), b.x+int(b.width)), y1=max(a.y+int(a.height), b.y+int(b.height));
+  return pixel_rect(x0, y0, unsigned(x1-x0), unsigned(y1-y0));
+}
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// premultiply()
+//============================================================================
+uint32_t premultiply(uint32_t argb)
+{
+  const uint32_t alpha=argb>>24;
+  if(0xff==alpha)
+    return argb;
+  if(!alpha)
+    return 0;
+  return (alpha<<24)|div_255_x2((argb&0x00ff00ff)*alpha)|(div_255_x2(((argb>>8)&0xff)*alpha)<<8);
+}
+//----
+
+void premultiply(surface &s)
+{
+  for(unsigned y=0; y<s.get_height(); ++y)
+  {
+    uint32_t *row=s.get_row(y);
+    for(unsigned x=0; x<s.get_width(); ++x)
+      row[x]=premultiply(row[x]);
+  }
+}
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// copy()
+//============================================================================
+void copy(surface &dst, int x, int y, const surface &src, const pixel_rect &src_rect, const pixel_rect &clip)
+{
+  pixel_rect rect=src_rect;
+  if(!clip_blit(dst, x, y, src, rect, clip))
+    return;
+  for(unsigned i=0; i<rect.height; ++i)
+    memcpy(dst.get_row(y+i)+x, src.get_row(rect.y+i)+rect.x, rect.width*sizeof(uint32_t));
+}
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// blend()
+//============================================================================
+void blend(surface &dst, int x, int y, const surface &src, const pixel_rect &src_rect, const pixel_rect &clip)
+{
+  // composite premultiplied source over destination
+  pixel_rect rect=src_rect;
+  if(!clip_blit(dst, x, y, src, rect, clip))
+    return;
+  for(unsigned i=0; i<rect.height; ++i)
+  {
+    uint32_t *d=dst.get_row(y+i)+x;
+    const uint32_t *s=src.get_row(rect.y+i)+rect.x;
+    for(unsigned j=0; j<rect.width; ++j)
+    {
+      const uint32_t alpha=s[j]>>24;
+      if(0xff==alpha)
+        d[j]=s[j];
+      else if(alpha)
+      {
+        const uint32_t inv_alpha=0xff-alpha;
+        d[j]=s[j]+(div_255_x2((d[j]&0x00ff00ff)*inv_alpha)|(div_255_x2(((d[j]>>8)&0x00ff00ff)*inv_alpha)<<8));
+      }
+    }
+  }
+}
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// surface
+//============================================================================
+surface::surface()
+  :m_width(0)
+  ,m_height(0)
+  ,m_stride(0)
+  ,m_pixels(0)
+{
+}
+//----
+
+surface::surface(unsigned width, unsigned height)
+  :m_width(0)
+  ,m_height(0)
+  ,m_stride(0)
+  ,m_pixels(0)
+{
+  reset(width, height);
+}
+//----
+
+surface::surface(unsigned width, unsigned height, unsigned stride, uint32_t *pixels)
+  :m_width(width)
+  ,m_height(height)
+  ,m_stride(stride)
+  ,m_pixels(pixels)
+{
+}
+//----
+
+void surface::reset(unsigned width, unsigned height)
+{
+  // allocate transparent pixels
+  m_buffer.assign(size_t(width)*height, 0);
+  m_width=width;
+  m_height=height;
+  m_stride=width;
+  m_pixels=m_buffer.empty() ? 0 : &m_buffer[0];
+}
+//----
+
+void surface::attach(unsigned width, unsigned height, unsigned stride, uint32_t *pixels)
+{
+  // wrap external pixels
+  vector<uint32_t>().swap(m_buffer);
+  m_width=width;
+  m_height=height;
+  m_stride=stride;
+  m_pixels=pixels;
+}
+//----------------------------------------------------------------------------
+
+void surface::clear(const pixel_rect &rect)
+{
+  fill(rect, 0);
+}
+//----
+
+void surface::fill(const pixel_rect &rect, uint32_t argb)
+{
+  const pixel_rect clipped=intersect(rect, get_rect());
+  for(unsigned i=0; i<clipped.height; ++i)
+    std::fill_n(get_row(clipped.y+i)+clipped.x, clipped.width, argb);
+}
+//----------------------------------------------------------------------------
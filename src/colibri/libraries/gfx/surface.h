@@ -0,0 +1,91 @@
+//============================================================================
+// gfx/surface.h: Portable software compositing
+//
+// (c) Michael Walter, 2006
+//============================================================================
+
+#ifndef UTILS_GFX_SURFACE_H
+#define UTILS_GFX_SURFACE_H
+#include <vector>
+#include <boost/cstdint.hpp>
+//----------------------------------------------------------------------------
+
+// Interface:
+struct pixel_rect;
+class surface;
+pixel_rect intersect(const pixel_rect&, const pixel_rect&);
+pixel_rect unite(const pixel_rect&, const pixel_rect&);
+boost::uint32_t premultiply(boost::uint32_t argb);
+void premultiply(surface&);
+void copy(surface &dst, int x, int y, const surface &src, const pixel_rect &src_rect, const pixel_rect &clip);
+void blend(surface &dst, int x, int y, const surface &src, const pixel_rect &src_rect, const pixel_rect &clip);
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// pixel_rect
+//============================================================================
+struct pixel_rect
+{
+  // construction
+  inline pixel_rect();
+  inline pixel_rect(int x, int y, unsigned width, unsigned height);
+  //--------------------------------------------------------------------------
+
+  // accessors
+  inline bool is_empty() const;
+  //--------------------------------------------------------------------------
+
+  int x, y;
+  unsigned width, height;
+};
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// surface
+//
+// 32bpp ARGB pixels with premultiplied alpha, stored as 0xAARRGGBB words
+// (which matches the memory layout of 32bpp DIB sections and GDI+'s
+// PixelFormat32bppPARGB). A surface either owns its pixels or wraps
+// external memory (e.g. the bits of a DIB section).
+//============================================================================
+class surface
+{
+public:
+  // construction
+  surface();
+  surface(unsigned width, unsigned height);
+  surface(unsigned width, unsigned height, unsigned stride, boost::uint32_t *pixels);
+  void reset(unsigned width, unsigned height);
+  void attach(unsigned width, unsigned height, unsigned stride, boost::uint32_t *pixels);
+  //--------------------------------------------------------------------------
+
+  // accessors
+  inline unsigned get_width() const;
+  inline unsigned get_height() const;
+  inline unsigned get_stride() const;
+  inline pixel_rect get_rect() const;
+  inline boost::uint32_t *get_row(unsigned y);
+  inline const boost::uint32_t *get_row(unsigned y) const;
+  //--------------------------------------------------------------------------
+
+  // filling
+  void clear(const pixel_rect&);
+  void fill(const pixel_rect&, boost::uint32_t argb);
+  //--------------------------------------------------------------------------
+
+private:
+  surface(const surface&); // not implemented
+  void operator=(const surface&); // not implemented
+  //--------------------------------------------------------------------------
+
+  unsigned m_width, m_height;
+  unsigned m_stride; // in pixels
+  boost::uint32_t *m_pixels;
+  std::vector<boost::uint32_t> m_buffer;
+};
+//----------------------------------------------------------------------------
+
+#include "surface.inl"
+#endif
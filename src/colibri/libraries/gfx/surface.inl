@@ -0,0 +1,73 @@
+//============================================================================
+// gfx/surface.inl: Portable software compositing
+//
+// (c) Michael Walter, 2006
+//============================================================================
+
+
+//============================================================================
+// pixel_rect
+//============================================================================
+pixel_rect::pixel_rect()
+  :x(0)
+  ,y(0)
+  ,width(0)
+  ,height(0)
+{
+}
+//----
+
+pixel_rect::pixel_rect(int x, int y, unsigned width, unsigned height)
+  :x(x)
+  ,y(y)
+  ,width(width)
+  ,height(height)
+{
+}
+//----------------------------------------------------------------------------
+
+bool pixel_rect::is_empty() const
+{
+  return !width || !height;
+}
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// surface
+//============================================================================
+unsigned surface::get_width() const
+{
+  return m_width;
+}
+//----
+
+unsigned surface::get_height() const
+{
+  return m_height;
+}
+//----
+
+unsigned surface::get_stride() const
+{
+  return m_stride;
+}
+//----
+
+pixel_rect surface::get_rect() const
+{
+  return pixel_rect(0, 0, m_width, m_height);
+}
+//----
+
+boost::uint32_t *surface::get_row(unsigned y)
+{
+  return m_pixels+y*m_stride;
+}
+//----
+
+const boost::uint32_t *surface::get_row(unsigned y) const
+{
+  return m_pixels+y*m_stride;
+}
+//----------------------------------------------------------------------------
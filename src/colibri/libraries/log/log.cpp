@@ -8,14 +8,27 @@
 #include <ctime>
 #include <cstdarg>
 #include <cstdio>
+#include <cstring>
 #include <list>
+#include <vector>
+#include <sstream>
+#include <boost/thread/thread.hpp>
 #include <boost/thread/mutex.hpp>
+#include <boost/thread/condition.hpp>
 #include <boost/format.hpp>
+#include <boost/bind.hpp>
+#include <boost/filesystem/operations.hpp>
+#ifdef LOGGER_ZLIB
+#include <zlib.h>
+#endif
 #ifdef _WIN32
 #include <windows.h>
 #endif
 #ifdef _MSC_VER
 #define snprintf _snprintf
+#ifdef LOGGER_ZLIB
+#pragma comment(lib, "zlib.lib")
+#endif
 #endif
 //----------------------------------------------------------------------------
 
@@ -32,18 +45,406 @@ namespace
   //--------------------------------------------------------------------------
 
 
+  //==========================================================================
+  // atomic_load(), atomic_store(), atomic_cas()
+  //==========================================================================
+  inline long atomic_load(const volatile long *value)
+  {
+#ifdef _WIN32
+    const long result=*value;
+    MemoryBarrier();
+    return result;
+#else
+    const long result=*value;
+    __sync_synchronize();
+    return result;
+#endif
+  }
+  //----
+
+  inline void atomic_store(volatile long *value, long new_value)
+  {
+#ifdef _WIN32
+    MemoryBarrier();
+    *value=new_value;
+#else
+    __sync_synchronize();
+    *value=new_value;
+#endif
+  }
+  //----
+
+  inline bool atomic_cas(volatile long *value, long expected, long new_value)
+  {
+#ifdef _WIN32
+    return expected==InterlockedCompareExchange(value, new_value, expected);
+#else
+    return __sync_bool_compare_and_swap(value, expected, new_value);
+#endif
+  }
+  //----
+
+  inline long atomic_increment(volatile long *value)
+  {
+#ifdef _WIN32
+    return InterlockedIncrement(value);
+#else
+    return __sync_add_and_fetch(value, 1);
+#endif
+  }
+  //----
+
+  inline long atomic_exchange(volatile long *value, long new_value)
+  {
+#ifdef _WIN32
+    return InterlockedExchange(value, new_value);
+#else
+    return __sync_lock_test_and_set(value, new_value);
+#endif
+  }
+  //----
+
+  inline long atomic_decrement(volatile long *value)
+  {
+#ifdef _WIN32
+    return InterlockedDecrement(value);
+#else
+    return __sync_sub_and_fetch(value, 1);
+#endif
+  }
+  //----
+
+  template<typename T>
+  inline T *atomic_exchange_pointer(T *volatile *value, T *new_value)
+  {
+#ifdef _WIN32
+    return static_cast<T*>(InterlockedExchangePointer(reinterpret_cast<void *volatile*>(value), new_value));
+#else
+    return __sync_lock_test_and_set(value, new_value);
+#endif
+  }
+  //----
+
+  template<typename T>
+  inline bool atomic_cas_pointer(T *volatile *value, T *expected, T *new_value)
+  {
+#ifdef _WIN32
+    return expected==InterlockedCompareExchangePointer(reinterpret_cast<void *volatile*>(value), new_value, expected);
+#else
+    return __sync_bool_compare_and_swap(value, expected, new_value);
+#endif
+  }
+  //--------------------------------------------------------------------------
+
+
+  //==========================================================================
+  // record_queue
+  //
+  // Bounded multi-producer/single-consumer ring buffer. Every slot carries a
+  // sequence number: producers claim a slot by advancing the enqueue position
+  // with a CAS and publish it by bumping the slot sequence, the consumer
+  // thread takes published slots in order and hands them back to producers.
+  //==========================================================================
+  class record_queue
+  {
+  public:
+    // construction
+    record_queue()
+      :m_enqueue_pos(0)
+      ,m_dequeue_pos(0)
+    {
+      for(long i=0; i<capacity; ++i)
+        m_slots[i].sequence=i;
+    }
+    //------------------------------------------------------------------------
+
+    // producer interface
+    bool try_push(logger::e_level level, time_t time, const char *text)
+    {
+      // claim slot
+      slot *s;
+      long pos=atomic_load(&m_enqueue_pos);
+      for(;;)
+      {
+        s=&m_slots[pos&(capacity-1)];
+        const long dif=atomic_load(&s->sequence)-pos;
+        if(!dif)
+        {
+          if(atomic_cas(&m_enqueue_pos, pos, pos+1))
+            break;
+          pos=atomic_load(&m_enqueue_pos);
+        }
+        else if(dif<0)
+          return false;
+        else
+          pos=atomic_load(&m_enqueue_pos);
+      }
+
+      // fill and publish slot
+      s->level=level;
+      s->time=time;
+      std::strncpy(s->text, text, max_text_length);
+      s->text[max_text_length-1]=0;
+      atomic_store(&s->sequence, pos+1);
+      return true;
+    }
+    //------------------------------------------------------------------------
+
+    // consumer interface
+    bool try_pop(logger::record &rec)
+    {
+      slot &s=m_slots[m_dequeue_pos&(capacity-1)];
+      if(atomic_load(&s.sequence)-(m_dequeue_pos+1)<0)
+        return false;
+
+      // copy record and hand slot back to producers
+      rec.level=s.level;
+      rec.time=s.time;
+      rec.text=s.text;
+      atomic_store(&s.sequence, m_dequeue_pos+capacity);
+      atomic_store(&m_dequeue_pos, m_dequeue_pos+1);
+      return true;
+    }
+    //----
+
+    bool has_consumed(long pos) const
+    {
+      return atomic_load(&m_dequeue_pos)-pos>=0;
+    }
+    //----
+
+    long get_enqueue_pos() const
+    {
+      return atomic_load(&m_enqueue_pos);
+    }
+    //------------------------------------------------------------------------
+
+  private:
+    enum {capacity=512, max_text_length=1024};
+    struct slot
+    {
+      volatile long sequence;
+      logger::e_level level;
+      time_t time;
+      char text[max_text_length];
+    };
+    //------------------------------------------------------------------------
+
+    slot m_slots[capacity];
+    volatile long m_enqueue_pos;
+    volatile long m_dequeue_pos;
+  };
+  //--------------------------------------------------------------------------
+
+
+  // registered rate limiters (see rate_limiter::allow())
+  logger::rate_limiter *g_limiters=0;
+  boost::mutex g_limiters_mutex;
+  //--------------------------------------------------------------------------
+
+
+  //==========================================================================
+  // log_suppressed(), report_suppressed()
+  //==========================================================================
+  void log_impl(logger::e_level level, const char *text);
+  //----
+
+  void log_suppressed(long num_suppressed)
+  {
+    log_impl(logger::level_warn, (boost::format("Suppressed %1% similar log records") % num_suppressed).str().c_str());
+  }
+  //----
+
+  void report_suppressed(bool force)
+  {
+    // report suppressed records of limiters whose window has passed (or of all
+    // limiters if forced), which wouldn't be reported until their next record
+    std::vector<long> counts;
+    {
+      const long now=long(time(0));
+      boost::mutex::scoped_lock lock(g_limiters_mutex);
+      for(logger::rate_limiter *limiter=g_limiters; limiter; limiter=limiter->next)
+        if(atomic_load(&limiter->suppressed) && (force || now-atomic_load(&limiter->window_start)>=limiter->interval_secs))
+          if(const long num_suppressed=atomic_exchange(&limiter->suppressed, 0))
+            counts.push_back(num_suppressed);
+    }
+    for(std::vector<long>::const_iterator iter=counts.begin(); iter!=counts.end(); ++iter)
+      log_suppressed(*iter);
+  }
+  //--------------------------------------------------------------------------
+
+
+  //==========================================================================
+  // async_writer
+  //==========================================================================
+  class async_writer
+  {
+  public:
+    // construction and destruction
+    async_writer()
+      :m_stop(0)
+      ,m_flush_requested(0)
+    {
+      m_thread.reset(new boost::thread(boost::bind(&async_writer::run, this)));
+      m_thread_id=m_thread->get_id();
+    }
+    //----
+
+    ~async_writer()
+    {
+      // drain queue and wait for writer thread
+      atomic_store(&m_stop, 1);
+      m_wakeup.notify_one();
+      m_thread->join();
+    }
+    //------------------------------------------------------------------------
+
+    // logging
+    void push(logger::e_level level, const char *text)
+    {
+      // records logged by targets on the writer thread can't wait for it, so
+      // they are dropped if the ring buffer is full
+      const time_t now=time(0);
+      if(boost::this_thread::get_id()==m_thread_id)
+      {
+        m_queue.try_push(level, now, text);
+        return;
+      }
+
+      // wait for the writer thread if the ring buffer is full
+      while(!m_queue.try_push(level, now, text))
+      {
+        m_wakeup.notify_one();
+        boost::this_thread::yield();
+      }
+
+      // error records are written and flushed immediately
+      if(level>=logger::level_error)
+      {
+        atomic_store(&m_flush_requested, 1);
+        m_wakeup.notify_one();
+      }
+    }
+    //----
+
+    void flush()
+    {
+      // wait until all records pushed so far have been written (targets on the
+      // writer thread are flushed by it anyway)
+      if(boost::this_thread::get_id()==m_thread_id)
+        return;
+      const long pos=m_queue.get_enqueue_pos();
+      atomic_store(&m_flush_requested, 1);
+      while(!m_queue.has_consumed(pos))
+      {
+        m_wakeup.notify_one();
+        boost::this_thread::yield();
+      }
+
+      // flush targets
+      boost::mutex::scoped_lock lock(g_mutex);
+      for(targets::iterator iter=g_targets.begin(); iter!=g_targets.end(); ++iter)
+        (*iter)->flush();
+    }
+    //------------------------------------------------------------------------
+
+  private:
+    enum {poll_msecs=100, flush_msecs=1000};
+    //------------------------------------------------------------------------
+
+    void run()
+    {
+      boost::posix_time::ptime last_flush=boost::posix_time::microsec_clock::universal_time();
+      bool unflushed=false;
+      for(;;)
+      {
+        // write all queued records in one batch, including the suppression
+        // counts of rate limiters whose window has passed
+        const bool stop=0!=atomic_load(&m_stop);
+        report_suppressed(false);
+        if(write_batch())
+          unflushed=true;
+
+        // flush periodically, on error records and on shutdown
+        const boost::posix_time::ptime now=boost::posix_time::microsec_clock::universal_time();
+        if(stop || atomic_cas(&m_flush_requested, 1, 0) || (unflushed && now-last_flush>=boost::posix_time::milliseconds(long(flush_msecs))))
+        {
+          boost::mutex::scoped_lock lock(g_mutex);
+          for(targets::iterator iter=g_targets.begin(); iter!=g_targets.end(); ++iter)
+            (*iter)->flush();
+          last_flush=now;
+          unflushed=false;
+        }
+        if(stop)
+          return;
+
+        // sleep until woken up or until the next poll
+        boost::mutex::scoped_lock lock(m_wakeup_mutex);
+        m_wakeup.timed_wait(lock, boost::posix_time::milliseconds(long(poll_msecs)));
+      }
+    }
+    //----
+
+    bool write_batch()
+    {
+      logger::record rec;
+      if(!m_queue.try_pop(rec))
+        return false;
+      boost::mutex::scoped_lock lock(g_mutex);
+      do
+      {
+        for(targets::iterator iter=g_targets.begin(); iter!=g_targets.end(); ++iter)
+          (*iter)->log(rec);
+        if(rec.level>=logger::level_error)
+          for(targets::iterator iter=g_targets.begin(); iter!=g_targets.end(); ++iter)
+            (*iter)->flush();
+      }
+      while(m_queue.try_pop(rec));
+      return true;
+    }
+    //------------------------------------------------------------------------
+
+    record_queue m_queue;
+    volatile long m_stop;
+    volatile long m_flush_requested;
+    boost::mutex m_wakeup_mutex;
+    boost::condition m_wakeup;
+    std::auto_ptr<boost::thread> m_thread;
+    boost::thread::id m_thread_id;
+  };
+  //--------------------------------------------------------------------------
+
+  // async writer, if enabled, and number of threads currently using it
+  async_writer *volatile g_async_writer=0;
+  volatile long g_async_users=0;
+  //--------------------------------------------------------------------------
+
+
   //==========================================================================
   // log_impl()
   //==========================================================================
   void log_impl(logger::e_level level, const char *text)
   {
+    // hand off to writer thread? (the writer isn't destroyed while in use)
+    atomic_increment(&g_async_users);
+    if(async_writer *writer=g_async_writer)
+    {
+      writer->push(level, text);
+      atomic_decrement(&g_async_users);
+      return;
+    }
+    atomic_decrement(&g_async_users);
+
     // acquire mutex
     boost::mutex::scoped_lock lock(g_mutex);
 
     // log to all targets
     logger::record rec={level, time(0), text};
     for(targets::iterator iter=g_targets.begin(); iter!=g_targets.end(); ++iter)
+    {
       (*iter)->log(rec);
+      (*iter)->flush();
+    }
   }
   //--------------------------------------------------------------------------
 
@@ -81,6 +482,140 @@ namespace
   //--------------------------------------------------------------------------
 
 
+  //==========================================================================
+  // dedup_target
+  //==========================================================================
+  class dedup_target: public logger::target
+  {
+  public:
+    // construction
+    dedup_target(std::shared_ptr<logger::target> target)
+      :m_target(target)
+      ,m_has_last(false)
+      ,m_repeat_count(0)
+      ,m_output_time(0)
+    {
+    }
+    //------------------------------------------------------------------------
+
+    // logging
+    virtual void log(const logger::record &rec)
+    {
+      // swallow repetitions of the last record
+      if(m_has_last && rec.level==m_last.level && rec.text==m_last.text)
+      {
+        ++m_repeat_count;
+        m_last.time=rec.time;
+        return;
+      }
+
+      // report repetitions, then forward record
+      report_repetitions();
+      m_target->log(rec);
+      m_output_time=rec.time;
+      m_last=rec;
+      m_has_last=true;
+      m_repeat_count=0;
+    }
+    //----
+
+    virtual void flush()
+    {
+      // report ongoing repetitions at most once per second
+      if(m_last.time!=m_output_time)
+        report_repetitions();
+      m_target->flush();
+    }
+    //------------------------------------------------------------------------
+
+  private:
+    void report_repetitions()
+    {
+      if(!m_repeat_count)
+        return;
+      char buffer[64];
+      snprintf(buffer, 64, "Last message repeated %u times", m_repeat_count);
+      buffer[63]=0;
+      logger::record rec={m_last.level, m_last.time, buffer};
+      m_target->log(rec);
+      m_output_time=rec.time;
+      m_repeat_count=0;
+    }
+    //------------------------------------------------------------------------
+
+    std::shared_ptr<logger::target> m_target;
+    logger::record m_last;
+    bool m_has_last;
+    unsigned m_repeat_count;
+    time_t m_output_time;
+  };
+  //--------------------------------------------------------------------------
+
+
+  //==========================================================================
+  // rate_limited_target
+  //==========================================================================
+  class rate_limited_target: public logger::target
+  {
+  public:
+    // construction
+    rate_limited_target(std::shared_ptr<logger::target> target, unsigned max_records, unsigned interval_secs)
+      :m_target(target)
+      ,m_max_records(max_records)
+      ,m_interval_secs(interval_secs)
+      ,m_window_start(0)
+      ,m_count(0)
+      ,m_dropped(0)
+    {
+    }
+    //------------------------------------------------------------------------
+
+    // logging
+    virtual void log(const logger::record &rec)
+    {
+      // start new window, reporting dropped records of the last one
+      if(rec.time-m_window_start>=time_t(m_interval_secs))
+      {
+        if(m_dropped)
+        {
+          char buffer[64];
+          snprintf(buffer, 64, "Dropped %u log records", m_dropped);
+          buffer[63]=0;
+          logger::record summary={logger::level_warn, rec.time, buffer};
+          m_target->log(summary);
+        }
+        m_window_start=rec.time;
+        m_count=m_dropped=0;
+      }
+
+      // forward errors and records within budget
+      if(rec.level<logger::level_error && m_count>=m_max_records)
+      {
+        ++m_dropped;
+        return;
+      }
+      ++m_count;
+      m_target->log(rec);
+    }
+    //----
+
+    virtual void flush()
+    {
+      m_target->flush();
+    }
+    //------------------------------------------------------------------------
+
+  private:
+    std::shared_ptr<logger::target> m_target;
+    const unsigned m_max_records;
+    const unsigned m_interval_secs;
+    time_t m_window_start;
+    unsigned m_count;
+    unsigned m_dropped;
+  };
+  //--------------------------------------------------------------------------
+
+
   //==========================================================================
   // file_target
   //==========================================================================
@@ -89,8 +624,9 @@ namespace
   {
   public:
     // construction and destruction
-    file_target(const boost::filesystem::wpath &path)
-      :m_file(CreateFileW(path.string().c_str(), GENERIC_WRITE, FILE_SHARE_READ, 0, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL , 0))
+    file_target(const boost::filesystem::wpath &path, bool append=false)
+      :m_file(CreateFileW(path.string().c_str(), GENERIC_WRITE, FILE_SHARE_READ, 0, append ? OPEN_ALWAYS : CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL , 0))
+      ,m_size(0)
     {
       if(INVALID_HANDLE_VALUE==m_file)
       {
@@ -99,6 +635,10 @@ namespace
           ascii+=*iter<0x80 ? char(*iter) : '?';
         throw std::logic_error(str(boost::format("Unable to log to file '%1%'.") % ascii).c_str());
       }
+
+      // continue existing log
+      if(append)
+        m_size=SetFilePointer(m_file, 0, 0, FILE_END);
     }      
     //----
 
@@ -115,26 +655,45 @@ namespace
       std::string line=str(rec);
       line+="\r\n";
 
-      // write and flush
+      // write
       DWORD written=0;
       WriteFile(m_file, line.c_str(), static_cast<DWORD>(line.size()), &written, 0);
+      m_size+=written;
+    }
+    //----
+
+    virtual void flush()
+    {
       FlushFileBuffers(m_file);
     }
     //--------------------------------------------------------------------------
 
+    // accessors
+    unsigned long get_size() const
+    {
+      return m_size;
+    }
+    //--------------------------------------------------------------------------
+
   private:
     HANDLE m_file;
+    unsigned long m_size;
   };
 #else
   class file_target: public logger::target
   {
   public:
     // construction and destruction
-    file_target(const std::string &filename)
-      :m_file(std::fopen(filename.c_str(), "wb"))
+    file_target(const boost::filesystem::wpath &path, bool append=false)
+      :m_file(std::fopen(path.external_file_string().c_str(), append ? "ab" : "wb"))
+      ,m_size(0)
     {
       if(!m_file)
-        throw std::logic_error((boost::format("Unable to log to file '%s'.")%filename).str().c_str());
+        throw std::logic_error((boost::format("Unable to log to file '%s'.")%path.external_file_string()).str().c_str());
+
+      // continue existing log
+      if(append && 0==std::fseek(m_file, 0, SEEK_END))
+        m_size=std::ftell(m_file);
     }
     //----
 
@@ -151,16 +710,312 @@ namespace
       std::string line=str(rec);
       line+="\r\n";
 
-      // write and flush
+      // write
       std::fputs(line.c_str(), m_file);
+      m_size+=static_cast<unsigned long>(line.size());
+    }
+    //----
+
+    virtual void flush()
+    {
       std::fflush(m_file);
     }
     //--------------------------------------------------------------------------
 
+    // accessors
+    unsigned long get_size() const
+    {
+      return m_size;
+    }
+    //--------------------------------------------------------------------------
+
   private:
     std::FILE *m_file;
+    unsigned long m_size;
   };
 #endif
+  //--------------------------------------------------------------------------
+
+
+#ifdef LOGGER_ZLIB
+  //==========================================================================
+  // open_file()
+  //==========================================================================
+  std::FILE *open_file(const boost::filesystem::wpath &path, bool write)
+  {
+#ifdef _WIN32
+    return _wfopen(path.string().c_str(), write ? L"wb" : L"rb");
+#else
+    return std::fopen(path.external_file_string().c_str(), write ? "wb" : "rb");
+#endif
+  }
+  //--------------------------------------------------------------------------
+
+
+  //==========================================================================
+  // gzip_file()
+  //==========================================================================
+  bool gzip_file(const boost::filesystem::wpath &src_path, const boost::filesystem::wpath &dst_path)
+  {
+    // open files
+    std::FILE *src=open_file(src_path, false);
+    if(!src)
+      return false;
+    std::FILE *dst=open_file(dst_path, true);
+    if(!dst)
+    {
+      std::fclose(src);
+      return false;
+    }
+
+    // initialize deflate stream with gzip header
+    z_stream stream;
+    std::memset(&stream, 0, sizeof(stream));
+    bool ok=Z_OK==deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15+16, 8, Z_DEFAULT_STRATEGY);
+
+    // compress file
+    unsigned char in[16384], out[16384];
+    int flush=Z_NO_FLUSH;
+    while(ok && Z_FINISH!=flush)
+    {
+      stream.avail_in=static_cast<uInt>(std::fread(in, 1, sizeof(in), src));
+      stream.next_in=in;
+      flush=std::feof(src) || std::ferror(src) ? Z_FINISH : Z_NO_FLUSH;
+      do
+      {
+        stream.avail_out=sizeof(out);
+        stream.next_out=out;
+        deflate(&stream, flush);
+        const size_t size=sizeof(out)-stream.avail_out;
+        ok&=size==std::fwrite(out, 1, size, dst);
+      }
+      while(ok && !stream.avail_out);
+    }
+    deflateEnd(&stream);
+
+    // cleanup
+    ok&=!std::ferror(src);
+    std::fclose(src);
+    ok&=0==std::fclose(dst);
+    return ok;
+  }
+  //--------------------------------------------------------------------------
+#endif
+
+
+  //==========================================================================
+  // log_compressor
+  //
+  // Worker thread that shifts the generations of a rotated log file
+  // (log.txt.1 -> log.txt.2, ...) and moves the most recently rotated file
+  // to log.txt.1. With LOGGER_ZLIB, generations are gzipped (log.txt.1.gz).
+  //==========================================================================
+  class log_compressor
+  {
+  public:
+    // construction and destruction
+    log_compressor(const boost::filesystem::wpath &path, unsigned max_generations)
+      :m_path(path)
+      ,m_max_generations(max_generations)
+      ,m_pending(false)
+      ,m_stop(false)
+    {
+      m_thread.reset(new boost::thread(boost::bind(&log_compressor::run, this)));
+    }
+    //----
+
+    ~log_compressor()
+    {
+      // finish pending job and wait for worker thread
+      {
+        boost::mutex::scoped_lock lock(m_mutex);
+        m_stop=true;
+        m_wakeup.notify_one();
+      }
+      m_thread->join();
+    }
+    //------------------------------------------------------------------------
+
+    // compression
+    boost::filesystem::wpath get_rotated_path() const
+    {
+      return generation_path(0);
+    }
+    //----
+
+    bool is_busy()
+    {
+      boost::mutex::scoped_lock lock(m_mutex);
+      return m_pending;
+    }
+    //----
+
+    void compress_rotated_file()
+    {
+      boost::mutex::scoped_lock lock(m_mutex);
+      m_pending=true;
+      m_wakeup.notify_one();
+    }
+    //------------------------------------------------------------------------
+
+  private:
+    boost::filesystem::wpath generation_path(unsigned generation) const
+    {
+      std::wostringstream suffix;
+      suffix<<L"."<<generation;
+#ifdef LOGGER_ZLIB
+      if(generation)
+        suffix<<L".gz";
+#endif
+      return boost::filesystem::wpath(m_path.string()+suffix.str());
+    }
+    //----
+
+    void run()
+    {
+      for(;;)
+      {
+        // wait for job
+        {
+          boost::mutex::scoped_lock lock(m_mutex);
+          while(!m_pending && !m_stop)
+            m_wakeup.wait(lock);
+          if(!m_pending)
+            return;
+        }
+
+        // shift generations, dropping the oldest one, and compress rotated file
+        try
+        {
+          boost::filesystem::remove(generation_path(m_max_generations));
+          for(unsigned generation=m_max_generations; generation>1; --generation)
+            if(boost::filesystem::exists(generation_path(generation-1)))
+              boost::filesystem::rename(generation_path(generation-1), generation_path(generation));
+#ifdef LOGGER_ZLIB
+          if(m_max_generations && gzip_file(generation_path(0), generation_path(1)))
+            boost::filesystem::remove(generation_path(0));
+          else
+#endif
+          if(m_max_generations)
+            boost::filesystem::rename(generation_path(0), generation_path(1));
+          else
+            boost::filesystem::remove(generation_path(0));
+        }
+        catch(std::exception&)
+        {
+        }
+
+        // mark job as done
+        boost::mutex::scoped_lock lock(m_mutex);
+        m_pending=false;
+      }
+    }
+    //------------------------------------------------------------------------
+
+    const boost::filesystem::wpath m_path;
+    const unsigned m_max_generations;
+    boost::mutex m_mutex;
+    boost::condition m_wakeup;
+    bool m_pending;
+    bool m_stop;
+    std::auto_ptr<boost::thread> m_thread;
+  };
+  //--------------------------------------------------------------------------
+
+
+  //==========================================================================
+  // rotating_file_target
+  //==========================================================================
+  class rotating_file_target: public logger::target
+  {
+  public:
+    // construction
+    rotating_file_target(const boost::filesystem::wpath &path, unsigned long max_size, unsigned max_generations)
+      :m_path(path)
+      ,m_max_size(max_size)
+      ,m_rotation_size(max_size)
+      ,m_compressor(path, max_generations)
+    {
+      // compress file left over by an interrupted rotation
+      if(boost::filesystem::exists(m_compressor.get_rotated_path()))
+        m_compressor.compress_rotated_file();
+      m_file.reset(new file_target(path, true));
+    }
+    //------------------------------------------------------------------------
+
+    // logging
+    virtual void log(const logger::record &rec)
+    {
+      if(!m_file.get())
+        return;
+      m_file->log(rec);
+      if(m_file->get_size()>=m_rotation_size)
+        rotate();
+    }
+    //----
+
+    virtual void flush()
+    {
+      if(m_file.get())
+        m_file->flush();
+    }
+    //------------------------------------------------------------------------
+
+  private:
+    void rotate()
+    {
+      // keep writing while the previous generation is being compressed
+      if(m_compressor.is_busy())
+        return;
+
+      // move current file out of the way and start a new one
+      const boost::filesystem::wpath rotated_path=m_compressor.get_rotated_path();
+      bool is_rotated=false;
+      m_file.reset();
+      try
+      {
+        boost::filesystem::rename(m_path, rotated_path);
+        is_rotated=true;
+        m_file.reset(new file_target(m_path, true));
+        m_compressor.compress_rotated_file();
+        m_rotation_size=m_max_size;
+        return;
+      }
+      catch(std::exception&)
+      {
+      }
+
+      // keep writing to the current file and retry after another max_size
+      // bytes (logging to this target stops if the file can't be reopened)
+      try
+      {
+        boost::filesystem::wpath path=m_path;
+        if(is_rotated)
+        {
+          try
+          {
+            boost::filesystem::rename(rotated_path, m_path);
+          }
+          catch(std::exception&)
+          {
+            path=rotated_path;
+          }
+        }
+        m_file.reset(new file_target(path, true));
+        m_rotation_size=m_file->get_size()+m_max_size;
+      }
+      catch(std::exception&)
+      {
+      }
+    }
+    //------------------------------------------------------------------------
+
+    const boost::filesystem::wpath m_path;
+    const unsigned long m_max_size;
+    unsigned long m_rotation_size;
+    log_compressor m_compressor;
+    std::auto_ptr<file_target> m_file;
+  };
 }
 //----------------------------------------------------------------------------
 
@@ -181,12 +1036,16 @@ namespace
 
 void logger::debug(const char *text)
 {
+  if(!is_enabled(level_debug))
+    return;
   log_impl(level_debug, text);
 }
 //----
 
 void logger::debugf(const char *format, ...)
 {
+  if(!is_enabled(level_debug))
+    return;
   TEXTIFY(text, format);
   log_impl(level_debug, text);
 }
@@ -194,12 +1053,16 @@ void logger::debugf(const char *format, ...)
 
 void logger::info(const char *text)
 {
+  if(!is_enabled(level_info))
+    return;
   log_impl(level_info, text);
 }
 //----
 
 void logger::infof(const char *format, ...)
 {
+  if(!is_enabled(level_info))
+    return;
   TEXTIFY(text, format);
   log_impl(level_info, text);
 }
@@ -207,12 +1070,16 @@ void logger::infof(const char *format, ...)
 
 void logger::warn(const char *text)
 {
+  if(!is_enabled(level_warn))
+    return;
   log_impl(level_warn, text);
 }
 //----
 
 void logger::warnf(const char *format, ...)
 {
+  if(!is_enabled(level_warn))
+    return;
   TEXTIFY(text, format);
   log_impl(level_warn, text);
 }
@@ -220,28 +1087,104 @@ void logger::warnf(const char *format, ...)
 
 void logger::error(const char *text)
 {
+  if(!is_enabled(level_error))
+    return;
   log_impl(level_error, text);
 }
 //----
 
 void logger::errorf(const char *format, ...)
 {
+  if(!is_enabled(level_error))
+    return;
   TEXTIFY(text, format);
   log_impl(level_error, text);
 }
 //----------------------------------------------------------------------------
 
 
+//============================================================================
+// set_min_level(), get_min_level()
+//============================================================================
+logger::e_level logger::g_min_level=level_debug;
+//----
+
+void logger::set_min_level(e_level level)
+{
+  g_min_level=level;
+}
+//----
+
+logger::e_level logger::get_min_level()
+{
+  return g_min_level;
+}
+//----------------------------------------------------------------------------
+
+
 //============================================================================
 // add_target()
 //============================================================================
 void logger::add_target(std::shared_ptr<target> target)
 {
+  boost::mutex::scoped_lock lock(g_mutex);
   g_targets.push_back(target);
 }
 //----------------------------------------------------------------------------
 
 
+//============================================================================
+// set_async(), is_async(), flush()
+//============================================================================
+void logger::set_async(bool enable)
+{
+  // start writer thread, unless a concurrent caller installed one first
+  if(enable)
+  {
+    if(g_async_writer)
+      return;
+    std::auto_ptr<async_writer> writer(new async_writer);
+    if(atomic_cas_pointer(&g_async_writer, (async_writer*)0, writer.get()))
+      writer.release();
+    return;
+  }
+
+  // detach writer thread, wait for threads still pushing to it and let it
+  // drain its queue and stop
+  report_suppressed(true);
+  std::auto_ptr<async_writer> writer(atomic_exchange_pointer(&g_async_writer, (async_writer*)0));
+  while(atomic_load(&g_async_users))
+    boost::this_thread::yield();
+}
+//----
+
+bool logger::is_async()
+{
+  return 0!=g_async_writer;
+}
+//----
+
+void logger::flush()
+{
+  // wait for writer thread, if any
+  report_suppressed(true);
+  atomic_increment(&g_async_users);
+  if(async_writer *writer=g_async_writer)
+  {
+    writer->flush();
+    atomic_decrement(&g_async_users);
+    return;
+  }
+  atomic_decrement(&g_async_users);
+
+  // flush all targets
+  boost::mutex::scoped_lock lock(g_mutex);
+  for(targets::iterator iter=g_targets.begin(); iter!=g_targets.end(); ++iter)
+    (*iter)->flush();
+}
+//----------------------------------------------------------------------------
+
+
 //============================================================================
 // create_..._target()
 //============================================================================
@@ -261,6 +1204,24 @@ std::shared_ptr<logger::target> logger::create_file_target(const boost::filesyst
 {
   return std::shared_ptr<logger::target>(new file_target(path));
 }
+//----
+
+std::shared_ptr<logger::target> logger::create_rotating_file_target(const boost::filesystem::wpath &path, unsigned long max_size, unsigned max_generations)
+{
+  return std::shared_ptr<logger::target>(new rotating_file_target(path, max_size, max_generations));
+}
+//----
+
+std::shared_ptr<logger::target> logger::create_dedup_target(std::shared_ptr<target> target)
+{
+  return std::shared_ptr<logger::target>(new dedup_target(target));
+}
+//----
+
+std::shared_ptr<logger::target> logger::create_rate_limited_target(std::shared_ptr<target> target, unsigned max_records, unsigned interval_secs)
+{
+  return std::shared_ptr<logger::target>(new rate_limited_target(target, max_records, interval_secs));
+}
 //----------------------------------------------------------------------------
 
 
@@ -304,6 +1265,38 @@ std::string logger::str(const record &rec)
 //----------------------------------------------------------------------------
 
 
+//============================================================================
+// rate_limiter
+//============================================================================
+bool logger::rate_limiter::allow()
+{
+  // register limiter for report_suppressed()
+  if(!atomic_load(&is_registered) && atomic_cas(&is_registered, 0, 1))
+  {
+    boost::mutex::scoped_lock lock(g_limiters_mutex);
+    next=g_limiters;
+    g_limiters=this;
+  }
+
+  // start new window (only one caller wins the race)
+  const long now=long(time(0));
+  const long start=atomic_load(&window_start);
+  if(now-start>=interval_secs && atomic_cas(&window_start, start, now))
+  {
+    atomic_exchange(&count, 0);
+    if(const long num_suppressed=atomic_exchange(&suppressed, 0))
+      log_suppressed(num_suppressed);
+  }
+
+  // allow record if within budget
+  if(atomic_increment(&count)<=max_records)
+    return true;
+  atomic_increment(&suppressed);
+  return false;
+}
+//----------------------------------------------------------------------------
+
+
 //============================================================================
 // target
 //============================================================================
@@ -311,3 +1304,8 @@ logger::target::~target()
 {
 }
 //----------------------------------------------------------------------------
+
+void logger::target::flush()
+{
+}
+//----------------------------------------------------------------------------
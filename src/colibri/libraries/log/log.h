@@ -9,6 +9,27 @@
 #include <string>
 #include <memory>
 #include <boost/filesystem/path.hpp>
+
+// records below this level are compiled out (see LOG_DEBUGF() and LOG_INFOF())
+#ifndef LOGGER_MIN_LEVEL
+#ifdef NDEBUG
+#define LOGGER_MIN_LEVEL 1
+#else
+#define LOGGER_MIN_LEVEL 0
+#endif
+#endif
+
+// level-checked logging, skips argument evaluation and formatting when disabled
+#define LOG_DEBUGF(...) do { if(logger::is_enabled(logger::level_debug)) logger::debugf(__VA_ARGS__); } while(0)
+#define LOG_INFOF(...) do { if(logger::is_enabled(logger::level_info)) logger::infof(__VA_ARGS__); } while(0)
+
+// per-call-site rate limited logging (at most max_per_sec records per second),
+// the limiter is a constant-initialized aggregate, so that concurrent first
+// calls don't race on its construction
+#define LOG_WARNF_LIMITED(max_per_sec, ...) do { if(logger::is_enabled(logger::level_warn)) { static logger::rate_limiter s_log_limiter=LOGGER_RATE_LIMITER_INIT(max_per_sec, 1); if(s_log_limiter.allow()) logger::warnf(__VA_ARGS__); } } while(0)
+#define LOGGER_RATE_LIMITER_INIT(max_records, interval_secs) {max_records, interval_secs, 0, 0, 0, 0, 0}
+//----------------------------------------------------------------------------
+
 namespace logger
 {
 //----------------------------------------------------------------------------
@@ -16,6 +37,7 @@ namespace logger
 // interface:
 struct record;
 class target;
+struct rate_limiter;
 void debug(const char *text);
 void debugf(const char *format, ...);
 void info(const char *text);
@@ -25,9 +47,15 @@ void warnf(const char *format, ...);
 void error(const char *text);
 void errorf(const char *format, ...);
 void add_target(std::shared_ptr<target>);
+void set_async(bool enable);
+bool is_async();
+void flush();
 std::shared_ptr<target> create_debug_target();
 std::shared_ptr<target> create_stdout_target();
 std::shared_ptr<target> create_file_target(const boost::filesystem::wpath&);
+std::shared_ptr<target> create_rotating_file_target(const boost::filesystem::wpath&, unsigned long max_size, unsigned max_generations);
+std::shared_ptr<target> create_dedup_target(std::shared_ptr<target>);
+std::shared_ptr<target> create_rate_limited_target(std::shared_ptr<target>, unsigned max_records, unsigned interval_secs=1);
 //----------------------------------------------------------------------------
 
 
@@ -45,6 +73,11 @@ enum e_level
 //----
 
 const char *str(e_level level);
+bool is_enabled(e_level level);
+void set_min_level(e_level level);
+e_level get_min_level();
+const e_level compiled_min_level=e_level(LOGGER_MIN_LEVEL);
+extern e_level g_min_level;
 //--------------------------------------------------------------------------
 
 
@@ -75,8 +108,35 @@ public:
 
   // logging
   virtual void log(const record&)=0;
+  virtual void flush();
+};
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// rate_limiter
+//
+// Initialize with LOGGER_RATE_LIMITER_INIT(). Limiters register themselves
+// on first use, so that records suppressed in a final burst are reported by
+// the writer thread once the window has passed, or by flush().
+//============================================================================
+struct rate_limiter
+{
+  // limiting
+  bool allow();
+  //--------------------------------------------------------------------------
+
+  long max_records;
+  long interval_secs;
+  volatile long window_start;
+  volatile long count;
+  volatile long suppressed;
+  volatile long is_registered;
+  rate_limiter *next;
 };
 //----------------------------------------------------------------------------
 
 }
+
+#include "log.inl"
 #endif
@@ -0,0 +1,15 @@
+//============================================================================
+// log.inl: Light-weight logging library
+//
+// (c) 2006, Michael Walter
+//============================================================================
+
+
+//============================================================================
+// is_enabled()
+//============================================================================
+inline bool logger::is_enabled(e_level level)
+{
+  return level>=compiled_min_level && level>=g_min_level;
+}
+//----------------------------------------------------------------------------
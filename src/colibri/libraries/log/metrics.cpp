@@ -0,0 +1,258 @@
+//============================================================================
+// metrics.cpp: Latency histograms
+//
+// (c) 2006, Michael Walter
+//============================================================================
+
+#include "metrics.h"
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <boost/thread/mutex.hpp>
+#include <boost/ptr_container/ptr_map.hpp>
+#include <boost/format.hpp>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// <anonymous namespace>
+//============================================================================
+namespace
+{
+  //==========================================================================
+  // registry
+  //==========================================================================
+  struct registry
+  {
+    boost::mutex mutex;
+    boost::ptr_map<std::string, logger::latency_histogram> histograms;
+  };
+  //----
+
+  registry &get_registry()
+  {
+    // constructed on first use, as histograms are looked up during static initialization
+    static registry s_registry;
+    return s_registry;
+  }
+  //--------------------------------------------------------------------------
+
+
+  //==========================================================================
+  // get_bucket_bound(), get_bucket()
+  //==========================================================================
+  const unsigned num_bucket_bounds=64;
+  //----
+
+  unsigned long long get_bucket_bound(unsigned bucket)
+  {
+    // upper bound of each bucket in microseconds, growing by 25%
+    static unsigned long long s_bounds[num_bucket_bounds]={0};
+    if(!s_bounds[0])
+      for(unsigned i=0; i<num_bucket_bounds; ++i)
+        s_bounds[i]=(unsigned long long)std::ceil(std::pow(1.25, double(i)));
+    return s_bounds[bucket];
+  }
+  //----
+
+  unsigned get_bucket(unsigned long long us)
+  {
+    unsigned bucket=0;
+    while(bucket+1<num_bucket_bounds && us>get_bucket_bound(bucket))
+      ++bucket;
+    return bucket;
+  }
+  //--------------------------------------------------------------------------
+}
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// get_monotonic_time()
+//============================================================================
+unsigned long long logger::get_monotonic_time()
+{
+  // get time in microseconds
+#ifdef _WIN32
+  static LARGE_INTEGER s_frequency={0};
+  if(!s_frequency.QuadPart)
+    QueryPerformanceFrequency(&s_frequency);
+  LARGE_INTEGER counter;
+  QueryPerformanceCounter(&counter);
+  return (unsigned long long)(counter.QuadPart/s_frequency.QuadPart)*1000000+
+         (unsigned long long)(counter.QuadPart%s_frequency.QuadPart)*1000000/s_frequency.QuadPart;
+#else
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec*1000000+ts.tv_nsec/1000;
+#endif
+}
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// latency_summary
+//============================================================================
+std::string logger::str(const latency_summary &summary)
+{
+  return (boost::format("%1%: %2% samples, p50 %3$.2f ms, p95 %4$.2f ms, p99 %5$.2f ms, max %6$.2f ms")
+    % summary.name % summary.num_samples % (summary.p50/1000.0) % (summary.p95/1000.0) % (summary.p99/1000.0) % (summary.max/1000.0)).str();
+}
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// latency_histogram
+//============================================================================
+logger::latency_histogram::latency_histogram(const char *name)
+  :m_name(name)
+{
+  clear();
+}
+//----------------------------------------------------------------------------
+
+void logger::latency_histogram::add(unsigned long long us)
+{
+  boost::mutex::scoped_lock lock(get_registry().mutex);
+  ++m_counts[get_bucket(us)];
+  ++m_num_samples;
+  m_max=std::max(m_max, us);
+
+  // decay old samples once the window is full
+  if(++m_window_count>=window_size)
+  {
+    for(unsigned i=0; i<num_buckets; ++i)
+      m_counts[i]/=2;
+    m_window_count=0;
+  }
+}
+//----
+
+void logger::latency_histogram::reset()
+{
+  boost::mutex::scoped_lock lock(get_registry().mutex);
+  clear();
+}
+//----
+
+logger::latency_summary logger::latency_histogram::get_summary() const
+{
+  boost::mutex::scoped_lock lock(get_registry().mutex);
+  latency_summary summary;
+  summary.name=m_name.c_str();
+  summary.num_samples=m_num_samples;
+  summary.p50=get_percentile(50);
+  summary.p95=get_percentile(95);
+  summary.p99=get_percentile(99);
+  summary.max=m_max;
+  return summary;
+}
+//----------------------------------------------------------------------------
+
+void logger::latency_histogram::clear()
+{
+  std::fill(m_counts, m_counts+num_buckets, 0);
+  m_window_count=0;
+  m_num_samples=0;
+  m_max=0;
+}
+//----
+
+unsigned long long logger::latency_histogram::get_percentile(unsigned percent) const
+{
+  // find bucket containing the percentile, report its upper bound
+  unsigned long long total=0;
+  for(unsigned i=0; i<num_buckets; ++i)
+    total+=m_counts[i];
+  if(!total)
+    return 0;
+  const unsigned long long rank=(total*percent+99)/100;
+  unsigned long long count=0;
+  for(unsigned i=0; i<num_buckets; ++i)
+    if((count+=m_counts[i])>=rank)
+      return std::min(get_bucket_bound(i), m_max);
+  return m_max;
+}
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// get_histograms()
+//============================================================================
+namespace
+{
+  std::vector<logger::latency_histogram*> get_histograms()
+  {
+    // histograms are never destroyed, so they can be used outside of the lock
+    registry &reg=get_registry();
+    boost::mutex::scoped_lock lock(reg.mutex);
+    std::vector<logger::latency_histogram*> histograms;
+    for(boost::ptr_map<std::string, logger::latency_histogram>::iterator iter=reg.histograms.begin(); iter!=reg.histograms.end(); ++iter)
+      histograms.push_back(iter->second);
+    return histograms;
+  }
+}
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// get_latency_histogram()
+//============================================================================
+logger::latency_histogram &logger::get_latency_histogram(const char *name)
+{
+  // look up histogram, create it on first use
+  registry &reg=get_registry();
+  boost::mutex::scoped_lock lock(reg.mutex);
+  std::string key=name;
+  boost::ptr_map<std::string, latency_histogram>::iterator iter=reg.histograms.find(key);
+  if(iter==reg.histograms.end())
+    iter=reg.histograms.insert(key, new latency_histogram(name)).first;
+  return *iter->second;
+}
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// get_latency_summaries(), log_latency_summaries(), reset_latency_histograms()
+//============================================================================
+std::vector<logger::latency_summary> logger::get_latency_summaries()
+{
+  const std::vector<latency_histogram*> histograms=get_histograms();
+  std::vector<latency_summary> summaries;
+  for(std::vector<latency_histogram*>::const_iterator iter=histograms.begin(); iter!=histograms.end(); ++iter)
+    summaries.push_back((*iter)->get_summary());
+  return summaries;
+}
+//----
+
+void logger::log_latency_summaries(e_level level)
+{
+  if(!is_enabled(level))
+    return;
+  const std::vector<latency_summary> summaries=get_latency_summaries();
+  for(std::vector<latency_summary>::const_iterator iter=summaries.begin(); iter!=summaries.end(); ++iter)
+  {
+    const std::string text="Latency "+str(*iter);
+    switch(level)
+    {
+      case level_debug: debug(text.c_str()); break;
+      case level_info: info(text.c_str()); break;
+      case level_warn: warn(text.c_str()); break;
+      default: error(text.c_str()); break;
+    }
+  }
+}
+//----
+
+void logger::reset_latency_histograms()
+{
+  const std::vector<latency_histogram*> histograms=get_histograms();
+  for(std::vector<latency_histogram*>::const_iterator iter=histograms.begin(); iter!=histograms.end(); ++iter)
+    (*iter)->reset();
+}
+//----------------------------------------------------------------------------
@@ -0,0 +1,106 @@
+//============================================================================
+// metrics.h: Latency histograms
+//
+// (c) 2006, Michael Walter
+//============================================================================
+
+#ifndef LOG_METRICS_H
+#define LOG_METRICS_H
+#include "log.h"
+#include <vector>
+//----------------------------------------------------------------------------
+
+namespace logger
+{
+//----------------------------------------------------------------------------
+
+// interface:
+struct latency_summary;
+class latency_histogram;
+class scoped_latency;
+unsigned long long get_monotonic_time();
+latency_histogram &get_latency_histogram(const char *name);
+std::vector<latency_summary> get_latency_summaries();
+void log_latency_summaries(e_level level=level_info);
+void reset_latency_histograms();
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// latency_summary
+//============================================================================
+struct latency_summary
+{
+  const char *name;
+  unsigned long long num_samples; // since the last reset
+  unsigned long long p50, p95, p99, max; // in microseconds
+};
+//----
+
+std::string str(const latency_summary&);
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// latency_histogram
+//
+// Counts samples (in microseconds) in geometric buckets which are 25% wide,
+// so percentiles are reported with at most 25% error. Once a window of
+// samples has been collected all counts are halved, which makes the
+// percentiles follow recent behavior rather than the whole session.
+//============================================================================
+class latency_histogram
+{
+public:
+  // construction
+  latency_histogram(const char *name);
+  //--------------------------------------------------------------------------
+
+  // sampling
+  void add(unsigned long long us);
+  void reset();
+  latency_summary get_summary() const;
+  //--------------------------------------------------------------------------
+
+private:
+  latency_histogram(const latency_histogram&); // not implemented
+  void operator=(const latency_histogram&); // not implemented
+  enum {num_buckets=64, window_size=1024};
+  void clear();
+  unsigned long long get_percentile(unsigned percent) const;
+  //--------------------------------------------------------------------------
+
+  const std::string m_name;
+  unsigned m_counts[num_buckets];
+  unsigned m_window_count;
+  unsigned long long m_num_samples;
+  unsigned long long m_max;
+};
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// scoped_latency
+//============================================================================
+class scoped_latency
+{
+public:
+  // construction and destruction
+  inline scoped_latency(latency_histogram&);
+  inline ~scoped_latency();
+  //--------------------------------------------------------------------------
+
+private:
+  scoped_latency(const scoped_latency&); // not implemented
+  void operator=(const scoped_latency&); // not implemented
+  //--------------------------------------------------------------------------
+
+  latency_histogram &m_histogram;
+  const unsigned long long m_start;
+};
+//----------------------------------------------------------------------------
+
+}
+
+#include "metrics.inl"
+#endif
@@ -0,0 +1,22 @@
+//============================================================================
+// metrics.inl: Latency histograms
+//
+// (c) 2006, Michael Walter
+//============================================================================
+
+
+//============================================================================
+// scoped_latency
+//============================================================================
+logger::scoped_latency::scoped_latency(latency_histogram &histogram)
+  :m_histogram(histogram)
+  ,m_start(get_monotonic_time())
+{
+}
+//----
+
+logger::scoped_latency::~scoped_latency()
+{
+  m_histogram.add(get_monotonic_time()-m_start);
+}
+//----------------------------------------------------------------------------
@@ -0,0 +1,356 @@
+//============================================================================
+// trace.cpp: Binary structured tracing
+//
+// (c) 2006, Michael Walter
+//============================================================================
+
+#include "trace.h"
+#include "metrics.h"
+#include <ctime>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <boost/thread/mutex.hpp>
+#include <boost/format.hpp>
+#include <boost/filesystem/operations.hpp>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// <anonymous namespace>
+//============================================================================
+namespace
+{
+  // globals:
+  std::vector<const logger::trace_site*> g_sites;
+  std::shared_ptr<logger::trace_target> g_trace_target;
+  boost::mutex g_trace_mutex;
+  //--------------------------------------------------------------------------
+
+
+  //==========================================================================
+  // get_thread_id()
+  //==========================================================================
+  unsigned get_thread_id()
+  {
+#ifdef _WIN32
+    return GetCurrentThreadId();
+#else
+    return unsigned((unsigned long)pthread_self());
+#endif
+  }
+  //--------------------------------------------------------------------------
+
+
+  //==========================================================================
+  // trace_encoder
+  //==========================================================================
+  class trace_encoder
+  {
+  public:
+    // construction
+    trace_encoder()
+      :m_size(0)
+    {
+    }
+    //------------------------------------------------------------------------
+
+    // encoding
+    void put_u8(unsigned value)
+    {
+      if(m_size<buffer_size)
+        m_buffer[m_size++]=(unsigned char)value;
+    }
+    //----
+
+    void put_u16(unsigned value)
+    {
+      put_u8(value);
+      put_u8(value>>8);
+    }
+    //----
+
+    void put_u32(unsigned value)
+    {
+      put_u16(value&0xffff);
+      put_u16(value>>16);
+    }
+    //----
+
+    void put_u64(unsigned long long value)
+    {
+      put_u32(unsigned(value&0xffffffff));
+      put_u32(unsigned(value>>32));
+    }
+    //----
+
+    void put_string(const char *s)
+    {
+      const size_t len=s ? std::min<size_t>(std::strlen(s), logger::trace_max_string_length) : 0;
+      put_u16(unsigned(len));
+      for(size_t i=0; i<len; ++i)
+        put_u8((unsigned char)s[i]);
+    }
+    //----
+
+    void put_wstring(const wchar_t *s)
+    {
+      // store UTF-16, splitting code points beyond the BMP on platforms with 32-bit wchar_t
+      size_t len=0, num_units=0;
+      if(s)
+        for(; s[len] && num_units<logger::trace_max_string_length; ++len)
+          num_units+=unsigned(s[len])>0xffff ? 2 : 1;
+      put_u16(unsigned(num_units));
+      for(size_t i=0; i<len; ++i)
+      {
+        const unsigned c=unsigned(s[i]);
+        if(c>0xffff)
+        {
+          put_u16(0xd800+((c-0x10000)>>10));
+          put_u16(0xdc00+((c-0x10000)&0x3ff));
+        }
+        else
+          put_u16(c);
+      }
+    }
+    //----
+
+    void put_arg(const logger::trace_arg &arg)
+    {
+      put_u8(arg.type);
+      switch(arg.type)
+      {
+        case logger::trace_arg_int: put_u64((unsigned long long)arg.value.i); break;
+        case logger::trace_arg_uint: put_u64(arg.value.u); break;
+        case logger::trace_arg_float:
+        {
+          unsigned long long bits;
+          std::memcpy(&bits, &arg.value.f, sizeof(bits));
+          put_u64(bits);
+        } break;
+        case logger::trace_arg_string: put_string(arg.value.s); break;
+        case logger::trace_arg_wstring: put_wstring(arg.value.ws); break;
+      }
+    }
+    //------------------------------------------------------------------------
+
+    // accessors
+    const unsigned char *get_data() const
+    {
+      return m_buffer;
+    }
+    //----
+
+    size_t get_size() const
+    {
+      return m_size;
+    }
+    //----
+
+    bool is_truncated() const
+    {
+      return m_size==buffer_size;
+    }
+    //------------------------------------------------------------------------
+
+  private:
+    enum {buffer_size=8192};
+    unsigned char m_buffer[buffer_size];
+    size_t m_size;
+  };
+  //--------------------------------------------------------------------------
+
+
+  //==========================================================================
+  // register_site()
+  //==========================================================================
+  void register_site(logger::trace_site &site)
+  {
+    boost::mutex::scoped_lock lock(g_trace_mutex);
+    if(site.id)
+      return;
+    g_sites.push_back(&site);
+    site.id=long(g_sites.size());
+  }
+  //--------------------------------------------------------------------------
+}
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// trace_target
+//
+// Buffered trace file. Site records are written lazily ahead of the first
+// event that refers to them; once the file exceeds its size limit it is
+// moved to "<name>.old" and a fresh file is started.
+//============================================================================
+class logger::trace_target
+{
+public:
+  // construction and destruction
+  trace_target(const boost::filesystem::wpath &path, unsigned long max_size)
+    :m_path(path)
+    ,m_max_size(max_size)
+    ,m_file(0)
+  {
+    open();
+  }
+  //----
+
+  ~trace_target()
+  {
+    if(m_file)
+      std::fclose(m_file);
+  }
+  //--------------------------------------------------------------------------
+
+  // writing
+  void write(e_level level, const void *data, size_t size)
+  {
+    // write pending site records
+    if(!m_file)
+      return;
+    while(m_num_sites<g_sites.size())
+    {
+      const trace_site &site=*g_sites[m_num_sites++];
+      trace_encoder encoder;
+      encoder.put_u8(trace_tag_site);
+      encoder.put_u32(unsigned(site.id));
+      encoder.put_u32(site.line);
+      encoder.put_string(site.file);
+      encoder.put_string(site.format);
+      put(encoder.get_data(), encoder.get_size());
+    }
+
+    // write event and push errors to disk
+    put(data, size);
+    if(level>=level_error)
+      std::fflush(m_file);
+
+    // start over if the file grew too large
+    if(m_size>=m_max_size)
+    {
+      std::fclose(m_file);
+      m_file=0;
+      try
+      {
+        const boost::filesystem::wpath old_path(m_path.string()+L".old");
+        boost::filesystem::remove(old_path);
+        boost::filesystem::rename(m_path, old_path);
+      }
+      catch(std::exception&)
+      {
+      }
+      try
+      {
+        open();
+      }
+      catch(std::exception&)
+      {
+      }
+    }
+  }
+  //--------------------------------------------------------------------------
+
+private:
+  void open()
+  {
+    // open file
+#ifdef _WIN32
+    m_file=_wfopen(m_path.string().c_str(), L"wb");
+    if(!m_file)
+    {
+      std::string ascii;
+      for(std::wstring::const_iterator iter=m_path.string().begin(); iter!=m_path.string().end(); ++iter)
+        ascii+=*iter<0x80 ? char(*iter) : '?';
+      throw std::logic_error(str(boost::format("Unable to trace to file '%1%'.") % ascii).c_str());
+    }
+#else
+    m_file=std::fopen(m_path.external_file_string().c_str(), "wb");
+    if(!m_file)
+      throw std::logic_error((boost::format("Unable to trace to file '%s'.")%m_path.external_file_string()).str().c_str());
+#endif
+    std::setvbuf(m_file, 0, _IOFBF, 64*1024);
+    m_size=0;
+    m_num_sites=0;
+
+    // write header
+    trace_encoder encoder;
+    encoder.put_u32(trace_file_magic);
+    encoder.put_u32(trace_file_version);
+    encoder.put_u64((unsigned long long)std::time(0));
+    encoder.put_u64(logger::get_monotonic_time());
+    put(encoder.get_data(), encoder.get_size());
+  }
+  //----
+
+  void put(const void *data, size_t size)
+  {
+    m_size+=(unsigned long)std::fwrite(data, 1, size, m_file);
+  }
+  //--------------------------------------------------------------------------
+
+  const boost::filesystem::wpath m_path;
+  const unsigned long m_max_size;
+  std::FILE *m_file;
+  unsigned long m_size;
+  size_t m_num_sites;
+};
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// trace()
+//============================================================================
+bool logger::g_is_tracing=false;
+//----
+
+void logger::trace(e_level level, trace_site &site, const trace_arg *args, unsigned num_args)
+{
+  // assign site id on first use
+  if(!site.id)
+    register_site(site);
+
+  // encode event outside of the lock
+  trace_encoder encoder;
+  encoder.put_u8(trace_tag_event);
+  encoder.put_u8(level);
+  encoder.put_u64(logger::get_monotonic_time());
+  encoder.put_u32(get_thread_id());
+  encoder.put_u32(unsigned(site.id));
+  encoder.put_u8(num_args);
+  for(unsigned i=0; i<num_args; ++i)
+    encoder.put_arg(args[i]);
+  if(encoder.is_truncated())
+    return;
+
+  // write event
+  boost::mutex::scoped_lock lock(g_trace_mutex);
+  if(trace_target *target=g_trace_target.get())
+    target->write(level, encoder.get_data(), encoder.get_size());
+}
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// set_trace_target(), create_trace_file_target()
+//============================================================================
+void logger::set_trace_target(std::shared_ptr<trace_target> target)
+{
+  boost::mutex::scoped_lock lock(g_trace_mutex);
+  g_trace_target=target;
+  g_is_tracing=0!=target.get();
+}
+//----
+
+std::shared_ptr<logger::trace_target> logger::create_trace_file_target(const boost::filesystem::wpath &path, unsigned long max_size)
+{
+  return std::shared_ptr<trace_target>(new trace_target(path, max_size));
+}
+//----------------------------------------------------------------------------
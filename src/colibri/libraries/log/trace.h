@@ -0,0 +1,113 @@
+//============================================================================
+// trace.h: Binary structured tracing
+//
+// (c) 2006, Michael Walter
+//============================================================================
+
+#ifndef LOG_TRACE_H
+#define LOG_TRACE_H
+#include "log.h"
+
+// binary tracing, records the raw arguments which are formatted offline by
+// trace_decoder, e.g. LOG_TRACE(logger::level_info, "Found %u items for %S", num_items, term.c_str())
+// (the leading dummy argument keeps the array non-empty for formats without arguments)
+#define LOG_TRACE(level, format, ...) do { if(logger::is_tracing(level)) { static logger::trace_site s_trace_site={__FILE__, __LINE__, format, 0}; const logger::trace_arg trace_args[]={logger::trace_arg(0), __VA_ARGS__}; logger::trace(level, s_trace_site, trace_args+1, sizeof(trace_args)/sizeof(*trace_args)-1); } } while(0)
+//----------------------------------------------------------------------------
+
+namespace logger
+{
+//----------------------------------------------------------------------------
+
+// interface:
+struct trace_site;
+struct trace_arg;
+class trace_target;
+bool is_tracing(e_level level);
+void trace(e_level level, trace_site&, const trace_arg *args, unsigned num_args);
+void set_trace_target(std::shared_ptr<trace_target>);
+std::shared_ptr<trace_target> create_trace_file_target(const boost::filesystem::wpath&, unsigned long max_size);
+extern bool g_is_tracing;
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// trace file format
+//
+// All values are little-endian. The file starts with a header (magic,
+// version, wall clock time and monotonic time in microseconds at creation),
+// followed by site records (tag, id, line, file, format) and event records
+// (tag, level, monotonic time, thread id, site id, argument count, arguments).
+// Strings are stored with a 16-bit length prefix, wide strings as UTF-16.
+//============================================================================
+enum
+{
+  trace_file_magic=0x54424c43, // "CLBT"
+  trace_file_version=1,
+  trace_max_string_length=1024
+};
+//----
+
+enum e_trace_tag
+{
+  trace_tag_site='S',
+  trace_tag_event='E'
+};
+//----
+
+enum e_trace_arg_type
+{
+  trace_arg_int=1,
+  trace_arg_uint,
+  trace_arg_float,
+  trace_arg_string,
+  trace_arg_wstring
+};
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// trace_site
+//============================================================================
+struct trace_site
+{
+  const char *file;
+  unsigned line;
+  const char *format;
+  volatile long id; // assigned on first use
+};
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// trace_arg
+//============================================================================
+struct trace_arg
+{
+  // construction
+  inline trace_arg(int);
+  inline trace_arg(unsigned);
+  inline trace_arg(long);
+  inline trace_arg(unsigned long);
+  inline trace_arg(long long);
+  inline trace_arg(unsigned long long);
+  inline trace_arg(double);
+  inline trace_arg(const char*);
+  inline trace_arg(const wchar_t*);
+  //--------------------------------------------------------------------------
+
+  e_trace_arg_type type;
+  union
+  {
+    long long i;
+    unsigned long long u;
+    double f;
+    const char *s;
+    const wchar_t *ws;
+  } value;
+};
+//----------------------------------------------------------------------------
+
+}
+
+#include "trace.inl"
+#endif
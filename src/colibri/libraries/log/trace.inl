@@ -0,0 +1,82 @@
+//============================================================================
+// trace.inl: Binary structured tracing
+//
+// (c) 2006, Michael Walter
+//============================================================================
+
+
+//============================================================================
+// is_tracing()
+//============================================================================
+inline bool logger::is_tracing(e_level level)
+{
+  return g_is_tracing && level>=compiled_min_level;
+}
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// trace_arg
+//============================================================================
+logger::trace_arg::trace_arg(int i)
+  :type(trace_arg_int)
+{
+  value.i=i;
+}
+//----
+
+logger::trace_arg::trace_arg(unsigned u)
+  :type(trace_arg_uint)
+{
+  value.u=u;
+}
+//----
+
+logger::trace_arg::trace_arg(long i)
+  :type(trace_arg_int)
+{
+  value.i=i;
+}
+//----
+
+logger::trace_arg::trace_arg(unsigned long u)
+  :type(trace_arg_uint)
+{
+  value.u=u;
+}
+//----
+
+logger::trace_arg::trace_arg(long long i)
+  :type(trace_arg_int)
+{
+  value.i=i;
+}
+//----
+
+logger::trace_arg::trace_arg(unsigned long long u)
+  :type(trace_arg_uint)
+{
+  value.u=u;
+}
+//----
+
+logger::trace_arg::trace_arg(double f)
+  :type(trace_arg_float)
+{
+  value.f=f;
+}
+//----
+
+logger::trace_arg::trace_arg(const char *s)
+  :type(trace_arg_string)
+{
+  value.s=s;
+}
+//----
+
+logger::trace_arg::trace_arg(const wchar_t *ws)
+  :type(trace_arg_wstring)
+{
+  value.ws=ws;
+}
+//----------------------------------------------------------------------------
@@ -5,17 +5,37 @@
 //============================================================================
 
 #include "gfx.h"
+#include "icon_store.h"
 #include "../core/dynlib.h"
 #include "../log/log.h"
 #include "../../core/defs.h"
 #include <hash_map>
 #include <vector>
+#include <deque>
+#include <list>
 #include <sstream>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition.hpp>
+#include <boost/bind.hpp>
 #pragma comment(lib, "gdiplus.lib")
 #define SHIL_LARGE          0   // normally 32x32
 #define SHIL_SMALL          1   // normally 16x16
 #define SHIL_EXTRALARGE     2
 #define SHIL_SYSSMALL       3   // like SHIL_SMALL, but tracks system small icon metric correctly
+struct UPDATELAYEREDWINDOWINFO_VISTA // UPDATELAYEREDWINDOWINFO requires _WIN32_WINNT>=0x0600
+{
+  DWORD cbSize;
+  HDC hdcDst;
+  const POINT *pptDst;
+  const SIZE *psize;
+  HDC hdcSrc;
+  const POINT *pptSrc;
+  COLORREF crKey;
+  const BLENDFUNCTION *pblend;
+  DWORD dwFlags;
+  const RECT *prcDirty;
+};
 extern "C" const IID IID_IImageList;
 using namespace std;
 using namespace stdext;
@@ -45,9 +65,220 @@ namespace
   //--------------------------------------------------------------------------
 
   // container types
-  typedef hash_map<wstring, std::shared_ptr<image> > image_hash;
-  typedef hash_map<icon_info, std::shared_ptr<icon>, icon_hash_traits> icon_hash;
-  typedef vector<DWORD*> hicon_bytes;
+  typedef hash_map<icon_info, bool, icon_hash_traits> icon_set;
+  typedef hash_map<icon_info, HANDLE, icon_hash_traits> icon_thread_map;
+  //--------------------------------------------------------------------------
+
+  // image memory accounting
+  unsigned long get_image_size(const std::shared_ptr<image> &image)
+  {
+    return image ? image->GetWidth()*image->GetHeight()*4 : 0;
+  }
+  //----
+
+  unsigned long get_sprite_size(const std::shared_ptr<sprite> &s)
+  {
+    return s ? s->rect.width*s->rect.height*4 : 0;
+  }
+  //----
+
+  // deleter for bitmaps created from icon bytes
+  struct hicon_image_deleter
+  {
+    hicon_image_deleter(DWORD *bytes)
+      :bytes(bytes)
+    {
+    }
+
+    void operator()(image *image) const
+    {
+      delete image;
+      delete []bytes;
+    }
+
+    DWORD *bytes;
+  };
+  //--------------------------------------------------------------------------
+
+  // deleter for sprites in the icon atlas
+  class gfx_backend;
+  struct icon_sprite_deleter
+  {
+    icon_sprite_deleter(gfx_backend &backend)
+      :backend(&backend)
+    {
+    }
+
+    void operator()(sprite*) const;
+
+    gfx_backend *backend;
+  };
+  //--------------------------------------------------------------------------
+
+
+  //==========================================================================
+  // lru_cache
+  //
+  // Byte-accounted cache. Every use stamps the entry with the caller's tick,
+  // so that the least recently used entry of several caches can be evicted.
+  // Pinned entries are never evicted and don't count against the budget.
+  //==========================================================================
+  template<typename Key, typename Value, typename Traits=hash_compare<Key, less<Key> > >
+  class lru_cache
+  {
+  public:
+    // construction
+    lru_cache()
+      :m_size(0)
+      ,m_pinned_size(0)
+      ,m_hits(0)
+      ,m_misses(0)
+      ,m_evictions(0)
+    {
+    }
+    //------------------------------------------------------------------------
+
+    // lookup and insertion
+    Value lookup(const Key &key, unsigned long tick)
+    {
+      typename entries::iterator iter=m_entries.find(key);
+      if(iter==m_entries.end())
+      {
+        ++m_misses;
+        return Value();
+      }
+      ++m_hits;
+      touch(iter->second, tick);
+      return iter->second.value;
+    }
+    //----
+
+    bool contains(const Key &key) const
+    {
+      // doesn't count as a use
+      return m_entries.find(key)!=m_entries.end();
+    }
+    //----
+
+    void insert(const Key &key, const Value &value, unsigned long size, bool pinned, unsigned long tick)
+    {
+      erase(key);
+      entry &e=m_entries[key];
+      e.value=value;
+      e.size=size;
+      e.pinned=pinned;
+      if(pinned)
+        m_pinned_size+=size;
+      else
+      {
+        m_size+=size;
+        e.use_pos=m_uses.insert(m_uses.begin(), use(key, tick));
+      }
+    }
+    //----
+
+    void pin(const Key &key)
+    {
+      typename entries::iterator iter=m_entries.find(key);
+      if(iter==m_entries.end() || iter->second.pinned)
+        return;
+      entry &e=iter->second;
+      m_uses.erase(e.use_pos);
+      m_size-=e.size;
+      m_pinned_size+=e.size;
+      e.pinned=true;
+    }
+    //----
+
+    void clear()
+    {
+      m_entries.clear();
+      m_uses.clear();
+      m_size=m_pinned_size=0;
+    }
+    //------------------------------------------------------------------------
+
+    // eviction
+    bool is_evictable() const
+    {
+      return !m_uses.empty();
+    }
+    //----
+
+    unsigned long get_oldest_tick() const
+    {
+      return m_uses.back().second;
+    }
+    //----
+
+    void evict_oldest()
+    {
+      erase(m_uses.back().first);
+      ++m_evictions;
+    }
+    //------------------------------------------------------------------------
+
+    // statistics
+    size_t get_num_entries() const {return m_entries.size();}
+    unsigned long get_size() const {return m_size;}
+    unsigned long get_pinned_size() const {return m_pinned_size;}
+    unsigned long get_num_hits() const {return m_hits;}
+    unsigned long get_num_misses() const {return m_misses;}
+    unsigned long get_num_evictions() const {return m_evictions;}
+    //------------------------------------------------------------------------
+
+  private:
+    typedef pair<Key, unsigned long> use;
+    typedef list<use> uses;
+    struct entry
+    {
+      Value value;
+      unsigned long size;
+      bool pinned;
+      typename uses::iterator use_pos;
+    };
+    typedef hash_map<Key, entry, Traits> entries;
+    //------------------------------------------------------------------------
+
+    void touch(entry &e, unsigned long tick)
+    {
+      if(e.pinned)
+        return;
+      e.use_pos->second=tick;
+      m_uses.splice(m_uses.begin(), m_uses, e.use_pos);
+    }
+    //----
+
+    void erase(const Key &key)
+    {
+      typename entries::iterator iter=m_entries.find(key);
+      if(iter==m_entries.end())
+        return;
+      entry &e=iter->second;
+      if(e.pinned)
+        m_pinned_size-=e.size;
+      else
+      {
+        m_size-=e.size;
+        m_uses.erase(e.use_pos);
+      }
+      m_entries.erase(iter);
+    }
+    //------------------------------------------------------------------------
+
+    entries m_entries;
+    uses m_uses; // most recently used first
+    unsigned long m_size, m_pinned_size;
+    unsigned long m_hits, m_misses, m_evictions;
+  };
+  //--------------------------------------------------------------------------
+
+  // icon loading request
+  struct icon_request
+  {
+    icon_info info;
+    wstring fallback_name;
+  };
   //--------------------------------------------------------------------------
 
   //==========================================================================
@@ -66,63 +297,246 @@ namespace
 
     ~gfx_backend()
     {
-      // clear cache
+      // stop icon loaders
+      {
+        boost::mutex::scoped_lock lock(m_mutex);
+        m_stop_loaders=true;
+        m_requests.clear();
+        m_prefetch_requests.clear();
+      }
+      m_request_available.notify_all();
+      m_loaders.join_all();
+
+      // clear cache and save icon store
       clear_cache();
+      m_icon_store.reset();
 
       // shutdown gdi+
       Gdiplus::GdiplusShutdown(m_gdi_plus);
     }
     //------------------------------------------------------------------------
 
-    // theme hack
+    // theme hack (read by icon loaders)
     void set_current_theme(const std::wstring &name)
     {
+      boost::mutex::scoped_lock lock(m_mutex);
       m_current_theme=name;
     }
 
-    const std::wstring &current_theme() const
+    std::wstring current_theme()
     {
+      boost::mutex::scoped_lock lock(m_mutex);
       return m_current_theme;
     }
     //------------------------------------------------------------------------
 
     // cache management
-    std::shared_ptr<image> lookup_image(const wstring &filename)
+    std::shared_ptr<image> lookup_image(const wstring &filename, bool pin)
     {
-      image_hash::iterator iter=m_images.find(filename);
-      return iter==m_images.end() ? std::shared_ptr<image>() : iter->second;
+      boost::mutex::scoped_lock lock(m_mutex);
+      std::shared_ptr<image> image=m_images.lookup(filename, ++m_tick);
+      if(image && pin)
+        m_images.pin(filename);
+      return image;
     }
     //----
 
     std::shared_ptr<icon> lookup_icon(const icon_info &info)
     {
-      icon_hash::iterator iter=m_icons.find(info);
-      return iter==m_icons.end() ? std::shared_ptr<icon>() : iter->second;
+      boost::mutex::scoped_lock lock(m_mutex);
+      return m_icons.lookup(info, ++m_tick);
     }
     //----
 
-    void cache_image(const wstring &filename, std::shared_ptr<image> image)
+    void cache_image(const wstring &filename, std::shared_ptr<image> image, bool pin)
     {
-      m_images[filename]=image;
+      const unsigned long size=get_image_size(image);
+      boost::mutex::scoped_lock lock(m_mutex);
+      m_images.insert(filename, image, size, pin, ++m_tick);
+      trim_cache();
     }
     //----
 
     void cache_icon(const icon_info &info, std::shared_ptr<icon> icon)
     {
-      m_icons[info]=icon;
+      // packed icons are charged for their atlas pixels (the fallback icon
+      // cached for failed icons only once), unpacked images of file and theme
+      // icons are accounted for by the image cache
+      unsigned long size=0;
+      if(info.source==icon->info.source && info.path==icon->info.path)
+      {
+        if(icon->sprite_32 || icon->sprite_48)
+          size=get_sprite_size(icon->sprite_32)+get_sprite_size(icon->sprite_48);
+        else if(icon_source_file!=info.source && icon_source_theme!=info.source)
+          size=get_image_size(icon->icon_32)+get_image_size(icon->icon_48);
+      }
+
+      // insert icon
+      boost::mutex::scoped_lock lock(m_mutex);
+      m_icons.insert(info, icon, size, false, ++m_tick);
+      trim_cache();
     }
     //----
 
     void clear_cache()
     {
-      // clear images and icons
+      boost::mutex::scoped_lock lock(m_mutex);
       m_images.clear();
       m_icons.clear();
+    }
+    //----
+
+    void set_max_cache_size(unsigned long max_size)
+    {
+      boost::mutex::scoped_lock lock(m_mutex);
+      m_max_cache_size=max_size;
+      trim_cache();
+    }
+    //----
+
+    void set_icon_store(const boost::filesystem::wpath &path)
+    {
+      boost::mutex::scoped_lock lock(m_mutex);
+      if(!m_icon_store.get() || m_icon_store->get_path()!=path)
+        m_icon_store.reset(new icon_store(path));
+    }
+    //----
+
+    icon_store *get_icon_store()
+    {
+      boost::mutex::scoped_lock lock(m_mutex);
+      return m_icon_store.get();
+    }
+    //----
+
+    icon_cache_stats get_cache_stats()
+    {
+      boost::mutex::scoped_lock lock(m_mutex);
+      icon_cache_stats stats;
+      stats.num_images=m_images.get_num_entries();
+      stats.num_icons=m_icons.get_num_entries();
+      stats.size=m_images.get_size()+m_icons.get_size();
+      stats.pinned_size=m_images.get_pinned_size()+m_icons.get_pinned_size();
+      stats.max_size=m_max_cache_size;
+      stats.num_hits=m_images.get_num_hits()+m_icons.get_num_hits();
+      stats.num_misses=m_images.get_num_misses()+m_icons.get_num_misses();
+      stats.num_evictions=m_images.get_num_evictions()+m_icons.get_num_evictions();
+      boost::mutex::scoped_lock atlas_lock(m_atlas_mutex);
+      stats.atlas_size=m_icon_atlas.get_size();
+      return stats;
+    }
+    //------------------------------------------------------------------------
+
+    // icon atlas
+    void pack_icon(icon &icon)
+    {
+      // convert icons to premultiplied pixels outside of the atlas lock (icons
+      // failing to convert are painted by GDI+), images from the image cache
+      // are shared between threads, so GDI+ access to them is serialized
+      surface pixels_32(32, 32), pixels_48(48, 48);
+      try
+      {
+        boost::mutex::scoped_lock image_lock(m_image_mutex);
+        image_to_surface(*icon.icon_32, pixels_32);
+        image_to_surface(*icon.icon_48, pixels_48);
+      }
+      catch(std::exception &e_)
+      {
+        LOG_WARNF_LIMITED(10, "Unable to pack icon %S into atlas: %s", icon.info.path.c_str(), e_.what());
+        return;
+      }
+
+      // add them to the atlas and release the images, which are only painted
+      // if the icon couldn't be packed
+      {
+        boost::mutex::scoped_lock lock(m_atlas_mutex);
+        icon.sprite_32.reset(new sprite(m_icon_atlas.add(pixels_32)), icon_sprite_deleter(*this));
+        icon.sprite_48.reset(new sprite(m_icon_atlas.add(pixels_48)), icon_sprite_deleter(*this));
+      }
+      icon.icon_32.reset();
+      icon.icon_48.reset();
+    }
+    //----
+
+    void draw_icon(Gdiplus::Graphics &graphics, int x, int y, const icon &icon, unsigned size)
+    {
+      boost::mutex::scoped_lock lock(m_image_mutex);
+      graphics.DrawImage((48==size ? icon.icon_48 : icon.icon_32).get(), x, y, size, size);
+    }
+    //----
+
+    void remove_sprite(const sprite &s)
+    {
+      boost::mutex::scoped_lock lock(m_atlas_mutex);
+      m_icon_atlas.remove(s);
+    }
+    //----
+
+    void blend_sprite(surface &dst, int x, int y, const sprite &s, const pixel_rect &clip)
+    {
+      boost::mutex::scoped_lock lock(m_atlas_mutex);
+      m_icon_atlas.blend(dst, x, y, s, clip);
+    }
+    //------------------------------------------------------------------------
+
+    // asynchronous icon loading
+    void request_icon(const icon_info &info, const wstring &fallback_name)
+    {
+      // queue request unless the icon is being loaded already (possibly by a
+      // prefetch, which then has to notify the gui as well)
+      {
+        boost::mutex::scoped_lock lock(m_mutex);
+        icon_set::iterator iter=m_pending_icons.find(info);
+        if(iter!=m_pending_icons.end())
+        {
+          // the gui waits for a prefetched icon now, so raise its loader back
+          // to normal priority
+          iter->second=true;
+          icon_thread_map::iterator thread=m_prefetching_loaders.find(info);
+          if(thread!=m_prefetching_loaders.end())
+          {
+            SetThreadPriority(thread->second, THREAD_PRIORITY_NORMAL);
+            m_prefetching_loaders.erase(thread);
+          }
+          return;
+        }
+        m_pending_icons[info]=true;
+        icon_request request;
+        request.info=info;
+        request.fallback_name=fallback_name;
+        m_requests.push_back(request);
+      }
+      m_request_available.notify_one();
+    }
+    //----
+
+    void prefetch_icons(const vector<icon_info> &infos, const wstring &fallback_name)
+    {
+      // replace previous prefetch requests, skipping cached and pending icons
+      {
+        boost::mutex::scoped_lock lock(m_mutex);
+        m_prefetch_requests.clear();
+        for(vector<icon_info>::const_iterator iter=infos.begin(); iter!=infos.end(); ++iter)
+        {
+          if(icon_source_theme==iter->source || m_icons.contains(*iter) || m_pending_icons.find(*iter)!=m_pending_icons.end())
+            continue;
+          icon_request request;
+          request.info=*iter;
+          request.fallback_name=fallback_name;
+          m_prefetch_requests.push_back(request);
+        }
+        if(m_prefetch_requests.empty())
+          return;
+      }
+      m_request_available.notify_all();
+    }
+    //----
 
-      // clear HICON bytes
-      for(hicon_bytes::iterator iter=m_hicon_bytes.begin(); iter!=m_hicon_bytes.end(); ++iter)
-        delete []*iter;
-      m_hicon_bytes.clear();
+    void set_notify_window(HWND window, UINT msg)
+    {
+      boost::mutex::scoped_lock lock(m_mutex);
+      m_notify_window=window;
+      m_notify_msg=msg;
     }
     //------------------------------------------------------------------------
 
@@ -142,7 +556,7 @@ namespace
 
         // convert 32x32 icon
         if(!hicon_32)
-          logger::warnf("Unable to get 32x32 icon for %S at index %u of system image list", filename.c_str(), info.iIcon);
+          LOG_WARNF_LIMITED(10, "Unable to get 32x32 icon for %S at index %u of system image list", filename.c_str(), info.iIcon);
         else
         {
           icon_32=convert_hicon(hicon_32);
@@ -151,7 +565,7 @@ namespace
 
         // convert 48x48 icon
         if(!hicon_48)
-          logger::warnf("Unable to get 48x48 icon for %S at index %u of system image list", filename.c_str(), info.iIcon);
+          LOG_WARNF_LIMITED(10, "Unable to get 48x48 icon for %S at index %u of system image list", filename.c_str(), info.iIcon);
         else
         {
           icon_48=convert_hicon(hicon_48);
@@ -171,7 +585,7 @@ namespace
 
         // convert 32x32 icon
         if(!hicon_32)
-          logger::warnf("Unable to get 32x32 icon for %S at index %u of system image list", filename.c_str(), info.iIcon);
+          LOG_WARNF_LIMITED(10, "Unable to get 32x32 icon for %S at index %u of system image list", filename.c_str(), info.iIcon);
         {
           icon_32=convert_hicon(hicon_32);
           icon_48=convert_hicon(hicon_32);
@@ -201,7 +615,7 @@ namespace
       applet(0, CPL_NEWINQUIRE, index, reinterpret_cast<LPARAM>(&info));
       if(!info.hIcon)
       {
-        logger::warnf("Unable to get icon for %S#%u", filename.c_str(), index);
+        LOG_WARNF_LIMITED(10, "Unable to get icon for %S#%u", filename.c_str(), index);
         return;
       }
 
@@ -241,10 +655,10 @@ namespace
       HICON hicon_32=reinterpret_cast<HICON>(LoadImage(lib.get_hmodule(), MAKEINTRESOURCE(id), IMAGE_ICON, 32, 32, LR_DEFAULTCOLOR));
       if(!hicon_32)
       {
-        logger::warnf("Unable to get 32x32 icon in %S with id %u, trying 16x16", filename.c_str(), id);
+        LOG_WARNF_LIMITED(10, "Unable to get 32x32 icon in %S with id %u, trying 16x16", filename.c_str(), id);
         hicon_32=reinterpret_cast<HICON>(LoadImage(lib.get_hmodule(), MAKEINTRESOURCE(id), IMAGE_ICON, 16, 16, LR_DEFAULTCOLOR));
         if(!hicon_32)
-          logger::warnf("Unable to get 16x16 icon either", filename.c_str(), id);
+          LOG_WARNF_LIMITED(10, "Unable to get 16x16 icon either", filename.c_str(), id);
       }
 
       // convert 32x32 icon
@@ -258,14 +672,14 @@ namespace
       HICON hicon_48=reinterpret_cast<HICON>(LoadImage(lib.get_hmodule(), MAKEINTRESOURCE(id), IMAGE_ICON, 48, 48, LR_DEFAULTCOLOR));
       if(!hicon_48)
       {
-        logger::warnf("Unable to get 48x48 icon in %S with id %u, trying 32x32", filename.c_str(), id);
+        LOG_WARNF_LIMITED(10, "Unable to get 48x48 icon in %S with id %u, trying 32x32", filename.c_str(), id);
         hicon_48=reinterpret_cast<HICON>(LoadImage(lib.get_hmodule(), MAKEINTRESOURCE(id), IMAGE_ICON, 32, 32, LR_DEFAULTCOLOR));
         if(!hicon_48)
         {
-          logger::warnf("Unable to get 32x32 icon in %S with id %u, trying 16x16", filename.c_str(), id);
+          LOG_WARNF_LIMITED(10, "Unable to get 32x32 icon in %S with id %u, trying 16x16", filename.c_str(), id);
           hicon_48=reinterpret_cast<HICON>(LoadImage(lib.get_hmodule(), MAKEINTRESOURCE(id), IMAGE_ICON, 16, 16, LR_DEFAULTCOLOR));
           if(!hicon_48)
-            logger::warnf("Unable to get 16x16 icon either", filename.c_str(), id);
+            LOG_WARNF_LIMITED(10, "Unable to get 16x16 icon either", filename.c_str(), id);
         }
       }
 
@@ -300,7 +714,6 @@ namespace
       {
         // alloce buffer and fill icon bytes
         DWORD *bytes=new DWORD[bmp.bmWidth*bmp.bmHeight];
-        m_hicon_bytes.push_back(bytes);
         GetBitmapBits(info.hbmColor, bmp.bmWidthBytes*bmp.bmHeight, bytes);
 
         // determine whether icon has an alpha channel
@@ -317,7 +730,9 @@ namespace
 
         // if icon has an alpha channel, create bitmap from memory buffer (so that we get proper transparency)
         if(has_alpha)
-          image.reset(new Gdiplus::Bitmap(bmp.bmWidth, bmp.bmHeight, bmp.bmWidthBytes, PixelFormat32bppARGB, reinterpret_cast<BYTE*>(bytes)));
+          image.reset(new Gdiplus::Bitmap(bmp.bmWidth, bmp.bmHeight, bmp.bmWidthBytes, PixelFormat32bppARGB, reinterpret_cast<BYTE*>(bytes)), hicon_image_deleter(bytes));
+        else
+          delete []bytes;
       }
 
       // create image the default way
@@ -337,6 +752,11 @@ namespace
     gfx_backend()
       :m_image_list_32(0)
       ,m_image_list_48(0)
+      ,m_notify_window(0)
+      ,m_notify_msg(0)
+      ,m_stop_loaders(false)
+      ,m_tick(0)
+      ,m_max_cache_size(32*1024*1024)
     {
       // initialize gdi+
       Gdiplus::GdiplusStartupInput input;
@@ -365,16 +785,151 @@ namespace
         if(FAILED(sgil(SHIL_EXTRALARGE, IID_IImageList, reinterpret_cast<void**>(&m_image_list_48))))
           throw runtime_error("Unable to get 48x48 shell image list.");
       }
+
+      // start icon loaders
+      for(unsigned i=0; i<num_icon_loaders; ++i)
+        m_loaders.create_thread(boost::bind(&gfx_backend::icon_loader, this));
     }
     //------------------------------------------------------------------------
 
+    void icon_loader()
+    {
+      // shell functions require COM, the thread handle is used by
+      // request_icon() to raise the priority of prefetches
+      CoInitializeEx(0, COINIT_APARTMENTTHREADED);
+      HANDLE thread=OpenThread(THREAD_SET_INFORMATION, FALSE, GetCurrentThreadId());
+      for(;;)
+      {
+        // wait for request, serving visible icons before prefetched ones
+        icon_request request;
+        bool is_prefetch=false;
+        {
+          boost::mutex::scoped_lock lock(m_mutex);
+          for(;;)
+          {
+            while(!m_stop_loaders && m_requests.empty() && m_prefetch_requests.empty())
+              m_request_available.wait(lock);
+            if(m_stop_loaders)
+              break;
+            if(!m_requests.empty())
+            {
+              request=m_requests.front();
+              m_requests.pop_front();
+              break;
+            }
+            request=m_prefetch_requests.front();
+            m_prefetch_requests.pop_front();
+            if(m_icons.contains(request.info) || m_pending_icons.find(request.info)!=m_pending_icons.end())
+              continue;
+            m_pending_icons[request.info]=false;
+            is_prefetch=true;
+
+            // prefetching must not compete with the gui (the priority is set
+            // under the lock, so that request_icon() can't miss it)
+            SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_IDLE);
+            if(thread)
+              m_prefetching_loaders[request.info]=thread;
+            break;
+          }
+          if(m_stop_loaders)
+            break;
+        }
+
+        // load icon, falling back to the theme's fallback icon on errors
+        try
+        {
+          ::load_icon(request.info, request.fallback_name);
+        }
+        catch(std::exception &e_)
+        {
+          LOG_WARNF_LIMITED(10, "Unable to load icon %S: %s", request.info.path.c_str(), e_.what());
+          try
+          {
+            cache_icon(request.info, ::load_icon(icon_info(icon_source_theme, request.fallback_name), request.fallback_name));
+          }
+          catch(std::exception&)
+          {
+          }
+        }
+
+        if(is_prefetch)
+          SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_NORMAL);
+
+        // notify gui unless the icon was only prefetched
+        boost::mutex::scoped_lock lock(m_mutex);
+        icon_set::iterator iter=m_pending_icons.find(request.info);
+        const bool notify=iter!=m_pending_icons.end() && iter->second;
+        if(iter!=m_pending_icons.end())
+          m_pending_icons.erase(iter);
+        m_prefetching_loaders.erase(request.info);
+        if(notify && m_notify_window)
+          PostMessage(m_notify_window, m_notify_msg, 0, 0);
+
+        // write extracted icons to the icon store once there is nothing left to load
+        const bool is_idle=m_requests.empty() && m_prefetch_requests.empty();
+        icon_store *store=m_icon_store.get();
+        lock.unlock();
+        if(is_idle && store)
+          store->flush();
+      }
+      if(thread)
+        CloseHandle(thread);
+      CoUninitialize();
+    }
+    //------------------------------------------------------------------------
+
+    void trim_cache()
+    {
+      // evict least recently used images and icons until we're within budget
+      while(m_images.get_size()+m_icons.get_size()>m_max_cache_size)
+      {
+        if(m_images.is_evictable() && (!m_icons.is_evictable() || m_images.get_oldest_tick()<m_icons.get_oldest_tick()))
+          m_images.evict_oldest();
+        else if(m_icons.is_evictable())
+          m_icons.evict_oldest();
+        else
+          break;
+      }
+    }
+    //------------------------------------------------------------------------
+
+    enum {num_icon_loaders=2};
+
     ULONG_PTR m_gdi_plus;
     HIMAGELIST m_image_list_32, m_image_list_48;
-    image_hash m_images;
-    icon_hash m_icons;
-    hicon_bytes m_hicon_bytes;
     std::wstring m_current_theme;
+    boost::mutex m_mutex;
+
+    // caches
+    lru_cache<wstring, std::shared_ptr<image> > m_images;
+    lru_cache<icon_info, std::shared_ptr<icon>, icon_hash_traits> m_icons;
+    unsigned long m_tick;
+    unsigned long m_max_cache_size;
+    std::auto_ptr<icon_store> m_icon_store;
+
+    // icon atlas
+    atlas m_icon_atlas;
+    boost::mutex m_atlas_mutex;
+    boost::mutex m_image_mutex;
+
+    // icon loaders
+    deque<icon_request> m_requests, m_prefetch_requests;
+    icon_set m_pending_icons; // true if the gui waits for the icon
+    icon_thread_map m_prefetching_loaders; // loader threads prefetching at idle priority
+    boost::condition m_request_available;
+    boost::thread_group m_loaders;
+    HWND m_notify_window;
+    UINT m_notify_msg;
+    bool m_stop_loaders;
   };
+  //--------------------------------------------------------------------------
+
+  void icon_sprite_deleter::operator()(sprite *s) const
+  {
+    backend->remove_sprite(*s);
+    delete s;
+  }
+  //--------------------------------------------------------------------------
 }
 //----------------------------------------------------------------------------
 
@@ -395,6 +950,10 @@ void init_win32_gfx()
 //============================================================================
 void shutdown_win32_gfx()
 {
+  // report cache statistics
+  const icon_cache_stats stats=get_icon_cache_stats();
+  logger::infof("Icon cache: %u hits, %u misses, %u evictions, %u KB (%u KB pinned), %u KB icon atlas", stats.num_hits, stats.num_misses, stats.num_evictions, stats.size/1024, stats.pinned_size/1024, stats.atlas_size/1024);
+
   // delete backend instance
   delete &gfx_backend::get();
 }
@@ -427,10 +986,10 @@ void icon_info::set(e_icon_source source, const std::wstring &path)
 //============================================================================
 // load_image()
 //============================================================================
-std::shared_ptr<image> load_image(const boost::filesystem::wpath &path)
+std::shared_ptr<image> load_image(const boost::filesystem::wpath &path, bool pin)
 {
   // lookup image in cache
-  if(std::shared_ptr<image> ptr=gfx_backend::get().lookup_image(path.string()))
+  if(std::shared_ptr<image> ptr=gfx_backend::get().lookup_image(path.string(), pin))
     return ptr;
 
   // load image
@@ -439,12 +998,34 @@ std::shared_ptr<image> load_image(const boost::filesystem::wpath &path)
     throw_errorf("Unable to load image: %S", path.string().c_str());
   
   // cache and return image
-  gfx_backend::get().cache_image(path.string(), image);
+  gfx_backend::get().cache_image(path.string(), image, pin);
   return image;
 }
 //----------------------------------------------------------------------------
 
 
+//============================================================================
+// set_icon_cache_size(), set_icon_store_file(), get_icon_cache_stats()
+//============================================================================
+void set_icon_cache_size(unsigned long max_size)
+{
+  gfx_backend::get().set_max_cache_size(max_size);
+}
+//----
+
+void set_icon_store_file(const boost::filesystem::wpath &path)
+{
+  gfx_backend::get().set_icon_store(path);
+}
+//----
+
+icon_cache_stats get_icon_cache_stats()
+{
+  return gfx_backend::get().get_cache_stats();
+}
+//----------------------------------------------------------------------------
+
+
 //============================================================================
 // set_theme_for_icons_hack()
 //============================================================================
@@ -464,9 +1045,18 @@ std::shared_ptr<icon> load_icon(const icon_info &info, const std::wstring &fallb
   if(std::shared_ptr<icon> ptr=gfx_backend::get().lookup_icon(info))
     return ptr;
 
-  // branch on icon source type
+  // lookup extracted icons in icon store
   std::shared_ptr<icon> icon(new icon);
   icon->info=info;
+  icon_store *store=icon_source_file!=info.source && icon_source_theme!=info.source ? gfx_backend::get().get_icon_store() : 0;
+  if(store && store->load(info, icon->icon_32, icon->icon_48))
+  {
+    gfx_backend::get().pack_icon(*icon);
+    gfx_backend::get().cache_icon(info, icon);
+    return icon;
+  }
+
+  // branch on icon source type
   switch(info.source)
   {
   case icon_source_file:
@@ -516,7 +1106,7 @@ std::shared_ptr<icon> load_icon(const icon_info &info, const std::wstring &fallb
     }
     catch(std::exception&)
     {
-      logger::infof("Using icon \"%S\" (32x32) from default icon theme.", info.path.c_str());
+      LOG_INFOF("Using icon \"%S\" (32x32) from default icon theme.", info.path.c_str());
       icon->icon_32=load_image(install_folder() / L"themes" / L"default" / (info.path+L"_32.png"));
     }
     try
@@ -525,85 +1115,252 @@ std::shared_ptr<icon> load_icon(const icon_info &info, const std::wstring &fallb
     }
     catch(std::exception&)
     {
-      logger::infof("Using icon \"%S\" (48x48) from default icon theme.", info.path.c_str());
+      LOG_INFOF("Using icon \"%S\" (48x48) from default icon theme.", info.path.c_str());
       icon->icon_48=load_image(install_folder() / L"themes" / L"default" / (info.path+L"_48.png"));
     }
     break;
   }
 
+  // store extracted icons
+  if(store && icon->icon_32 && icon->icon_48)
+    store->store(info, icon->icon_32, icon->icon_48);
+
   // handle loading problems
   if(!icon->icon_32)
     icon->icon_32=load_image(install_folder() / L"themes" / L"default" / (fallback_name+L"_32.png"));
   if(!icon->icon_48)
     icon->icon_48=load_image(install_folder() / L"themes" / L"default" / (fallback_name+L"_48.png"));
 
-  // cache and return image
+  // pack icon into atlas, cache and return it
+  gfx_backend::get().pack_icon(*icon);
   gfx_backend::get().cache_icon(info, icon);
   return icon;
 }
 //----------------------------------------------------------------------------
 
 
+//============================================================================
+// image_to_surface()
+//============================================================================
+void image_to_surface(Gdiplus::Image &image, surface &s)
+{
+  // render image at the surface's size, GDI+ premultiplies the pixels for us
+  Gdiplus::Bitmap bitmap(s.get_width(), s.get_height(), s.get_stride()*4, PixelFormat32bppPARGB, reinterpret_cast<BYTE*>(s.get_row(0)));
+  Gdiplus::Graphics graphics(&bitmap);
+  graphics.SetCompositingMode(Gdiplus::CompositingModeSourceCopy);
+  graphics.SetInterpolationMode(Gdiplus::InterpolationModeHighQualityBicubic);
+  if(Gdiplus::Ok!=graphics.DrawImage(&image, 0, 0, s.get_width(), s.get_height()))
+    throw runtime_error("Unable to convert image to premultiplied pixels.");
+  graphics.Flush(Gdiplus::FlushIntentionSync);
+}
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// blend_icon(), draw_icon()
+//============================================================================
+bool blend_icon(surface &dst, int x, int y, const icon &icon, unsigned size, const pixel_rect &clip)
+{
+  // blit icon from the atlas
+  const std::shared_ptr<sprite> &s=48==size ? icon.sprite_48 : icon.sprite_32;
+  if(!s)
+    return false;
+  gfx_backend::get().blend_sprite(dst, x, y, *s, clip);
+  return true;
+}
+//----
+
+void draw_icon(Gdiplus::Graphics &graphics, int x, int y, const icon &icon, unsigned size)
+{
+  // paint icon which couldn't be packed with GDI+
+  gfx_backend::get().draw_icon(graphics, x, y, icon, size);
+}
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// load_icon_async()
+//============================================================================
+std::shared_ptr<icon> load_icon_async(const icon_info &info, const std::wstring &fallback_name)
+{
+  // lookup icon in cache
+  if(std::shared_ptr<icon> ptr=gfx_backend::get().lookup_icon(info))
+    return ptr;
+
+  // theme icons are cheap to load, everything else is loaded in the background
+  if(icon_source_theme==info.source)
+    return load_icon(info, fallback_name);
+  gfx_backend::get().request_icon(info, fallback_name);
+  return load_icon(icon_info(icon_source_theme, fallback_name), fallback_name);
+}
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// prefetch_icons()
+//============================================================================
+void prefetch_icons(const std::vector<icon_info> &infos, const std::wstring &fallback_name)
+{
+  gfx_backend::get().prefetch_icons(infos, fallback_name);
+}
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// set_icon_notify_window()
+//============================================================================
+void set_icon_notify_window(HWND window, UINT msg)
+{
+  gfx_backend::get().set_notify_window(window, msg);
+}
+//----------------------------------------------------------------------------
+
+
 //============================================================================
 // dc
 //============================================================================
 dc::dc(unsigned width, unsigned height)
+  :m_width(0)
+  ,m_height(0)
+  ,m_bitmap(0)
+  ,m_old_bitmap(0)
 {
-  // initialize image
-  m_width=width;
-  m_height=height;
-
   // create DC
   m_dc=CreateCompatibleDC(0);
   if(!m_dc)
     throw runtime_error("Unable to create screen-compatible DC.");
 
   // create DIB
-  BITMAPINFO bmi={0};
-  bmi.bmiHeader.biSize=sizeof(BITMAPINFOHEADER);
-  bmi.bmiHeader.biWidth=width;
-  bmi.bmiHeader.biHeight=-LONG(height);
-  bmi.bmiHeader.biPlanes=1;
-  bmi.bmiHeader.biBitCount=32;
-  bmi.bmiHeader.biCompression=BI_RGB;
-  bmi.bmiHeader.biSizeImage=width*height*4;
-  void *pixels;
-  m_bitmap=CreateDIBSection(m_dc, &bmi, DIB_RGB_COLORS, &pixels, 0, 0);
-  if(!m_bitmap)
+  try
+  {
+    create_bitmap(width, height);
+  }
+  catch(...)
   {
     DeleteDC(m_dc);
-    throw_errorf("Unable to create %ux%ux32 DIB section.", width, height);
+    throw;
   }
-
-  // select bitmap into DC
-  m_old_bitmap=reinterpret_cast<HBITMAP>(SelectObject(m_dc, m_bitmap));
 }
 //----
 
 dc::~dc()
 {
-  // select old bitmap into DC
-  if(m_old_bitmap)
-    SelectObject(m_dc, m_old_bitmap);
-
   // cleanup
-  DeleteObject(m_bitmap);
+  m_graphics.reset();
+  destroy_bitmap();
   DeleteDC(m_dc);
 }
+//----
+
+void dc::resize(unsigned width, unsigned height)
+{
+  // keep DIB section unless the size changed
+  if(width==m_width && height==m_height)
+    return;
+  m_graphics.reset();
+  destroy_bitmap();
+  create_bitmap(width, height);
+}
 //----------------------------------------------------------------------------
 
+unsigned dc::get_width() const
+{
+  return m_width;
+}
+//----
+
+unsigned dc::get_height() const
+{
+  return m_height;
+}
+//----
+
 HDC dc::get_dc() const
 {
   return m_dc;
 }
+//----
+
+Gdiplus::Graphics &dc::get_graphics()
+{
+  // create GDI+ graphics context on first use
+  if(!m_graphics.get())
+  {
+    std::auto_ptr<Gdiplus::Graphics> graphics(new Gdiplus::Graphics(m_dc));
+    if(Gdiplus::Ok!=graphics->GetLastStatus())
+      throw runtime_error("Unable to initialize GDI+ Graphics object for DC.");
+    m_graphics=graphics;
+  }
+  return *m_graphics;
+}
+//----
+
+surface &dc::get_surface()
+{
+  // wait for pending GDI+/GDI drawing before accessing the pixels
+  if(m_graphics.get())
+    m_graphics->Flush(Gdiplus::FlushIntentionSync);
+  GdiFlush();
+  return m_surface;
+}
 //----------------------------------------------------------------------------
 
-void dc::update(HWND handle)
+void dc::update(HWND handle, const pixel_rect *dirty)
 {
   SIZE size={m_width, m_height};
   POINT src={0};
   BLENDFUNCTION blend={AC_SRC_OVER, 0, 0xff, AC_SRC_ALPHA};
+
+  // only push the dirty part to the compositor if supported (Vista and later)
+  typedef BOOL WINAPI update_layered_window_indirect(HWND, const UPDATELAYEREDWINDOWINFO_VISTA*);
+  static dynamic_library s_user32(L"user32.dll");
+  static update_layered_window_indirect *s_ulwi=s_user32.try_lookup<update_layered_window_indirect>("UpdateLayeredWindowIndirect");
+  if(dirty && s_ulwi)
+  {
+    const RECT rc_dirty={dirty->x, dirty->y, dirty->x+LONG(dirty->width), dirty->y+LONG(dirty->height)};
+    UPDATELAYEREDWINDOWINFO_VISTA info={sizeof(info), 0, 0, &size, m_dc, &src, 0, &blend, ULW_ALPHA, &rc_dirty};
+    if(s_ulwi(handle, &info))
+      return;
+  }
   if(!UpdateLayeredWindow(handle, 0, 0, &size, m_dc, &src, 0, &blend, ULW_ALPHA))
     throw runtime_error("Unable to update layered window.");
 }
 //----------------------------------------------------------------------------
+
+void dc::create_bitmap(unsigned width, unsigned height)
+{
+  // create DIB
+  BITMAPINFO bmi={0};
+  bmi.bmiHeader.biSize=sizeof(BITMAPINFOHEADER);
+  bmi.bmiHeader.biWidth=width;
+  bmi.bmiHeader.biHeight=-LONG(height);
+  bmi.bmiHeader.biPlanes=1;
+  bmi.bmiHeader.biBitCount=32;
+  bmi.bmiHeader.biCompression=BI_RGB;
+  bmi.bmiHeader.biSizeImage=width*height*4;
+  void *pixels;
+  m_bitmap=CreateDIBSection(m_dc, &bmi, DIB_RGB_COLORS, &pixels, 0, 0);
+  if(!m_bitmap)
+    throw_errorf("Unable to create %ux%ux32 DIB section.", width, height);
+
+  // select bitmap into DC
+  m_old_bitmap=reinterpret_cast<HBITMAP>(SelectObject(m_dc, m_bitmap));
+  m_surface.attach(width, height, width, static_cast<boost::uint32_t*>(pixels));
+  m_width=width;
+  m_height=height;
+}
+//----
+
+void dc::destroy_bitmap()
+{
+  // select old bitmap into DC
+  if(m_old_bitmap)
+    SelectObject(m_dc, m_old_bitmap);
+
+  // cleanup
+  DeleteObject(m_bitmap);
+  m_bitmap=m_old_bitmap=0;
+  m_surface.attach(0, 0, 0, 0);
+  m_width=m_height=0;
+}
+//----------------------------------------------------------------------------
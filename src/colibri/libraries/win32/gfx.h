@@ -7,7 +7,10 @@
 #ifndef UTILS_WIN32_GFX_H
 #define UTILS_WIN32_GFX_H
 #include "win32.h"
+#include "../gfx/atlas.h"
+#include "../gfx/damage.h"
 #include <memory>
+#include <vector>
 #include <boost/filesystem.hpp>
 //----------------------------------------------------------------------------
 
@@ -16,10 +19,20 @@ typedef Gdiplus::Bitmap image;
 enum e_icon_source;
 struct icon_info;
 struct icon;
+struct icon_cache_stats;
 class dc;
 void set_theme_for_icons_hack(const std::wstring &name);
-std::shared_ptr<image> load_image(const boost::filesystem::wpath&);
+std::shared_ptr<image> load_image(const boost::filesystem::wpath&, bool pin=false);
 std::shared_ptr<icon> load_icon(const icon_info&, const std::wstring &fallback_name);
+std::shared_ptr<icon> load_icon_async(const icon_info&, const std::wstring &fallback_name);
+void prefetch_icons(const std::vector<icon_info>&, const std::wstring &fallback_name);
+void set_icon_notify_window(HWND, UINT msg);
+void set_icon_cache_size(unsigned long max_size);
+void set_icon_store_file(const boost::filesystem::wpath&);
+icon_cache_stats get_icon_cache_stats();
+void image_to_surface(Gdiplus::Image&, surface&);
+bool blend_icon(surface &dst, int x, int y, const icon&, unsigned size, const pixel_rect &clip);
+void draw_icon(Gdiplus::Graphics&, int x, int y, const icon&, unsigned size);
 class image_list;
 //----------------------------------------------------------------------------
 
@@ -67,12 +80,36 @@ struct icon
   icon_info info;
   std::shared_ptr<image> icon_32;
   std::shared_ptr<image> icon_48;
+  std::shared_ptr<sprite> sprite_32; // in the icon atlas (see blend_icon())
+  std::shared_ptr<sprite> sprite_48;
+};
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// icon_cache_stats
+//============================================================================
+struct icon_cache_stats
+{
+  unsigned long num_images;
+  unsigned long num_icons;
+  unsigned long size;
+  unsigned long pinned_size;
+  unsigned long max_size;
+  unsigned long num_hits;
+  unsigned long num_misses;
+  unsigned long num_evictions;
+  unsigned long atlas_size;
 };
 //----------------------------------------------------------------------------
 
 
 //============================================================================
 // dc
+//
+// Memory DC with a 32bpp DIB section, meant to be kept around as a back
+// buffer: resize() only reallocates the DIB section if the size changes and
+// the GDI+ graphics context is created once.
 //============================================================================
 class dc
 {
@@ -80,21 +117,34 @@ public:
   // construction and destruction
   dc(unsigned width, unsigned height);
   ~dc();
+  void resize(unsigned width, unsigned height);
   //--------------------------------------------------------------------------
 
   // accessors
+  unsigned get_width() const;
+  unsigned get_height() const;
   HDC get_dc() const;
+  Gdiplus::Graphics &get_graphics();
+  surface &get_surface();
   //--------------------------------------------------------------------------
 
   // updating
-  void update(HWND);
+  void update(HWND, const pixel_rect *dirty=0);
   //--------------------------------------------------------------------------
 
 private:
+  dc(const dc&); // not implemented
+  void operator=(const dc&); // not implemented
+  void create_bitmap(unsigned width, unsigned height);
+  void destroy_bitmap();
+  //--------------------------------------------------------------------------
+
   unsigned m_width;
   unsigned m_height;
   HDC m_dc;
   HBITMAP m_bitmap, m_old_bitmap;
+  surface m_surface;
+  std::auto_ptr<Gdiplus::Graphics> m_graphics;
 };
 //----------------------------------------------------------------------------
 
@@ -0,0 +1,509 @@
+//============================================================================
+// icon_store.cpp: Persistent icon store
+//
+// (c) Michael Walter, 2006
+//============================================================================
+
+#include "icon_store.h"
+#include "../log/log.h"
+#include <ctime>
+#include <sstream>
+using namespace std;
+using namespace boost;
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// anonymous namespace
+//============================================================================
+namespace
+{
+  // file format
+  enum
+  {
+    store_magic=0x53494c43, // "CLIS"
+    store_version=1,
+    max_unused_days=30,
+    max_icon_size=256,
+    max_pending_entries=32 // extracted icons kept in memory until appended
+  };
+  //----
+
+  struct store_header
+  {
+    unsigned magic;
+    unsigned version;
+    unsigned num_entries;
+    unsigned index_offset;
+  };
+  //--------------------------------------------------------------------------
+
+  // deleter for bitmaps referencing their own pixel buffer
+  struct pixel_image_deleter
+  {
+    pixel_image_deleter(DWORD *pixels)
+      :pixels(pixels)
+    {
+    }
+
+    void operator()(image *image) const
+    {
+      delete image;
+      delete []pixels;
+    }
+
+    DWORD *pixels;
+  };
+  //--------------------------------------------------------------------------
+
+  // index reading/writing
+  template<typename T> bool read(const unsigned char *&pos, const unsigned char *end, T &value)
+  {
+    if(unsigned(end-pos)<sizeof(T))
+      return false;
+    memcpy(&value, pos, sizeof(T));
+    pos+=sizeof(T);
+    return true;
+  }
+  //----
+
+  template<typename T> void write(std::string &buffer, const T &value)
+  {
+    buffer.append(reinterpret_cast<const char*>(&value), sizeof(T));
+  }
+  //----
+
+  bool write_at(HANDLE file, unsigned offset, const std::string &data)
+  {
+    DWORD written=0;
+    return INVALID_SET_FILE_POINTER!=SetFilePointer(file, LONG(offset), 0, FILE_BEGIN) &&
+           WriteFile(file, data.data(), DWORD(data.size()), &written, 0) && written==data.size();
+  }
+  //----
+
+  unsigned get_today()
+  {
+    return unsigned(time(0)/(24*60*60));
+  }
+  //--------------------------------------------------------------------------
+}
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// icon_store::stamp, icon_store::bitmap, icon_store::entry
+//============================================================================
+struct icon_store::stamp
+{
+  boost::uint64_t time;
+  boost::uint64_t size;
+};
+//----
+
+struct icon_store::bitmap
+{
+  unsigned short width, height;
+  unsigned offset; // into the mapped file, unless pixels are set
+  std::vector<DWORD> pixels;
+};
+//----
+
+struct icon_store::entry
+{
+  icon_info info;
+  stamp source;
+  unsigned last_used;
+  bitmap icon_32, icon_48;
+};
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// icon_store
+//============================================================================
+icon_store::icon_store(const boost::filesystem::wpath &path)
+  :m_path(path)
+  ,m_file(INVALID_HANDLE_VALUE)
+  ,m_mapping(0)
+  ,m_data(0)
+  ,m_data_size(0)
+  ,m_num_pending(0)
+  ,m_is_dirty(false)
+{
+  open();
+}
+//----
+
+icon_store::~icon_store()
+{
+  try
+  {
+    save();
+  }
+  catch(std::exception&)
+  {
+  }
+  close();
+}
+//----------------------------------------------------------------------------
+
+const boost::filesystem::wpath &icon_store::get_path() const
+{
+  return m_path;
+}
+//----------------------------------------------------------------------------
+
+bool icon_store::load(const icon_info &info, std::shared_ptr<image> &icon_32, std::shared_ptr<image> &icon_48)
+{
+  // lookup entry
+  stamp source;
+  if(!get_stamp(info, source))
+    return false;
+  boost::mutex::scoped_lock lock(m_mutex);
+  entries::iterator iter=m_entries.find(get_key(info));
+  if(iter==m_entries.end())
+    return false;
+
+  // stale?
+  entry &e=iter->second;
+  if(e.source.time!=source.time || e.source.size!=source.size)
+  {
+    if(e.icon_32.pixels.size())
+      --m_num_pending;
+    m_entries.erase(iter);
+    m_is_dirty=true;
+    return false;
+  }
+
+  // create images
+  icon_32=create_image(e.icon_32);
+  icon_48=create_image(e.icon_48);
+  if(!icon_32 || !icon_48)
+    return false;
+  if(e.last_used!=get_today())
+  {
+    e.last_used=get_today();
+    m_is_dirty=true;
+  }
+  return true;
+}
+//----
+
+void icon_store::store(const icon_info &info, const std::shared_ptr<image> &icon_32, const std::shared_ptr<image> &icon_48)
+{
+  // fill entry
+  entry e;
+  e.info=info;
+  e.last_used=get_today();
+  if(!get_stamp(info, e.source))
+    return;
+  image *images[2]={icon_32.get(), icon_48.get()};
+  bitmap *bitmaps[2]={&e.icon_32, &e.icon_48};
+  for(unsigned i=0; i<2; ++i)
+  {
+    // get image pixels
+    image &img=*images[i];
+    bitmap &bmp=*bitmaps[i];
+    if(img.GetWidth()>unsigned(max_icon_size) || img.GetHeight()>unsigned(max_icon_size))
+      return;
+    bmp.width=(unsigned short)img.GetWidth();
+    bmp.height=(unsigned short)img.GetHeight();
+    bmp.offset=0;
+    bmp.pixels.resize(bmp.width*bmp.height);
+    if(bmp.pixels.empty())
+      return;
+    Gdiplus::Rect rect(0, 0, bmp.width, bmp.height);
+    Gdiplus::BitmapData data;
+    data.Width=bmp.width;
+    data.Height=bmp.height;
+    data.Stride=bmp.width*4;
+    data.PixelFormat=PixelFormat32bppARGB;
+    data.Scan0=&bmp.pixels[0];
+    data.Reserved=0;
+    if(Gdiplus::Ok!=img.LockBits(&rect, Gdiplus::ImageLockModeRead|Gdiplus::ImageLockModeUserInputBuf, PixelFormat32bppARGB, &data))
+      return;
+    img.UnlockBits(&data);
+  }
+
+  // add entry, appending pending entries to the file in batches
+  boost::mutex::scoped_lock lock(m_mutex);
+  entry &pending=m_entries[get_key(info)];
+  if(pending.icon_32.pixels.empty())
+    ++m_num_pending;
+  pending=e;
+  m_is_dirty=true;
+  if(m_num_pending>=max_pending_entries)
+    append_pending();
+}
+//----
+
+void icon_store::flush()
+{
+  boost::mutex::scoped_lock lock(m_mutex);
+  append_pending();
+}
+//----
+
+void icon_store::save()
+{
+  boost::mutex::scoped_lock lock(m_mutex);
+  if(m_is_dirty)
+    write_store();
+}
+//----------------------------------------------------------------------------
+
+void icon_store::write_store()
+{
+  // open temporary file
+  const std::wstring temp_path=m_path.string()+L".new";
+  HANDLE file=CreateFileW(temp_path.c_str(), GENERIC_WRITE, 0, 0, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+  if(INVALID_HANDLE_VALUE==file)
+    throw_errorf("Unable to create icon store: %S", temp_path.c_str());
+
+  // write pixels of recently used icons, and build index
+  const unsigned today=get_today();
+  std::string pixels, index;
+  unsigned num_entries=0;
+  pixels.resize(sizeof(store_header));
+  for(entries::iterator iter=m_entries.begin(); iter!=m_entries.end(); ++iter)
+  {
+    const entry &e=iter->second;
+    if(e.last_used+max_unused_days<today)
+      continue;
+    const bitmap *bitmaps[2]={&e.icon_32, &e.icon_48};
+    unsigned offsets[2];
+    for(unsigned i=0; i<2; ++i)
+    {
+      offsets[i]=unsigned(pixels.size());
+      append_pixels(pixels, *bitmaps[i]);
+    }
+    write_index_entry(index, e, offsets);
+    ++num_entries;
+  }
+
+  // write header, pixels and index
+  store_header header={store_magic, store_version, num_entries, unsigned(pixels.size())};
+  memcpy(&pixels[0], &header, sizeof(header));
+  DWORD written=0;
+  const bool ok=WriteFile(file, pixels.data(), DWORD(pixels.size()), &written, 0) && written==pixels.size() &&
+                WriteFile(file, index.data(), DWORD(index.size()), &written, 0) && written==index.size();
+  CloseHandle(file);
+  if(!ok)
+  {
+    DeleteFileW(temp_path.c_str());
+    throw_errorf("Unable to write icon store: %S", temp_path.c_str());
+  }
+
+  // replace store and map it again, which drops the pixels of pending entries
+  close();
+  const bool is_replaced=0!=MoveFileExW(temp_path.c_str(), m_path.string().c_str(), MOVEFILE_REPLACE_EXISTING);
+  if(!is_replaced)
+    DeleteFileW(temp_path.c_str());
+  reopen();
+  if(!is_replaced)
+    throw_errorf("Unable to replace icon store: %S", m_path.string().c_str());
+  m_is_dirty=false;
+}
+//----------------------------------------------------------------------------
+
+void icon_store::append_pending()
+{
+  if(!m_num_pending)
+    return;
+
+  // write the complete store if there is none yet
+  if(!m_data)
+  {
+    try
+    {
+      write_store();
+    }
+    catch(std::exception &e_)
+    {
+      LOG_WARNF_LIMITED(10, "%s", e_.what());
+      reopen();
+    }
+    return;
+  }
+
+  // append the pixels of pending entries and a new index behind the end of
+  // the file, and only then point the header to the new index, so that the
+  // store stays valid if Colibri is interrupted (the old index is left
+  // behind until save() rewrites the store)
+  const unsigned pixels_offset=unsigned(m_data_size);
+  std::string pixels, index;
+  unsigned num_entries=0;
+  for(entries::iterator iter=m_entries.begin(); iter!=m_entries.end(); ++iter)
+  {
+    const entry &e=iter->second;
+    const bitmap *bitmaps[2]={&e.icon_32, &e.icon_48};
+    unsigned offsets[2];
+    for(unsigned i=0; i<2; ++i)
+    {
+      offsets[i]=bitmaps[i]->offset;
+      if(bitmaps[i]->pixels.size())
+      {
+        offsets[i]=pixels_offset+unsigned(pixels.size());
+        append_pixels(pixels, *bitmaps[i]);
+      }
+    }
+    write_index_entry(index, e, offsets);
+    ++num_entries;
+  }
+  const store_header header={store_magic, store_version, num_entries, pixels_offset+unsigned(pixels.size())};
+
+  // write them and map the store again, which drops the pixels of pending
+  // entries (on failure they are extracted again when next used)
+  close();
+  HANDLE file=CreateFileW(m_path.string().c_str(), GENERIC_WRITE, 0, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+  const bool ok=INVALID_HANDLE_VALUE!=file &&
+                write_at(file, pixels_offset, pixels) && write_at(file, header.index_offset, index) && FlushFileBuffers(file) &&
+                write_at(file, 0, std::string(reinterpret_cast<const char*>(&header), sizeof(header))) && FlushFileBuffers(file);
+  if(INVALID_HANDLE_VALUE!=file)
+    CloseHandle(file);
+  if(!ok)
+    LOG_WARNF_LIMITED(10, "Unable to append to icon store: %S", m_path.string().c_str());
+  reopen();
+}
+//----
+
+void icon_store::reopen()
+{
+  close();
+  m_entries.clear();
+  m_num_pending=0;
+  open();
+}
+//----------------------------------------------------------------------------
+
+void icon_store::open()
+{
+  // map file
+  m_file=CreateFileW(m_path.string().c_str(), GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, 0);
+  if(INVALID_HANDLE_VALUE==m_file)
+    return;
+  m_data_size=GetFileSize(m_file, 0);
+  m_mapping=m_data_size>=sizeof(store_header) ? CreateFileMappingW(m_file, 0, PAGE_READONLY, 0, 0, 0) : 0;
+  m_data=m_mapping ? static_cast<const unsigned char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0)) : 0;
+  if(!m_data)
+  {
+    close();
+    return;
+  }
+
+  // check header
+  store_header header;
+  memcpy(&header, m_data, sizeof(header));
+  if(store_magic!=header.magic || store_version!=header.version || header.index_offset>m_data_size)
+  {
+    logger::warn("Ignoring invalid icon store.");
+    close();
+    return;
+  }
+
+  // read index
+  const unsigned char *pos=m_data+header.index_offset, *end=m_data+m_data_size;
+  for(unsigned i=0; i<header.num_entries; ++i)
+  {
+    entry e;
+    unsigned char source;
+    unsigned short path_length;
+    if(!read(pos, end, source) || !read(pos, end, path_length) || unsigned(end-pos)<path_length*sizeof(wchar_t))
+      break;
+    e.info.source=e_icon_source(source);
+    e.info.path.assign(reinterpret_cast<const wchar_t*>(pos), path_length);
+    pos+=path_length*sizeof(wchar_t);
+    if(!read(pos, end, e.source.time) || !read(pos, end, e.source.size) || !read(pos, end, e.last_used))
+      break;
+    bitmap *bitmaps[2]={&e.icon_32, &e.icon_48};
+    bool ok=true;
+    for(unsigned j=0; ok && j<2; ++j)
+    {
+      // pixels must lie between the header and the index
+      bitmap &bmp=*bitmaps[j];
+      ok=read(pos, end, bmp.width) && read(pos, end, bmp.height) && read(pos, end, bmp.offset) &&
+         bmp.width && bmp.width<=max_icon_size && bmp.height && bmp.height<=max_icon_size &&
+         bmp.offset>=sizeof(store_header) && bmp.offset<=header.index_offset &&
+         boost::uint64_t(bmp.offset)+boost::uint64_t(bmp.width)*bmp.height*4<=header.index_offset;
+    }
+    if(!ok)
+      break;
+    m_entries[get_key(e.info)]=e;
+  }
+}
+//----
+
+void icon_store::close()
+{
+  if(m_data)
+    UnmapViewOfFile(m_data);
+  if(m_mapping)
+    CloseHandle(m_mapping);
+  if(INVALID_HANDLE_VALUE!=m_file)
+    CloseHandle(m_file);
+  m_file=INVALID_HANDLE_VALUE;
+  m_mapping=0;
+  m_data=0;
+  m_data_size=0;
+}
+//----------------------------------------------------------------------------
+
+bool icon_store::get_stamp(const icon_info &info, stamp &s)
+{
+  // icons are stamped with the modification time and size of their source file
+  const std::wstring filename=info.path.substr(0, info.path.find(L'#'));
+  WIN32_FILE_ATTRIBUTE_DATA data;
+  if(!GetFileAttributesExW(filename.c_str(), GetFileExInfoStandard, &data))
+    return false;
+  s.time=(boost::uint64_t(data.ftLastWriteTime.dwHighDateTime)<<32)|data.ftLastWriteTime.dwLowDateTime;
+  s.size=(boost::uint64_t(data.nFileSizeHigh)<<32)|data.nFileSizeLow;
+  return true;
+}
+//----
+
+std::wstring icon_store::get_key(const icon_info &info)
+{
+  std::wostringstream key;
+  key<<unsigned(info.source)<<L'|'<<info.path;
+  return key.str();
+}
+//----
+
+std::shared_ptr<image> icon_store::create_image(const bitmap &bmp) const
+{
+  // copy pixels into a buffer owned by the image
+  const unsigned num_pixels=bmp.width*bmp.height;
+  if(!num_pixels || (bmp.pixels.empty() && !m_data))
+    return std::shared_ptr<image>();
+  const DWORD *source=bmp.pixels.size() ? &bmp.pixels[0] : reinterpret_cast<const DWORD*>(m_data+bmp.offset);
+  DWORD *pixels=new DWORD[num_pixels];
+  memcpy(pixels, source, num_pixels*4);
+  return std::shared_ptr<image>(new Gdiplus::Bitmap(bmp.width, bmp.height, bmp.width*4, PixelFormat32bppARGB, reinterpret_cast<BYTE*>(pixels)), pixel_image_deleter(pixels));
+}
+//----
+
+void icon_store::append_pixels(std::string &buffer, const bitmap &bmp) const
+{
+  // append pending or mapped pixels
+  const unsigned num_bytes=bmp.width*bmp.height*4;
+  buffer.append(bmp.pixels.size() ? reinterpret_cast<const char*>(&bmp.pixels[0]) : reinterpret_cast<const char*>(m_data+bmp.offset), num_bytes);
+}
+//----
+
+void icon_store::write_index_entry(std::string &index, const entry &e, const unsigned offsets[2])
+{
+  write(index, (unsigned char)e.info.source);
+  write(index, (unsigned short)e.info.path.size());
+  index.append(reinterpret_cast<const char*>(e.info.path.c_str()), e.info.path.size()*sizeof(wchar_t));
+  write(index, e.source.time);
+  write(index, e.source.size);
+  write(index, e.last_used);
+  const bitmap *bitmaps[2]={&e.icon_32, &e.icon_48};
+  for(unsigned i=0; i<2; ++i)
+  {
+    write(index, bitmaps[i]->width);
+    write(index, bitmaps[i]->height);
+    write(index, offsets[i]);
+  }
+}
+//----------------------------------------------------------------------------
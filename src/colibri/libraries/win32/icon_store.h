@@ -0,0 +1,80 @@
+//============================================================================
+// icon_store.h: Persistent icon store
+//
+// (c) Michael Walter, 2006
+//============================================================================
+
+#ifndef UTILS_WIN32_ICON_STORE_H
+#define UTILS_WIN32_ICON_STORE_H
+#include "gfx.h"
+#include <map>
+#include <vector>
+#include <boost/thread/mutex.hpp>
+//----------------------------------------------------------------------------
+
+// Interface:
+class icon_store;
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// icon_store
+//
+// Extracted icons packed into a single file: a header, the raw 32bpp ARGB
+// pixels of all icons and an index (icon_info, source file time and size,
+// last use, pixel offsets) at the end. The file is mapped on construction.
+// Newly extracted icons are kept in memory until a batch of them is
+// appended by flush() (or when the batch is full), behind the current index
+// followed by a new index, so that a crash loses at most one batch. save()
+// rewrites the file, dropping unused icons and indices left behind.
+//============================================================================
+class icon_store
+{
+public:
+  // construction and destruction
+  icon_store(const boost::filesystem::wpath&);
+  ~icon_store();
+  //--------------------------------------------------------------------------
+
+  // accessors
+  const boost::filesystem::wpath &get_path() const;
+  //--------------------------------------------------------------------------
+
+  // loading and storing
+  bool load(const icon_info&, std::shared_ptr<image> &icon_32, std::shared_ptr<image> &icon_48);
+  void store(const icon_info&, const std::shared_ptr<image> &icon_32, const std::shared_ptr<image> &icon_48);
+  void flush();
+  void save();
+  //--------------------------------------------------------------------------
+
+private:
+  icon_store(const icon_store&); // not implemented
+  void operator=(const icon_store&); // not implemented
+  struct stamp;
+  struct bitmap;
+  struct entry;
+  typedef std::map<std::wstring, entry> entries;
+  void open();
+  void close();
+  void reopen();
+  void write_store();
+  void append_pending();
+  void append_pixels(std::string &buffer, const bitmap&) const;
+  static void write_index_entry(std::string &index, const entry&, const unsigned offsets[2]);
+  static bool get_stamp(const icon_info&, stamp&);
+  static std::wstring get_key(const icon_info&);
+  std::shared_ptr<image> create_image(const bitmap&) const;
+  //--------------------------------------------------------------------------
+
+  const boost::filesystem::wpath m_path;
+  HANDLE m_file, m_mapping;
+  const unsigned char *m_data;
+  unsigned long m_data_size;
+  entries m_entries;
+  unsigned m_num_pending; // entries with pixels in memory
+  bool m_is_dirty;
+  boost::mutex m_mutex;
+};
+//----------------------------------------------------------------------------
+
+#endif
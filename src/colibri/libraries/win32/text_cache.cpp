@@ -0,0 +1,158 @@
+//============================================================================
+// text_cache.cpp: Cache of rendered text
+//
+// (c) Michael Walter, 2006
+//============================================================================
+
+#include "text_cache.h"
+#include <cmath>
+#include <stdexcept>
+using namespace std;
+using namespace stdext;
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// text_cache::key_hash_traits
+//============================================================================
+size_t text_cache::key_hash_traits::operator()(const key &k) const
+{
+  return hash_compare<wstring>()(k.text)+size_t(k.font)+size_t(k.brush)+size_t(k.format)+size_t(k.width)+size_t(k.height);
+}
+//----
+
+bool text_cache::key_hash_traits::operator()(const key &a, const key &b) const
+{
+  if(a.font!=b.font)
+    return a.font<b.font;
+  if(a.brush!=b.brush)
+    return a.brush<b.brush;
+  if(a.format!=b.format)
+    return a.format<b.format;
+  if(a.width!=b.width)
+    return a.width<b.width;
+  if(a.height!=b.height)
+    return a.height<b.height;
+  if(a.x!=b.x)
+    return a.x<b.x;
+  if(a.y!=b.y)
+    return a.y<b.y;
+  return a.text<b.text;
+}
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// text_cache
+//============================================================================
+text_cache::text_cache(unsigned long max_size)
+  :m_max_size(max_size)
+  ,m_size(0)
+  ,m_hits(0)
+  ,m_misses(0)
+{
+}
+//----------------------------------------------------------------------------
+
+void text_cache::draw(surface &dst, const wstring &text, const Gdiplus::Font &font, const Gdiplus::Brush &brush, const Gdiplus::RectF &rc, const Gdiplus::StringFormat &format, const pixel_rect &clip)
+{
+  // split layout rect into pixel position and sub-pixel offset
+  if(text.empty() || rc.Width<=0 || rc.Height<=0)
+    return;
+  const int x=int(floor(rc.X)), y=int(floor(rc.Y));
+  key k;
+  k.text=text;
+  k.font=&font;
+  k.brush=&brush;
+  k.format=&format;
+  k.x=rc.X-Gdiplus::REAL(x);
+  k.y=rc.Y-Gdiplus::REAL(y);
+  k.width=rc.Width;
+  k.height=rc.Height;
+
+  // don't bother with invisible text
+  const unsigned width=unsigned(ceil(k.x+k.width)), height=unsigned(ceil(k.y+k.height));
+  if(intersect(pixel_rect(x, y, width, height), clip).is_empty())
+    return;
+
+  // look up rendered text, render it on a miss
+  entries::iterator iter=m_entries.find(k);
+  if(iter!=m_entries.end())
+  {
+    ++m_hits;
+    m_uses.splice(m_uses.begin(), m_uses, iter->second.use_pos);
+  }
+  else
+  {
+    ++m_misses;
+    entry e;
+    e.size=width*height*4;
+    evict(e.size);
+    e.text_sprite=render(k, width, height);
+    e.use_pos=m_uses.insert(m_uses.begin(), k);
+    iter=m_entries.insert(make_pair(k, e)).first;
+    m_size+=e.size;
+  }
+
+  // blend it
+  m_atlas.blend(dst, x, y, iter->second.text_sprite, clip);
+}
+//----
+
+void text_cache::clear()
+{
+  m_entries.clear();
+  m_uses.clear();
+  m_atlas.clear();
+  m_size=0;
+}
+//----------------------------------------------------------------------------
+
+unsigned long text_cache::get_size() const
+{
+  return m_size;
+}
+//----
+
+unsigned long text_cache::get_num_hits() const
+{
+  return m_hits;
+}
+//----
+
+unsigned long text_cache::get_num_misses() const
+{
+  return m_misses;
+}
+//----------------------------------------------------------------------------
+
+sprite text_cache::render(const key &k, unsigned width, unsigned height)
+{
+  // draw text onto transparent premultiplied pixels (ClearType needs an
+  // opaque background, so grayscale anti-aliasing is used)
+  surface pixels(width, height);
+  {
+    Gdiplus::Bitmap bitmap(width, height, pixels.get_stride()*4, PixelFormat32bppPARGB, reinterpret_cast<BYTE*>(pixels.get_row(0)));
+    Gdiplus::Graphics graphics(&bitmap);
+    graphics.SetTextRenderingHint(Gdiplus::TextRenderingHintAntiAliasGridFit);
+    if(Gdiplus::Ok!=graphics.DrawString(k.text.c_str(), INT(k.text.size()), k.font, Gdiplus::RectF(k.x, k.y, k.width, k.height), k.format, k.brush))
+      throw runtime_error("Unable to render text.");
+    graphics.Flush(Gdiplus::FlushIntentionSync);
+  }
+  return m_atlas.add(pixels);
+}
+//----
+
+void text_cache::evict(unsigned long size)
+{
+  // drop least recently used text until there's room for the given size
+  while(!m_uses.empty() && m_size+size>m_max_size)
+  {
+    entries::iterator iter=m_entries.find(m_uses.back());
+    m_atlas.remove(iter->second.text_sprite);
+    m_size-=iter->second.size;
+    m_entries.erase(iter);
+    m_uses.pop_back();
+  }
+}
+//----------------------------------------------------------------------------
@@ -0,0 +1,89 @@
+//============================================================================
+// text_cache.h: Cache of rendered text
+//
+// (c) Michael Walter, 2006
+//============================================================================
+
+#ifndef UTILS_WIN32_TEXT_CACHE_H
+#define UTILS_WIN32_TEXT_CACHE_H
+#include "win32.h"
+#include "../gfx/atlas.h"
+#include <string>
+#include <list>
+#include <hash_map>
+//----------------------------------------------------------------------------
+
+// Interface:
+class text_cache;
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// text_cache
+//
+// GDI+ shapes and rasterizes text on every DrawString() call. The cache
+// renders each (text, font, brush, format, layout rect size and sub-pixel
+// offset) once into a premultiplied sprite and blends that on later paints,
+// so only the position of the text may change between paints (e.g. when
+// scrolling). Fonts, brushes and formats are identified by address, so the
+// cache has to be cleared when they are destroyed.
+//============================================================================
+class text_cache
+{
+public:
+  // construction
+  text_cache(unsigned long max_size=4*1024*1024);
+  //--------------------------------------------------------------------------
+
+  // painting
+  void draw(surface &dst, const std::wstring &text, const Gdiplus::Font&, const Gdiplus::Brush&, const Gdiplus::RectF&, const Gdiplus::StringFormat&, const pixel_rect &clip);
+  void clear();
+  //--------------------------------------------------------------------------
+
+  // statistics
+  unsigned long get_size() const;
+  unsigned long get_num_hits() const;
+  unsigned long get_num_misses() const;
+  //--------------------------------------------------------------------------
+
+private:
+  text_cache(const text_cache&); // not implemented
+  void operator=(const text_cache&); // not implemented
+  struct key
+  {
+    std::wstring text;
+    const Gdiplus::Font *font;
+    const Gdiplus::Brush *brush;
+    const Gdiplus::StringFormat *format;
+    Gdiplus::REAL x, y; // sub-pixel offset
+    Gdiplus::REAL width, height;
+  };
+  struct key_hash_traits
+  {
+    static const size_t bucket_size=4;
+    static const size_t min_buckets=8;
+    size_t operator()(const key&) const;
+    bool operator()(const key&, const key&) const;
+  };
+  typedef std::list<key> uses;
+  struct entry
+  {
+    sprite text_sprite;
+    unsigned long size;
+    uses::iterator use_pos;
+  };
+  typedef stdext::hash_map<key, entry, key_hash_traits> entries;
+  sprite render(const key&, unsigned width, unsigned height);
+  void evict(unsigned long size);
+  //--------------------------------------------------------------------------
+
+  const unsigned long m_max_size;
+  atlas m_atlas;
+  uses m_uses; // most recently used first
+  entries m_entries;
+  unsigned long m_size;
+  unsigned long m_hits, m_misses;
+};
+//----------------------------------------------------------------------------
+
+#endif
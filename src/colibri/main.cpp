@@ -18,6 +18,7 @@
 #include "plugins/winamp_plugin.h"
 #include "libraries/win32/shell.h"
 #include "libraries/log/log.h"
+#include "libraries/log/trace.h"
 using namespace std;
 using namespace boost;
 //----------------------------------------------------------------------------
@@ -45,8 +46,9 @@ int WINAPI WinMain(HINSTANCE, HINSTANCE, LPSTR, int)
     }
 
     // initialize logging
-    logger::add_target(logger::create_file_target(profile_folder() / L"log.txt"));
-    logger::add_target(logger::create_debug_target());
+    logger::add_target(logger::create_dedup_target(logger::create_rotating_file_target(profile_folder() / L"log.txt", 1024*1024, 5)));
+    logger::add_target(logger::create_dedup_target(logger::create_debug_target()));
+    logger::set_async(true);
 
     // init utility library
     init_utils();
@@ -71,7 +73,7 @@ int WINAPI WinMain(HINSTANCE, HINSTANCE, LPSTR, int)
       restart=false;
 
       // load database
-      database db;
+      database db(profile_folder() / L"database.sqlite");
       db.add_plugin(std::shared_ptr<plugin>(new colibri_plugin));
 
       // create gui 
@@ -114,9 +116,16 @@ int WINAPI WinMain(HINSTANCE, HINSTANCE, LPSTR, int)
 
     // shutdown utility library
     shutdown_utils();
+
+    // write pending log and trace records
+    logger::set_async(false);
+    logger::set_trace_target(std::shared_ptr<logger::trace_target>());
   }
   catch(std::exception &e_)
   {
+    logger::error(e_.what());
+    logger::set_async(false);
+    logger::set_trace_target(std::shared_ptr<logger::trace_target>());
     MessageBoxA(0, e_.what(), "Fatal Error", MB_OK|MB_ICONERROR);
     return 1;
   }
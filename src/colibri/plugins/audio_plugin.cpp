@@ -138,6 +138,12 @@ void audio_plugin::index(boost::uint64_t new_index_version)
 }
 //----------------------------------------------------------------------------
 
+void audio_plugin::register_actions()
+{
+  register_action_prefix(L"audio_actions.");
+}
+//----
+
 bool audio_plugin::on_action(const std::wstring &name, boost::optional<database_item> target)
 {
   if(name==L"audio_actions.open_volume_control_menu")
@@ -39,6 +39,7 @@ public:
   //--------------------------------------------------------------------------
 
   // action handling
+  virtual void register_actions();
   virtual bool on_action(const std::wstring &name, boost::optional<database_item> target);
   //--------------------------------------------------------------------------
 
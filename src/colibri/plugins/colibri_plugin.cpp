@@ -6,12 +6,15 @@
 
 #include "colibri_plugin.h"
 #include "../core/version.h"
+#include "../db/session_recorder.h"
 #include "../gui/gui.h"
 #include "../gui/controller.h"
 #include "../libraries/win32/shell.h"
 #include "../libraries/win32/win.h"
 #include "../libraries/net/net.h"
 #include "../libraries/log/log.h"
+#include "../libraries/log/metrics.h"
+#include "../libraries/log/trace.h"
 #include "../thirdparty/rapidxml/rapidxml.hpp"
 #include <boost/bind.hpp>
 #include <boost/thread/thread.hpp>
@@ -104,8 +107,24 @@ unsigned colibri_plugin::update_config(unsigned current_version)
   case 6:
     // rename "show_update_notification" setting to "check_for_updates"
     config.prepare(L"UPDATE settings SET key = 'check_for_updates' WHERE key = 'show_update_notification'")->exec();
+
+  case 7:
+    // add "icon_cache.max_size" setting (in MB)
+    config.prepare(L"INSERT OR IGNORE INTO settings (key, value) VALUES ('icon_cache.max_size', 32)")->exec();
+
+  case 8:
+    // add "query_profiling.enabled" setting
+    config.prepare(L"INSERT OR IGNORE INTO settings (key, value) VALUES ('query_profiling.enabled', 0)")->exec();
+
+  case 9:
+    // add "session_recording.enabled" setting
+    config.prepare(L"INSERT OR IGNORE INTO settings (key, value) VALUES ('session_recording.enabled', 0)")->exec();
+
+  case 10:
+    // add "tracing.enabled" setting
+    config.prepare(L"INSERT OR IGNORE INTO settings (key, value) VALUES ('tracing.enabled', 0)")->exec();
   }
-  return 7;
+  return 11;
 }
 //----------------------------------------------------------------------------
 
@@ -126,6 +145,12 @@ void colibri_plugin::index(boost::uint64_t new_index_version)
 }
 //----------------------------------------------------------------------------
 
+void colibri_plugin::register_actions()
+{
+  register_action_prefix(L"colibri_actions.");
+}
+//----
+
 bool colibri_plugin::on_action(const std::wstring &name, boost::optional<database_item>)
 {
   if(name==L"colibri_actions.open_colibri_menu")
@@ -138,9 +163,90 @@ bool colibri_plugin::on_action(const std::wstring &name, boost::optional<databas
     ctrl->add_item(L"Update index", L"Update index", L"colibri/update_index", L"colibri_actions.update_index");
     ctrl->add_item(L"Restart", L"Restart Colibri", L"colibri/restart", L"colibri_actions.restart");
     ctrl->add_item(L"Quit", L"Quit Colibri", L"colibri/quit", L"colibri_actions.quit");
+    if(GetAsyncKeyState(VK_SHIFT)&0x8000)
+    {
+      ctrl->add_item(L"Latency statistics", L"Show input and rendering latencies", L"colibri/logo", L"colibri_actions.open_latency_menu");
+      ctrl->add_item(L"Query statistics", L"Show the most expensive database queries", L"colibri/logo", L"colibri_actions.open_query_menu");
+    }
+    get_gui().push_option_brick(ctrl);
+    return true;
+  }
+  else if(name==L"colibri_actions.open_latency_menu")
+  {
+    // open latency statistics menu (hidden, shown with Shift held)
+    menu_controller *ctrl=new menu_controller(get_db());
+    const std::vector<logger::latency_summary> summaries=logger::get_latency_summaries();
+    for(std::vector<logger::latency_summary>::const_iterator iter=summaries.begin(); iter!=summaries.end(); ++iter)
+    {
+      std::wostringstream description;
+      description.precision(2);
+      description<<std::fixed<<L"p50 "<<iter->p50/1000.0<<L" ms, p95 "<<iter->p95/1000.0<<L" ms, p99 "<<iter->p99/1000.0<<L" ms, max "<<iter->max/1000.0<<L" ms ("<<iter->num_samples<<L" samples)";
+      ctrl->add_item(std::wstring(iter->name, iter->name+strlen(iter->name)), description.str(), L"colibri/logo", L"colibri_actions.log_latency_statistics");
+    }
+    ctrl->add_item(L"Write to log", L"Write latency statistics to the log", L"colibri/logo", L"colibri_actions.log_latency_statistics");
+    ctrl->add_item(L"Reset", L"Reset latency statistics", L"colibri/logo", L"colibri_actions.reset_latency_statistics");
+    get_gui().push_option_brick(ctrl);
+    return true;
+  }
+  else if(name==L"colibri_actions.log_latency_statistics")
+  {
+    logger::log_latency_summaries();
+    get_gui().hide();
+    return true;
+  }
+  else if(name==L"colibri_actions.reset_latency_statistics")
+  {
+    logger::reset_latency_histograms();
+    get_gui().hide();
+    return true;
+  }
+  else if(name==L"colibri_actions.open_query_menu")
+  {
+    // open query statistics menu (hidden, shown with Shift held)
+    menu_controller *ctrl=new menu_controller(get_db());
+    const std::vector<sqlite_query_profile> profiles=get_sqlite_query_profiles();
+    for(size_t i=0; i<profiles.size() && i<10; ++i)
+    {
+      std::wostringstream description;
+      description.precision(2);
+      description<<std::fixed<<profiles[i].num_executions<<L" executions, "<<profiles[i].num_rows<<L" rows, total "<<profiles[i].total_time/1000.0<<L" ms, max "<<profiles[i].max_time/1000.0<<L" ms";
+      ctrl->add_item(std::wstring(profiles[i].sql.begin(), profiles[i].sql.end()), description.str(), L"colibri/logo", L"colibri_actions.log_query_statistics");
+    }
+    ctrl->add_checkbox_item(L"Query profiling enabled", L"Query profiling disabled", is_query_profiling_enabled(), L"colibri_actions.toggle_query_profiling");
+    ctrl->add_checkbox_item(L"Session recording enabled", L"Session recording disabled", is_session_recording_enabled(), L"colibri_actions.toggle_session_recording");
+    ctrl->add_checkbox_item(L"Tracing enabled", L"Tracing disabled", is_tracing_enabled(), L"colibri_actions.toggle_tracing");
+    ctrl->add_item(L"Write to log", L"Write query statistics to the log", L"colibri/logo", L"colibri_actions.log_query_statistics");
+    ctrl->add_item(L"Reset", L"Reset query statistics", L"colibri/logo", L"colibri_actions.reset_query_statistics");
     get_gui().push_option_brick(ctrl);
     return true;
   }
+  else if(name==L"colibri_actions.toggle_query_profiling")
+  {
+    enable_query_profiling(!is_query_profiling_enabled());
+    return true;
+  }
+  else if(name==L"colibri_actions.toggle_session_recording")
+  {
+    enable_session_recording(!is_session_recording_enabled());
+    return true;
+  }
+  else if(name==L"colibri_actions.toggle_tracing")
+  {
+    enable_tracing(!is_tracing_enabled());
+    return true;
+  }
+  else if(name==L"colibri_actions.log_query_statistics")
+  {
+    log_sqlite_query_profiles();
+    get_gui().hide();
+    return true;
+  }
+  else if(name==L"colibri_actions.reset_query_statistics")
+  {
+    reset_sqlite_query_profiles();
+    get_gui().hide();
+    return true;
+  }
   else if(name==L"colibri_actions.open_preferences_menu")
   {
     /*XXX
@@ -283,6 +389,9 @@ bool colibri_plugin::on_action(const std::wstring &name, boost::optional<databas
   }
   else if(name==L"global.startup")
   {
+    enable_sqlite_profiling(is_query_profiling_enabled());
+    enable_session_recording(is_session_recording_enabled());
+    enable_tracing(is_tracing_enabled());
     if(check_for_updates())
       boost::thread(boost::bind(&colibri_plugin::perform_update_check, this));
   }
@@ -402,6 +511,87 @@ void colibri_plugin::set_monitor(const std::wstring &name)
 }
 //----
 
+bool colibri_plugin::is_query_profiling_enabled() const
+{
+  return get_config().prepare(L"SELECT value FROM settings WHERE key = 'query_profiling.enabled'")->exec().get_bool();
+}
+//----
+
+void colibri_plugin::enable_query_profiling(bool enable)
+{
+  get_config().prepare(L"UPDATE settings SET value = ? WHERE key = 'query_profiling.enabled'")->bind(0, enable).exec();
+  enable_sqlite_profiling(enable);
+}
+//----
+
+bool colibri_plugin::is_session_recording_enabled() const
+{
+  return get_config().prepare(L"SELECT value FROM settings WHERE key = 'session_recording.enabled'")->exec().get_bool();
+}
+//----
+
+void colibri_plugin::enable_session_recording(bool enable)
+{
+  // record anonymized sessions of the main brick to sessions.txt (see
+  // session_recorder), which the benchmark tool replays
+  if(enable!=is_session_recording_enabled())
+    get_config().prepare(L"UPDATE settings SET value = ? WHERE key = 'session_recording.enabled'")->bind(0, enable).exec();
+  if(!enable)
+    m_session_recorder.reset();
+  else if(!m_session_recorder)
+  {
+    try
+    {
+      m_session_recorder.reset(new session_recorder(profile_folder() / L"sessions.txt"));
+    }
+    catch(std::exception &e_)
+    {
+      logger::warnf("Unable to enable session recording: %s", e_.what());
+    }
+  }
+}
+//----
+
+session_recorder *colibri_plugin::get_session_recorder() const
+{
+  return m_session_recorder.get();
+}
+//----
+
+bool colibri_plugin::is_tracing_enabled() const
+{
+  return get_config().prepare(L"SELECT value FROM settings WHERE key = 'tracing.enabled'")->exec().get_bool();
+}
+//----
+
+void colibri_plugin::enable_tracing(bool enable)
+{
+  // trace search and indexing to trace.bin (see trace.h), which records raw
+  // search terms and is thus opt-in
+  if(enable!=is_tracing_enabled())
+    get_config().prepare(L"UPDATE settings SET value = ? WHERE key = 'tracing.enabled'")->bind(0, enable).exec();
+  if(!enable)
+    logger::set_trace_target(std::shared_ptr<logger::trace_target>());
+  else if(!logger::g_is_tracing)
+  {
+    try
+    {
+      logger::set_trace_target(logger::create_trace_file_target(profile_folder() / L"trace.bin", 4*1024*1024));
+    }
+    catch(std::exception &e_)
+    {
+      logger::warnf("Unable to enable tracing: %s", e_.what());
+    }
+  }
+}
+//----
+
+unsigned colibri_plugin::get_icon_cache_size() const
+{
+  return get_config().prepare(L"SELECT value FROM settings WHERE key = 'icon_cache.max_size'")->exec().get_unsigned();
+}
+//----
+
 void colibri_plugin::set_hotkey(const hotkey &hk)
 {
   sqlite_connection &db=get_config();
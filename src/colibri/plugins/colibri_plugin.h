@@ -9,6 +9,7 @@
 #include "plugin.h"
 #include "../gui/gui.h"
 #include <boost/thread/condition.hpp>
+class session_recorder;
 //----------------------------------------------------------------------------
 
 // Interface:
@@ -54,6 +55,7 @@ public:
   //--------------------------------------------------------------------------
 
   // action handling
+  virtual void register_actions();
   virtual bool on_action(const std::wstring &name, boost::optional<database_item> target);
   //--------------------------------------------------------------------------
 
@@ -72,6 +74,14 @@ public:
   void set_theme(const std::wstring&);
   std::wstring get_monitor() const;
   void set_monitor(const std::wstring&);
+  bool is_query_profiling_enabled() const;
+  void enable_query_profiling(bool);
+  bool is_session_recording_enabled() const;
+  void enable_session_recording(bool);
+  session_recorder *get_session_recorder() const; // 0 unless recording
+  bool is_tracing_enabled() const;
+  void enable_tracing(bool);
+  unsigned get_icon_cache_size() const;
   hotkey get_hotkey() const;
   void set_hotkey(const hotkey&);
   //--------------------------------------------------------------------------
@@ -79,6 +89,7 @@ public:
 private:
   void perform_update_check();
   boost::condition m_feedback_allowed;
+  std::shared_ptr<session_recorder> m_session_recorder;
 };
 //----------------------------------------------------------------------------
 
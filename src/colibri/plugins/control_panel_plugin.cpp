@@ -99,7 +99,7 @@ void control_panel_plugin::index(database &db, boost::uint64_t new_index_version
   }
   catch(std::exception&)
   {
-    logger::warnf("Unable to load control panel appel '%S'", path.c_str());
+    LOG_WARNF_LIMITED(10, "Unable to load control panel appel '%S'", path.c_str());
     return;
   }
 
@@ -108,7 +108,7 @@ void control_panel_plugin::index(database &db, boost::uint64_t new_index_version
   cpl_applet *applet=lib->try_lookup<cpl_applet>("CPlApplet");
   if(!applet)
   {
-    logger::warnf("Unable to get control panel applet entry point '%S'", path.c_str());
+    LOG_WARNF_LIMITED(10, "Unable to get control panel applet entry point '%S'", path.c_str());
     return;
   }
 
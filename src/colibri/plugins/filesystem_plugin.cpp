@@ -51,9 +51,10 @@ void filesystem_plugin::index(boost::uint64_t new_index_version)
   // index all folders
   std::shared_ptr<sqlite_statement> stmt=get_config().prepare(L"SELECT path FROM folders");
   stmt->exec();
+  wstring folder;
   while(*stmt)
   {
-    wstring folder=stmt->get_string(0);
+    stmt->get_string_view(0).assign_to(folder);
     index(get_db(), new_index_version, folder);
     stmt->next();
   }
@@ -67,7 +68,7 @@ void filesystem_plugin::index(database &db, boost::uint64_t new_index_version, c
   HANDLE search=FindFirstFileExW((folder+L"\\*").c_str(), FindExInfoStandard, &wfd, FindExSearchNameMatch, 0, 0);
   if(INVALID_HANDLE_VALUE==search)
   {
-    logger::warnf("unable to index directory: %S", folder.c_str());
+    LOG_WARNF_LIMITED(10, "unable to index directory: %S", folder.c_str());
     return;
   }
 
@@ -113,5 +114,8 @@ void filesystem_plugin::index(database &db, boost::uint64_t new_index_version, c
   }
   while(FindNextFileW(search, &wfd));
   FindClose(search);
+
+  // commit large crawls in chunks
+  db.commit_index_chunk();
 }
 //----------------------------------------------------------------------------
@@ -23,12 +23,15 @@ void plugin::init(database &db)
   m_config.reset(new sqlite_connection((profile_folder() / (name + L".sqlite")).string()));
 
   // update settings (and schema)
+  sqlite_transaction schema_transaction(*m_config, sqlite_transaction::mode_immediate);
   unsigned current_version=m_config->begin_schema_update();
   m_config->prepare(L"INSERT OR IGNORE INTO meta (key, value) VALUES ('plugin.next_index_version', 1)")->exec();
   unsigned new_version=update_config(current_version);
   m_config->end_schema_update(name.c_str(), new_version);
+  schema_transaction.commit();
 
-  // trigger plugin-specific startup code
+  // register handled actions and trigger plugin-specific startup code
+  register_actions();
   on_action(L"global.startup", boost::none);
 }
 //----
@@ -76,8 +79,25 @@ void plugin::index(boost::uint64_t index_version)
 }
 //----------------------------------------------------------------------------
 
+void plugin::register_actions()
+{
+}
+//----
+
 bool plugin::on_action(const std::wstring &name, boost::optional<database_item> target)
 {
   return false;
 }
 //----------------------------------------------------------------------------
+
+void plugin::register_action(const wchar_t *name)
+{
+  get_db().register_action(name, *this);
+}
+//----
+
+void plugin::register_action_prefix(const wchar_t *prefix)
+{
+  get_db().register_action_prefix(prefix, *this);
+}
+//----------------------------------------------------------------------------
@@ -44,9 +44,16 @@ public:
   //--------------------------------------------------------------------------
 
   // action handling
+  virtual void register_actions();
   virtual bool on_action(const std::wstring &name, boost::optional<database_item> target);
   //--------------------------------------------------------------------------
 
+protected:
+  // action registration (see database::trigger_action())
+  void register_action(const wchar_t *name);
+  void register_action_prefix(const wchar_t *prefix);
+  //--------------------------------------------------------------------------
+
 private:
   std::shared_ptr<sqlite_connection> m_config;
   gui *m_gui;
@@ -87,19 +87,22 @@ void search_engines_plugin::index(boost::uint64_t new_index_version)
   // add search engines
   std::shared_ptr<sqlite_statement> stmt=get_config().prepare(L"SELECT uid, title, description, icon_basename FROM search_engines");
   stmt->exec();
+  database_item item;
+  item.plugin_id=get_name();
+  item.is_transient=false;
+  item.icon_info.source=icon_source_theme;
+  item.on_enter=L"search_engine.open_homepage";
+  item.on_tab=L"search_engine.open_brick";
+  item.index_version=new_index_version;
   while(*stmt)
   {
-    // prepare database item
-    database_item item;
-    item.plugin_id=get_name();
-    item.item_id=stmt->get_string(0);
-    item.title=stmt->get_string(1);
-    item.description=stmt->get_string(2);
-    item.is_transient=false;
-    item.icon_info.set(icon_source_theme, L"search_engines/"+stmt->get_string(3));
-    item.on_enter=L"search_engine.open_homepage";
-    item.on_tab=L"search_engine.open_brick";
-    item.index_version=new_index_version;
+    // prepare database item (reusing the strings of the previous one)
+    stmt->get_string_view(0).assign_to(item.item_id);
+    stmt->get_string_view(1).assign_to(item.title);
+    stmt->get_string_view(2).assign_to(item.description);
+    const sqlite_string_view icon_basename=stmt->get_string_view(3);
+    item.icon_info.path.assign(L"search_engines/");
+    item.icon_info.path.append(icon_basename.data, icon_basename.size);
 
     // add or update database
     get_db().add_or_update_item(item);
@@ -108,6 +111,12 @@ void search_engines_plugin::index(boost::uint64_t new_index_version)
 }
 //----------------------------------------------------------------------------
 
+void search_engines_plugin::register_actions()
+{
+  register_action_prefix(L"search_engine.");
+}
+//----
+
 bool search_engines_plugin::on_action(const std::wstring &name, boost::optional<database_item> target)
 {
   if(L"search_engine.open_homepage"==name && target)
@@ -56,6 +56,12 @@ void standard_actions_plugin::index(boost::uint64_t new_index_version)
 }
 //----------------------------------------------------------------------------
 
+void standard_actions_plugin::register_actions()
+{
+  register_action_prefix(L"standard_actions.");
+}
+//----
+
 bool standard_actions_plugin::on_action(const std::wstring &name, boost::optional<database_item> target)
 {
   if(L"standard_actions.launch"==name && target)
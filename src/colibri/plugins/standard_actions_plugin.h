@@ -34,6 +34,7 @@ public:
   //--------------------------------------------------------------------------
 
   // action handling
+  virtual void register_actions();
   virtual bool on_action(const std::wstring &name, boost::optional<database_item> target);
 };
 //----------------------------------------------------------------------------
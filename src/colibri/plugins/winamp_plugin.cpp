@@ -102,13 +102,14 @@ void winamp_plugin::index(boost::uint64_t new_index_version)
 }
 //----------------------------------------------------------------------------
 
-bool winamp_plugin::on_action(const std::wstring &name, boost::optional<database_item> target)
+void winamp_plugin::register_actions()
 {
-  // XXX: filter actions by plugin name
-  static const std::wstring prefix(L"winamp_actions.");
-  if(name.compare(0, prefix.length(), prefix)!=0)
-    return false;
+  register_action_prefix(L"winamp_actions.");
+}
+//----
 
+bool winamp_plugin::on_action(const std::wstring &name, boost::optional<database_item> target)
+{
   // check whether winamp is running
   HWND winamp=get_winamp();
   if(!winamp)
@@ -4,6 +4,7 @@
 #define WM_COLIBRI_ACTIVATE   (WM_USER+0)
 #define WM_COLIBRI_TRAYICON   (WM_USER+1)
 #define WM_COLIBRI_RESTART    (WM_USER+2)
+#define WM_COLIBRI_ICON_LOADED (WM_USER+3)
 
 #define IDI_COLIBRI             100
 #define IDI_COLIBRI_L           102
@@ -0,0 +1,344 @@
+//============================================================================
+// main.cpp: Colibri trace decoder
+//
+// Converts binary trace files (see libraries/log/trace.h) to text, e.g.
+// "trace_decoder trace.bin.old trace.bin > trace.txt".
+//
+// (c) Michael Walter, 2005-2007
+//============================================================================
+
+#include "../colibri/libraries/log/trace.h"
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <map>
+#include <string>
+#include <vector>
+#include <stdexcept>
+#ifdef _MSC_VER
+#define snprintf _snprintf
+#endif
+using namespace std;
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// trace_reader
+//============================================================================
+class trace_reader
+{
+public:
+  // construction and destruction
+  trace_reader(const char *filename)
+    :m_file(fopen(filename, "rb"))
+  {
+    if(!m_file)
+      throw runtime_error(string("Unable to open '")+filename+"'.");
+  }
+  //----
+
+  ~trace_reader()
+  {
+    fclose(m_file);
+  }
+  //--------------------------------------------------------------------------
+
+  // reading
+  bool at_end()
+  {
+    const int c=getc(m_file);
+    if(EOF==c)
+      return true;
+    ungetc(c, m_file);
+    return false;
+  }
+  //----
+
+  unsigned get_u8()
+  {
+    const int c=getc(m_file);
+    if(EOF==c)
+      throw runtime_error("Unexpected end of trace file.");
+    return unsigned(c);
+  }
+  //----
+
+  unsigned get_u16()
+  {
+    const unsigned lo=get_u8();
+    return lo|(get_u8()<<8);
+  }
+  //----
+
+  unsigned get_u32()
+  {
+    const unsigned lo=get_u16();
+    return lo|(get_u16()<<16);
+  }
+  //----
+
+  unsigned long long get_u64()
+  {
+    const unsigned long long lo=get_u32();
+    return lo|((unsigned long long)get_u32()<<32);
+  }
+  //----
+
+  string get_string()
+  {
+    string s(get_u16(), 0);
+    for(size_t i=0; i<s.size(); ++i)
+      s[i]=char(get_u8());
+    return s;
+  }
+  //----
+
+  string get_wstring()
+  {
+    // convert UTF-16 to UTF-8
+    const unsigned num_units=get_u16();
+    string s;
+    for(unsigned i=0; i<num_units; ++i)
+    {
+      unsigned c=get_u16();
+      if(c>=0xd800 && c<0xdc00 && i+1<num_units)
+      {
+        c=0x10000+((c-0xd800)<<10)+(get_u16()-0xdc00);
+        ++i;
+      }
+      if(c<0x80)
+        s+=char(c);
+      else if(c<0x800)
+      {
+        s+=char(0xc0|(c>>6));
+        s+=char(0x80|(c&0x3f));
+      }
+      else if(c<0x10000)
+      {
+        s+=char(0xe0|(c>>12));
+        s+=char(0x80|((c>>6)&0x3f));
+        s+=char(0x80|(c&0x3f));
+      }
+      else
+      {
+        s+=char(0xf0|(c>>18));
+        s+=char(0x80|((c>>12)&0x3f));
+        s+=char(0x80|((c>>6)&0x3f));
+        s+=char(0x80|(c&0x3f));
+      }
+    }
+    return s;
+  }
+  //--------------------------------------------------------------------------
+
+private:
+  FILE *m_file;
+};
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// trace_value
+//============================================================================
+struct trace_value
+{
+  logger::e_trace_arg_type type;
+  unsigned long long bits;
+  string text;
+};
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// trace_site_info
+//============================================================================
+struct trace_site_info
+{
+  string file;
+  unsigned line;
+  string format;
+};
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// format_value()
+//============================================================================
+string format_value(const string &spec, char conversion, const trace_value &value)
+{
+  // format according to the argument type, honouring the conversion if it fits
+  char buffer[256];
+  switch(value.type)
+  {
+    case logger::trace_arg_int:
+    case logger::trace_arg_uint:
+    {
+      const bool is_int_conversion=0!=strchr("diouxXc", conversion);
+      const char c=is_int_conversion ? conversion : value.type==logger::trace_arg_int ? 'd' : 'u';
+      if('c'==c)
+        return string(1, char(value.bits));
+      const string fmt=spec+"ll"+c;
+      if(value.type==logger::trace_arg_int)
+        snprintf(buffer, sizeof(buffer), fmt.c_str(), (long long)value.bits);
+      else
+        snprintf(buffer, sizeof(buffer), fmt.c_str(), value.bits);
+    } break;
+
+    case logger::trace_arg_float:
+    {
+      double f;
+      memcpy(&f, &value.bits, sizeof(f));
+      const string fmt=spec+(strchr("fFeEgG", conversion) ? conversion : 'g');
+      snprintf(buffer, sizeof(buffer), fmt.c_str(), f);
+    } break;
+
+    default: return value.text;
+  }
+  buffer[sizeof(buffer)-1]=0;
+  return buffer;
+}
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// format_message()
+//============================================================================
+string format_message(const string &format, const vector<trace_value> &values)
+{
+  // substitute printf-style conversions with the recorded arguments
+  string message;
+  size_t arg_index=0;
+  for(size_t i=0; i<format.size(); ++i)
+  {
+    if('%'!=format[i] || i+1==format.size())
+    {
+      message+=format[i];
+      continue;
+    }
+    if('%'==format[i+1])
+    {
+      message+='%';
+      ++i;
+      continue;
+    }
+
+    // split conversion into flags/width/precision and conversion character
+    size_t end=i+1;
+    string spec("%");
+    while(end<format.size() && strchr("-+ #0123456789.", format[end]))
+      spec+=format[end++];
+    while(end<format.size() && strchr("hlLqjzt", format[end]))
+      ++end;
+    const char conversion=end<format.size() ? format[end] : 0;
+    i=end;
+    message+=arg_index<values.size() ? format_value(spec, conversion, values[arg_index++]) : "<missing>";
+  }
+  return message;
+}
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// decode()
+//============================================================================
+void decode(const char *filename)
+{
+  // read header
+  trace_reader reader(filename);
+  if(logger::trace_file_magic!=reader.get_u32())
+    throw runtime_error(string("'")+filename+"' is not a trace file.");
+  if(logger::trace_file_version!=reader.get_u32())
+    throw runtime_error(string("'")+filename+"' has an unsupported trace file version.");
+  const time_t start_time=time_t(reader.get_u64());
+  const unsigned long long start_ticks=reader.get_u64();
+
+  // read records
+  static const char *s_levels[]={"DEBUG", "INFO", "WARN", "ERROR"};
+  map<unsigned, trace_site_info> sites;
+  vector<trace_value> values;
+  while(!reader.at_end())
+  {
+    switch(reader.get_u8())
+    {
+      case logger::trace_tag_site:
+      {
+        const unsigned id=reader.get_u32();
+        trace_site_info &site=sites[id];
+        site.line=reader.get_u32();
+        site.file=reader.get_string();
+        site.format=reader.get_string();
+      } break;
+
+      case logger::trace_tag_event:
+      {
+        // read event
+        const unsigned level=reader.get_u8();
+        const unsigned long long ticks=reader.get_u64();
+        const unsigned thread_id=reader.get_u32();
+        const unsigned site_id=reader.get_u32();
+        const unsigned num_args=reader.get_u8();
+        values.resize(num_args);
+        for(unsigned i=0; i<num_args; ++i)
+        {
+          trace_value &value=values[i];
+          value.type=logger::e_trace_arg_type(reader.get_u8());
+          value.bits=0;
+          value.text.clear();
+          switch(value.type)
+          {
+            case logger::trace_arg_int:
+            case logger::trace_arg_uint:
+            case logger::trace_arg_float: value.bits=reader.get_u64(); break;
+            case logger::trace_arg_string: value.text=reader.get_string(); break;
+            case logger::trace_arg_wstring: value.text=reader.get_wstring(); break;
+            default: throw runtime_error("Invalid argument type in trace file.");
+          }
+        }
+
+        // print time stamp and site
+        const unsigned long long elapsed=ticks>=start_ticks ? ticks-start_ticks : 0;
+        const time_t time=start_time+time_t(elapsed/1000000);
+        char time_text[32];
+        strftime(time_text, sizeof(time_text), "%Y-%m-%d %H:%M:%S", localtime(&time));
+        printf("%s.%06u [%s] %5u ", time_text, unsigned(elapsed%1000000), level<4 ? s_levels[level] : "?", thread_id);
+        map<unsigned, trace_site_info>::const_iterator site=sites.find(site_id);
+        if(site==sites.end())
+        {
+          printf("<unknown site %u>\n", site_id);
+          break;
+        }
+        printf("%s(%u): %s\n", site->second.file.c_str(), site->second.line, format_message(site->second.format, values).c_str());
+      } break;
+
+      default: throw runtime_error("Invalid record in trace file.");
+    }
+  }
+}
+//----------------------------------------------------------------------------
+
+
+//============================================================================
+// main
+//============================================================================
+int main(int argc, char **argv)
+{
+  if(argc<2)
+  {
+    fprintf(stderr, "Usage: trace_decoder <trace file>...\n");
+    return 1;
+  }
+
+  try
+  {
+    for(int i=1; i<argc; ++i)
+      decode(argv[i]);
+  }
+  catch(exception &e_)
+  {
+    fflush(stdout);
+    fprintf(stderr, "Error: %s\n", e_.what());
+    return 1;
+  }
+  return 0;
+}
+//----------------------------------------------------------------------------